@@ -0,0 +1,124 @@
+/**
+ * @file bench_chan.c
+ * @brief Throughput of channels between green threads
+ *
+ * Producers send BENCH_MESSAGES integers in total through one channel to
+ * consumers that receive until it is closed, in three topologies:
+ *  - pair: one producer, one consumer,
+ *  - fan-in: BENCH_FAN producers, one consumer,
+ *  - fan-out: one producer, BENCH_FAN consumers,
+ * with an unbuffered, a buffered and an unbounded channel. The benchmark
+ * reports, as CSV, the messages delivered per second.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "chan.h"
+#include "sched_policy.h"
+#include "schedule.h"
+#include "thread.h"
+#include "thread_info.h"
+
+#define BENCH_MESSAGES 200000
+#define BENCH_FAN 4
+#define BENCH_BUFFER 64
+
+static l1_chan chan;
+static unsigned producers, consumers;
+
+static void *producer(void *arg)
+{
+  for (intptr_t i = 0; i < BENCH_MESSAGES / producers; i++)
+  {
+    l1_chan_send(&chan, &i);
+  }
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  intptr_t received = 0, value;
+  while (l1_chan_recv(&chan, &value) == SUCCESS)
+  {
+    received++;
+  }
+  return (void *)received;
+}
+
+static void *root(void *arg)
+{
+  l1_tid tids[2 * BENCH_FAN];
+  for (unsigned i = 0; i < consumers; i++)
+  {
+    l1_thread_create(&tids[i], consumer, NULL);
+  }
+  for (unsigned i = 0; i < producers; i++)
+  {
+    l1_thread_create(&tids[consumers + i], producer, NULL);
+  }
+  for (unsigned i = 0; i < producers; i++)
+  {
+    l1_thread_join(tids[consumers + i], NULL);
+  }
+  l1_chan_close(&chan);
+  intptr_t received = 0;
+  for (unsigned i = 0; i < consumers; i++)
+  {
+    void *ret;
+    l1_thread_join(tids[i], &ret);
+    received += (intptr_t)ret;
+  }
+  return (void *)received;
+}
+
+/* Returns the elapsed time in ns */
+static uint64_t run(size_t capacity)
+{
+  initialize_scheduler(&l1_round_robin_policy);
+  l1_chan_init(&chan, sizeof(intptr_t), capacity);
+  l1_tid tid;
+  l1_thread_create(&tid, root, NULL);
+  uint64_t start = l1_time_monotonic_ns();
+  schedule();
+  uint64_t elapsed = l1_time_monotonic_ns() - start;
+
+  l1_thread_info *zombie = thread_list_find(&get_scheduler()->thread_arrays[ZOMBIE], tid);
+  if (zombie == NULL || (intptr_t)zombie->retval != BENCH_MESSAGES)
+  {
+    fprintf(stderr, "Error: lost messages\n");
+    exit(1);
+  }
+  l1_chan_destroy(&chan);
+  clean_up_scheduler();
+  return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+  struct
+  {
+    const char *name;
+    unsigned producers;
+    unsigned consumers;
+  } topologies[] = {{"pair", 1, 1}, {"fan-in", BENCH_FAN, 1}, {"fan-out", 1, BENCH_FAN}};
+  struct
+  {
+    const char *name;
+    size_t capacity;
+  } capacities[] = {{"0", 0}, {"64", BENCH_BUFFER}, {"unbounded", L1_CHAN_UNBOUNDED}};
+
+  printf("topology,capacity,producers,consumers,messages,elapsed_ms,msgs_per_sec\n");
+  for (size_t t = 0; t < sizeof(topologies) / sizeof(topologies[0]); t++)
+  {
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++)
+    {
+      producers = topologies[t].producers;
+      consumers = topologies[t].consumers;
+      uint64_t elapsed = run(capacities[c].capacity);
+      printf("%s,%s,%u,%u,%d,%.2f,%.0f\n", topologies[t].name, capacities[c].name, producers,
+             consumers, BENCH_MESSAGES, (double)elapsed / L1_NSEC_PER_MSEC,
+             BENCH_MESSAGES * (double)L1_NSEC_PER_SEC / elapsed);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file bench_chunk.c
+ * @brief Allocation time of the chunk allocator against fragmentation
+ *
+ * The arena is first cut into regions of one chunk, and every other region
+ * is freed, leaving holes of one chunk, over a share of the arena
+ * that grows from 0 to all of it. The benchmark then times BENCH_ROUNDS
+ * l1_chunk_malloc and l1_chunk_free pairs of regions that fit in the holes,
+ * and of regions too large for them, and reports, as CSV, the best time
+ * per pair of BENCH_REPEATS runs.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "l1_time.h"
+#include "malloc.h"
+
+#define BENCH_ROUNDS 20000
+#define BENCH_REPEATS 5
+
+void *(*l1_malloc)(size_t) = l1_chunk_malloc;
+l1_error (*l1_free)(void *) = l1_chunk_free;
+void (*l1_init)(void) = l1_chunk_init;
+void (*l1_deinit)(void) = l1_chunk_deinit;
+
+static void *regions[CHUNK_ARENA_LENGTH];
+
+/* Fragments the first `fragmented` chunks of the arena */
+static void fragment(size_t fragmented)
+{
+  size_t count = 0;
+  for (size_t chunk = 0; chunk < fragmented; chunk++)
+  {
+    regions[count++] = l1_malloc(1);
+  }
+  for (size_t i = 0; i < count; i += 2)
+  {
+    l1_free(regions[i]);
+  }
+}
+
+static double time_pairs(size_t size)
+{
+  uint64_t best = UINT64_MAX;
+  for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+  {
+    uint64_t start = l1_time_monotonic_ns();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+      void *ptr = l1_malloc(size);
+      if (ptr == NULL)
+      {
+        fprintf(stderr, "Error: the benchmark arena is full\n");
+        exit(1);
+      }
+      l1_free(ptr);
+    }
+    uint64_t elapsed = l1_time_monotonic_ns() - start;
+    best = (elapsed < best) ? elapsed : best;
+  }
+  return (double)best / BENCH_ROUNDS;
+}
+
+int main(int argc, char **argv)
+{
+  printf("fragmented_chunks,small_ns_per_pair,large_ns_per_pair\n");
+  for (size_t fragmented = 0; fragmented <= CHUNK_ARENA_LENGTH * 3 / 4; fragmented += CHUNK_ARENA_LENGTH / 8)
+  {
+    l1_init();
+    fragment(fragmented);
+    double small = time_pairs(1);
+    double large = time_pairs(8 * CHUNK_SIZE);
+    printf("%zu,%.1f,%.1f\n", fragmented, small, large);
+    l1_deinit();
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file bench_classes.c
+ * @brief Latency of interactive threads next to a large batch job
+ *
+ * BENCH_BATCH_THREADS CPU-bound threads (or argv[1]) spin and yield next to
+ * BENCH_INTERACTIVE_THREADS threads that sleep 1 ms and run briefly, for
+ * BENCH_DURATION_NS, first with every thread under one policy, then under
+ * l1_class_policy with the sleepers in the interactive class and the
+ * spinners in the batch class. The benchmark reports, as CSV, the delay
+ * between the end of a sleep and the run of the sleeper, and the share of
+ * the switches that went to the batch threads.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "histogram.h"
+#include "sched_policy.h"
+#include "schedule.h"
+#include "stats.h"
+#include "thread.h"
+
+#define BENCH_BATCH_THREADS 10000
+#define BENCH_INTERACTIVE_THREADS 4
+#define BENCH_BURST_ITERS 2000
+#define BENCH_DURATION_NS (300 * L1_NSEC_PER_MSEC)
+
+static long batch_threads = BENCH_BATCH_THREADS;
+static l1_histogram response;
+static uint64_t deadline_ns;
+static uint64_t batch_switches;
+static bool use_classes;
+
+static void *spinner(void *arg)
+{
+  while (l1_time_monotonic_ns() < deadline_ns)
+  {
+    for (volatile int i = 0; i < BENCH_BURST_ITERS; i++)
+      ;
+    batch_switches++;
+    yield(-1);
+  }
+  return NULL;
+}
+
+static void *sleeper(void *arg)
+{
+  while (l1_time_monotonic_ns() < deadline_ns)
+  {
+    uint64_t due = l1_time_monotonic_ns() + L1_NSEC_PER_MSEC;
+    l1_sleep(L1_NSEC_PER_MSEC);
+    uint64_t now = l1_time_monotonic_ns();
+    l1_histogram_record(&response, (now > due) ? now - due : 0);
+    for (volatile int i = 0; i < BENCH_BURST_ITERS; i++)
+      ;
+  }
+  return NULL;
+}
+
+static void spawn(l1_sched_class sched_class, void *(*routine)(void *), l1_tid *tid)
+{
+  l1_thread_attr attr = {.detached = (tid == NULL), .sched_class = use_classes ? sched_class : 0};
+  l1_tid ignored;
+  if (l1_thread_create_attr((tid != NULL) ? tid : &ignored, &attr, routine, NULL) != SUCCESS)
+  {
+    fprintf(stderr, "Error: unable to create benchmark thread\n");
+    exit(1);
+  }
+}
+
+static void *driver(void *arg)
+{
+  l1_tid tids[BENCH_INTERACTIVE_THREADS];
+  deadline_ns = l1_time_monotonic_ns() + BENCH_DURATION_NS;
+  for (long i = 0; i < batch_threads; i++)
+  {
+    spawn(L1_CLASS_BATCH, spinner, NULL);
+  }
+  for (int i = 0; i < BENCH_INTERACTIVE_THREADS; i++)
+  {
+    spawn(L1_CLASS_INTERACTIVE, sleeper, &tids[i]);
+  }
+  for (int i = 0; i < BENCH_INTERACTIVE_THREADS; i++)
+  {
+    l1_thread_join(tids[i], NULL);
+  }
+  return NULL;
+}
+
+static void run(const char *name, const sched_policy *policy)
+{
+  l1_histogram_init(&response);
+  batch_switches = 0;
+  use_classes = (policy == &l1_class_policy);
+  initialize_scheduler(policy);
+  l1_tid tid;
+  l1_thread_create(&tid, driver, NULL);
+  schedule();
+  const l1_sched_stats_info *stats = l1_sched_stats();
+  printf("%s,%ld,%llu,%.1f,%.1f,%.1f,%.3f\n", name, batch_threads,
+         (unsigned long long)response.count,
+         (double)l1_histogram_quantile(&response, 0.5) / L1_NSEC_PER_USEC,
+         (double)l1_histogram_quantile(&response, 0.99) / L1_NSEC_PER_USEC,
+         (double)response.max / L1_NSEC_PER_USEC, (double)batch_switches / stats->switches);
+  fflush(stdout);
+  clean_up_scheduler();
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    batch_threads = strtol(argv[1], NULL, 10);
+  }
+  printf("policy,batch_threads,wakeups,response_p50_us,response_p99_us,response_max_us,"
+         "batch_share\n");
+  run("round_robin", &l1_round_robin_policy);
+  run("mlfq", &l1_mlfq_policy);
+  run("fair_share", &l1_fair_share_policy);
+  run("classes", &l1_class_policy);
+  return 0;
+}
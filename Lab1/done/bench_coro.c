@@ -0,0 +1,106 @@
+/**
+ * @file bench_coro.c
+ * @brief Cost of a generator step: coroutine versus green threads
+ *
+ * A generator produces N integers that a consumer sums, either as a
+ * coroutine resumed by the consumer, or as a green thread that hands each
+ * value over through a shared slot and yields to the consumer thread, which
+ * yields back, so that every value takes a round trip through the
+ * scheduler. The benchmark reports, as CSV, the time per value of each.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "coro.h"
+#include "sched_policy.h"
+#include "schedule.h"
+#include "thread.h"
+#include "thread_info.h"
+
+#define BENCH_MAX_ITEMS (1 << 20)
+
+static intptr_t slot;
+static intptr_t sum;
+
+static void *coro_generator(void *arg)
+{
+  for (intptr_t i = 0; i < (intptr_t)arg; i++)
+  {
+    l1_coro_yield((void *)i);
+  }
+  return NULL;
+}
+
+static void *coro_consumer(void *arg)
+{
+  l1_coro *coro;
+  l1_coro_create(&coro, coro_generator, arg);
+  void *value;
+  while (l1_coro_resume(coro, &value) == SUCCESS && !l1_coro_is_done(coro))
+  {
+    sum += (intptr_t)value;
+  }
+  l1_coro_destroy(coro);
+  return NULL;
+}
+
+/* Round robin runs the two threads alternately */
+static void *thread_generator(void *arg)
+{
+  for (intptr_t i = 0; i < (intptr_t)arg; i++)
+  {
+    slot = i;
+    yield(-1);
+  }
+  return NULL;
+}
+
+static void *thread_consumer(void *arg)
+{
+  for (intptr_t i = 0; i < (intptr_t)arg; i++)
+  {
+    sum += slot;
+    yield(-1);
+  }
+  return NULL;
+}
+
+/* Returns the elapsed time in ns */
+static uint64_t run(bool coro, intptr_t count)
+{
+  initialize_scheduler(&l1_round_robin_policy);
+  l1_tid tid;
+  sum = 0;
+  if (coro)
+  {
+    l1_thread_create(&tid, coro_consumer, (void *)count);
+  }
+  else
+  {
+    l1_thread_create(&tid, thread_generator, (void *)count);
+    l1_thread_create(&tid, thread_consumer, (void *)count);
+  }
+  uint64_t start = l1_time_monotonic_ns();
+  schedule();
+  uint64_t elapsed = l1_time_monotonic_ns() - start;
+  if (sum != count * (count - 1) / 2)
+  {
+    fprintf(stderr, "Error: lost values\n");
+    exit(1);
+  }
+  clean_up_scheduler();
+  return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+  printf("items,coro_ns_per_item,thread_ns_per_item,speedup\n");
+  for (intptr_t count = 1024; count <= BENCH_MAX_ITEMS; count *= 32)
+  {
+    uint64_t coro = run(true, count);
+    uint64_t thread = run(false, count);
+    printf("%ld,%.1f,%.1f,%.2f\n", (long)count, (double)coro / count, (double)thread / count,
+           (double)thread / coro);
+  }
+  return 0;
+}
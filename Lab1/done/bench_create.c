@@ -0,0 +1,113 @@
+/**
+ * @file bench_create.c
+ * @brief Creation cost of many threads, one by one against in a batch
+ *
+ * A green thread creates BENCH_THREADS threads (or argv[1]) that return at
+ * once, either with as many calls to l1_thread_create or with one call to
+ * l1_thread_create_many, then joins them in order. Each way runs
+ * BENCH_ROUNDS times, alternately, in a fresh scheduler. The benchmark
+ * reports, as CSV, the best time per thread of the creation alone and of
+ * the whole round (creation, run and join).
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sched_policy.h"
+#include "schedule.h"
+#include "thread.h"
+
+#define BENCH_THREADS 100000
+#define BENCH_ROUNDS 3
+
+static long thread_count = BENCH_THREADS;
+static l1_tid *tids;
+static uint64_t create_ns;
+
+static void *returner(void *arg)
+{
+  return arg;
+}
+
+static void *create_single(void *arg)
+{
+  uint64_t start = l1_time_monotonic_ns();
+  for (long i = 0; i < thread_count; i++)
+  {
+    if (l1_thread_create(&tids[i], returner, NULL) != SUCCESS)
+    {
+      fprintf(stderr, "Error: unable to create benchmark thread\n");
+      exit(1);
+    }
+  }
+  create_ns = l1_time_monotonic_ns() - start;
+  for (long i = 0; i < thread_count; i++)
+  {
+    l1_thread_join(tids[i], NULL);
+  }
+  return NULL;
+}
+
+static void *create_batch(void *arg)
+{
+  uint64_t start = l1_time_monotonic_ns();
+  if (l1_thread_create_many(thread_count, returner, NULL, tids) != SUCCESS)
+  {
+    fprintf(stderr, "Error: unable to create benchmark threads\n");
+    exit(1);
+  }
+  create_ns = l1_time_monotonic_ns() - start;
+  for (long i = 0; i < thread_count; i++)
+  {
+    l1_thread_join(tids[i], NULL);
+  }
+  return NULL;
+}
+
+/* Returns the length of the round in ns, create_ns that of the creation */
+static uint64_t run(void *(*driver)(void *))
+{
+  uint64_t start = l1_time_monotonic_ns();
+  initialize_scheduler(&l1_round_robin_policy);
+  l1_tid tid;
+  l1_thread_create(&tid, driver, NULL);
+  schedule();
+  clean_up_scheduler();
+  return l1_time_monotonic_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    thread_count = strtol(argv[1], NULL, 10);
+  }
+  tids = malloc(thread_count * sizeof(l1_tid));
+  if (tids == NULL)
+  {
+    fprintf(stderr, "Error: unable to allocate the thread IDs\n");
+    return 1;
+  }
+  const struct
+  {
+    const char *name;
+    void *(*driver)(void *);
+  } modes[] = {{"single", create_single}, {"batch", create_batch}};
+  uint64_t best_create[2] = {UINT64_MAX, UINT64_MAX}, best_round[2] = {UINT64_MAX, UINT64_MAX};
+  for (int round = 0; round < BENCH_ROUNDS; round++)
+  {
+    for (int mode = 0; mode < 2; mode++)
+    {
+      uint64_t round_ns = run(modes[mode].driver);
+      best_create[mode] = (create_ns < best_create[mode]) ? create_ns : best_create[mode];
+      best_round[mode] = (round_ns < best_round[mode]) ? round_ns : best_round[mode];
+    }
+  }
+  printf("mode,threads,create_ns_per_thread,round_ns_per_thread\n");
+  for (int mode = 0; mode < 2; mode++)
+  {
+    printf("%s,%ld,%.1f,%.1f\n", modes[mode].name, thread_count,
+           (double)best_create[mode] / thread_count, (double)best_round[mode] / thread_count);
+  }
+  free(tids);
+  return 0;
+}
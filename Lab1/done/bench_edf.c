@@ -0,0 +1,111 @@
+/**
+ * @file bench_edf.c
+ * @brief Tail latency of threads with deadlines under load, EDF against MLFQ
+ *
+ * BENCH_HANDLERS request handlers each sleep BENCH_INTERVAL_NS, the arrival
+ * of a request, then serve it within BENCH_BUDGET_NS: BENCH_STEPS bursts of
+ * work separated by yields. BENCH_CPU_THREADS CPU-bound threads without
+ * deadline spin and yield next to them for BENCH_DURATION_NS. The benchmark
+ * reports, as CSV, per policy, the latency of the requests from their
+ * arrival to their completion, the deadline misses, and the share of the
+ * switches that went to the CPU-bound threads.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "histogram.h"
+#include "sched_policy.h"
+#include "schedule.h"
+#include "stats.h"
+#include "thread.h"
+
+#define BENCH_HANDLERS 4
+#define BENCH_CPU_THREADS 8
+#define BENCH_STEPS 4
+#define BENCH_STEP_ITERS 5000
+#define BENCH_BURST_ITERS 20000
+#define BENCH_INTERVAL_NS (2 * L1_NSEC_PER_MSEC)
+#define BENCH_BUDGET_NS (L1_NSEC_PER_MSEC)
+#define BENCH_DURATION_NS (500 * L1_NSEC_PER_MSEC)
+
+static l1_histogram latency;
+static uint64_t deadline_ns;
+static uint64_t background_switches;
+
+static void *handler(void *arg)
+{
+  while (l1_time_monotonic_ns() < deadline_ns)
+  {
+    uint64_t arrival = l1_time_monotonic_ns() + BENCH_INTERVAL_NS;
+    l1_sleep(BENCH_INTERVAL_NS);
+    l1_thread_set_deadline(BENCH_BUDGET_NS);
+    for (int step = 0; step < BENCH_STEPS; step++)
+    {
+      for (volatile int i = 0; i < BENCH_STEP_ITERS; i++)
+        ;
+      yield(-1);
+    }
+    uint64_t now = l1_time_monotonic_ns();
+    l1_histogram_record(&latency, (now > arrival) ? now - arrival : 0);
+    l1_thread_set_deadline(0);
+  }
+  return NULL;
+}
+
+static void *cpu_bound(void *arg)
+{
+  while (l1_time_monotonic_ns() < deadline_ns)
+  {
+    for (volatile int i = 0; i < BENCH_BURST_ITERS; i++)
+      ;
+    background_switches++;
+    yield(-1);
+  }
+  return NULL;
+}
+
+static void *driver(void *arg)
+{
+  l1_tid tids[BENCH_HANDLERS + BENCH_CPU_THREADS];
+  deadline_ns = l1_time_monotonic_ns() + BENCH_DURATION_NS;
+  for (int i = 0; i < BENCH_HANDLERS + BENCH_CPU_THREADS; i++)
+  {
+    if (l1_thread_create(&tids[i], (i < BENCH_HANDLERS) ? handler : cpu_bound, NULL) != SUCCESS)
+    {
+      fprintf(stderr, "Error: unable to create benchmark thread\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < BENCH_HANDLERS + BENCH_CPU_THREADS; i++)
+  {
+    l1_thread_join(tids[i], NULL);
+  }
+  return NULL;
+}
+
+static void run(const char *name, const sched_policy *policy)
+{
+  l1_histogram_init(&latency);
+  background_switches = 0;
+  initialize_scheduler(policy);
+  l1_tid tid;
+  l1_thread_create(&tid, driver, NULL);
+  schedule();
+  const l1_sched_stats_info *stats = l1_sched_stats();
+  printf("%s,%llu,%.1f,%.1f,%.1f,%llu,%.3f\n", name, (unsigned long long)latency.count,
+         (double)l1_histogram_quantile(&latency, 0.5) / L1_NSEC_PER_USEC,
+         (double)l1_histogram_quantile(&latency, 0.99) / L1_NSEC_PER_USEC,
+         (double)latency.max / L1_NSEC_PER_USEC, (unsigned long long)stats->deadline_misses,
+         (double)background_switches / stats->switches);
+  fflush(stdout);
+  clean_up_scheduler();
+}
+
+int main(int argc, char **argv)
+{
+  printf("policy,requests,latency_p50_us,latency_p99_us,latency_max_us,deadline_misses,"
+         "background_share\n");
+  run("edf", &l1_edf_policy);
+  run("mlfq", &l1_mlfq_policy);
+  return 0;
+}
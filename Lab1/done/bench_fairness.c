@@ -0,0 +1,118 @@
+/**
+ * @file bench_fairness.c
+ * @brief Fairness and latency comparison of the scheduling policies
+ *
+ * Every policy runs the same set of CPU-bound green threads, each at a
+ * different priority level, for a fixed wall-clock budget. A thread spins
+ * for a short burst and yields, over and over. The benchmark reports, as CSV:
+ *  - the Jain index of the CPU time normalized by the fair share weight of
+ *    each thread (1.0 means every thread got exactly its weighted share),
+ *  - the mean and maximum time between a yield and the next dispatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+#include "thread_info.h"
+
+#define BENCH_THREADS 4
+#define BENCH_BUDGET_NS (200 * 1000 * 1000ULL)
+#define BENCH_BURST_ITERS 20000
+
+typedef struct {
+  l1_priority level;      /* Priority level the worker runs at */
+  uint64_t run_ns;        /* Time spent spinning */
+  uint64_t wait_ns;       /* Time spent between yield and resume */
+  uint64_t max_wait_ns;   /* Longest such wait */
+  uint64_t waits;         /* Number of yields */
+} bench_worker;
+
+static uint64_t bench_deadline;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *spinner(void *arg)
+{
+  bench_worker *w = arg;
+  get_scheduler()->current->priority_level = w->level;
+
+  for (;;)
+  {
+    uint64_t start = now_ns();
+    if (start >= bench_deadline)
+    {
+      break;
+    }
+    for (volatile int i = 0; i < BENCH_BURST_ITERS; i++)
+      ;
+    uint64_t stop = now_ns();
+    w->run_ns += stop - start;
+
+    yield(-1);
+
+    uint64_t wait = now_ns() - stop;
+    w->wait_ns += wait;
+    w->waits++;
+    if (wait > w->max_wait_ns)
+    {
+      w->max_wait_ns = wait;
+    }
+  }
+  return NULL;
+}
+
+static void run_policy(const char *name, const sched_policy *policy)
+{
+  bench_worker workers[BENCH_THREADS] = {0};
+
+  initialize_scheduler(policy);
+  for (int i = 0; i < BENCH_THREADS; i++)
+  {
+    l1_tid tid;
+    workers[i].level = TOP_PRIORITY - i;
+    if (l1_thread_create(&tid, spinner, &workers[i]) != SUCCESS)
+    {
+      fprintf(stderr, "Error: unable to create benchmark thread\n");
+      exit(1);
+    }
+  }
+  bench_deadline = now_ns() + BENCH_BUDGET_NS;
+  schedule();
+  clean_up_scheduler();
+
+  /* Jain index of x_i = run_i / weight_i */
+  double sum = 0, sum_sq = 0;
+  uint64_t wait_ns = 0, waits = 0, max_wait_ns = 0;
+  for (int i = 0; i < BENCH_THREADS; i++)
+  {
+    double x = (double)workers[i].run_ns / l1_fair_weight(workers[i].level);
+    sum += x;
+    sum_sq += x * x;
+    wait_ns += workers[i].wait_ns;
+    waits += workers[i].waits;
+    if (workers[i].max_wait_ns > max_wait_ns)
+    {
+      max_wait_ns = workers[i].max_wait_ns;
+    }
+  }
+  double jain = (sum_sq > 0) ? (sum * sum) / (BENCH_THREADS * sum_sq) : 0;
+  printf("%s,%d,%.4f,%.2f,%.2f\n", name, BENCH_THREADS, jain,
+         waits ? (double)wait_ns / waits / 1000 : 0, (double)max_wait_ns / 1000);
+}
+
+int main(int argc, char **argv)
+{
+  printf("policy,threads,jain_weighted,mean_wait_us,max_wait_us\n");
+  run_policy("round_robin", &l1_round_robin_policy);
+  run_policy("smallest_cycles", &l1_smallest_cycles_policy);
+  run_policy("mlfq", &l1_mlfq_policy);
+  run_policy("fair_share", &l1_fair_share_policy);
+  return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file bench_idle.c
+ * @brief Cost of waiting for another OS thread, parked against polled
+ *
+ * A pthread signals a green thread BENCH_ROUNDS times, BENCH_INTERVAL_NS
+ * apart. The green thread either waits on an l1_notifier, which lets the
+ * scheduler sleep in epoll_wait, or polls a flag with yield(-1), the only
+ * way to wait for another OS thread before. The benchmark reports, as CSV,
+ * the delay between the signal and the run of the green thread, and the CPU
+ * time the scheduler thread used, as a share of the elapsed time.
+ */
+#define _GNU_SOURCE /* RUSAGE_THREAD */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "event_loop.h"
+#include "histogram.h"
+#include "sched_policy.h"
+#include "schedule.h"
+#include "thread.h"
+
+#define BENCH_ROUNDS 2000
+#define BENCH_INTERVAL_NS (L1_NSEC_PER_MSEC / 2)
+
+static l1_histogram latency;
+static l1_notifier notifier;
+static atomic_uint_fast64_t signaled_at;
+static bool use_notifier;
+
+static void *signaler(void *arg)
+{
+  struct timespec interval = {0, BENCH_INTERVAL_NS};
+  for (int i = 0; i < BENCH_ROUNDS; i++)
+  {
+    /* Signals are merged, wait until the previous one was taken */
+    while (atomic_load(&signaled_at) != 0)
+    {
+      nanosleep(&interval, NULL);
+    }
+    nanosleep(&interval, NULL);
+    atomic_store(&signaled_at, l1_time_monotonic_ns());
+    if (use_notifier)
+    {
+      l1_notifier_signal(&notifier);
+    }
+  }
+  return NULL;
+}
+
+static void *waiter(void *arg)
+{
+  for (int i = 0; i < BENCH_ROUNDS; i++)
+  {
+    uint64_t sent;
+    if (use_notifier)
+    {
+      l1_notifier_wait(&notifier);
+      sent = atomic_exchange(&signaled_at, 0);
+    }
+    else
+    {
+      while ((sent = atomic_exchange(&signaled_at, 0)) == 0)
+      {
+        yield(-1);
+      }
+    }
+    uint64_t now = l1_time_monotonic_ns();
+    l1_histogram_record(&latency, (now > sent) ? now - sent : 0);
+  }
+  return NULL;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * L1_NSEC_PER_SEC +
+         (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * L1_NSEC_PER_USEC;
+}
+
+static void run(const char *name, bool notify)
+{
+  l1_histogram_init(&latency);
+  l1_notifier_init(&notifier);
+  atomic_store(&signaled_at, 0);
+  use_notifier = notify;
+  initialize_scheduler(&l1_round_robin_policy);
+  l1_tid tid;
+  l1_thread_create(&tid, waiter, NULL);
+  pthread_t pthread;
+  uint64_t start = l1_time_monotonic_ns(), cpu_start = thread_cpu_ns();
+  if (pthread_create(&pthread, NULL, signaler, NULL) != 0)
+  {
+    fprintf(stderr, "Error: unable to create the signaling thread\n");
+    exit(1);
+  }
+  schedule();
+  uint64_t elapsed = l1_time_monotonic_ns() - start, cpu = thread_cpu_ns() - cpu_start;
+  pthread_join(pthread, NULL);
+  printf("%s,%llu,%.1f,%.1f,%.1f,%.3f\n", name, (unsigned long long)latency.count,
+         (double)l1_histogram_quantile(&latency, 0.5) / L1_NSEC_PER_USEC,
+         (double)l1_histogram_quantile(&latency, 0.99) / L1_NSEC_PER_USEC,
+         (double)latency.max / L1_NSEC_PER_USEC, (double)cpu / elapsed);
+  fflush(stdout);
+  clean_up_scheduler();
+  l1_notifier_destroy(&notifier);
+}
+
+int main(int argc, char **argv)
+{
+  printf("mode,wakeups,latency_p50_us,latency_p99_us,latency_max_us,scheduler_cpu_share\n");
+  run("notifier", true);
+  run("yield_loop", false);
+  return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file bench_preempt.c
+ * @brief Latency of interactive green threads next to CPU-bound ones
+ *
+ * Interactive threads yield in a loop and record how long it takes to get
+ * the processor back, while CPU-bound threads spin for BENCH_SPIN_NS each
+ * without ever yielding. Without preemption an interactive thread waits for
+ * a whole spinner; with it, for about one slice. In deferred mode the
+ * spinners call l1_preempt_point in their loop, in async mode they do not.
+ * The benchmark reports the latency percentiles as CSV.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "preempt.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "thread.h"
+#include "thread_info.h"
+
+#define BENCH_SPINNERS 2
+#define BENCH_INTERACTIVE 2
+#define BENCH_SPIN_NS (50 * L1_NSEC_PER_MSEC)
+#define BENCH_MAX_SAMPLES (1 << 16)
+
+static l1_time samples[BENCH_INTERACTIVE][BENCH_MAX_SAMPLES];
+static size_t sample_count[BENCH_INTERACTIVE];
+static volatile int spinners_left;
+static l1_preempt_mode bench_mode;
+
+static void *spinner(void *arg)
+{
+  l1_time start, now, ran;
+  l1_time_get(&start);
+  do
+  {
+    if (bench_mode == L1_PREEMPT_DEFERRED)
+    {
+      l1_preempt_point();
+    }
+    l1_time_get(&now);
+    l1_time_diff(&ran, now, start);
+  } while (l1_time_is_smaller(ran, BENCH_SPIN_NS));
+  spinners_left--;
+  return NULL;
+}
+
+static void *interactive(void *arg)
+{
+  size_t id = (size_t)arg;
+  while (spinners_left > 0)
+  {
+    l1_time before, after, latency;
+    l1_time_get(&before);
+    yield(-1);
+    l1_time_get(&after);
+    l1_time_diff(&latency, after, before);
+    if (sample_count[id] < BENCH_MAX_SAMPLES)
+    {
+      samples[id][sample_count[id]++] = latency;
+    }
+  }
+  return NULL;
+}
+
+static int compare_time(const void *a, const void *b)
+{
+  l1_time x = *(const l1_time *)a, y = *(const l1_time *)b;
+  return (x > y) - (x < y);
+}
+
+static void run(const char *name, const sched_policy *policy, l1_preempt_mode mode)
+{
+  initialize_scheduler(policy);
+  bench_mode = mode;
+  if (mode != L1_PREEMPT_OFF && l1_preempt_start(mode) != SUCCESS)
+  {
+    fprintf(stderr, "Error: unable to start preemption\n");
+    exit(1);
+  }
+  spinners_left = BENCH_SPINNERS;
+  l1_tid tid;
+  for (size_t i = 0; i < BENCH_INTERACTIVE; i++)
+  {
+    sample_count[i] = 0;
+    l1_thread_create(&tid, interactive, (void *)i);
+  }
+  for (int i = 0; i < BENCH_SPINNERS; i++)
+  {
+    l1_thread_create(&tid, spinner, NULL);
+  }
+  schedule();
+  uint64_t preemptions = get_scheduler()->preemptions;
+  clean_up_scheduler();
+
+  /* Merge the samples of all interactive threads */
+  static l1_time all[BENCH_INTERACTIVE * BENCH_MAX_SAMPLES];
+  size_t n = 0;
+  for (int i = 0; i < BENCH_INTERACTIVE; i++)
+  {
+    for (size_t j = 0; j < sample_count[i]; j++)
+    {
+      all[n++] = samples[i][j];
+    }
+  }
+  qsort(all, n, sizeof(l1_time), compare_time);
+  const char *modes[] = {"off", "deferred", "async"};
+  printf("%s,%s,%zu,%.2f,%.2f,%.2f,%lu\n", name, modes[mode], n,
+         n ? (double)all[n / 2] / L1_NSEC_PER_USEC : 0,
+         n ? (double)all[n * 99 / 100] / L1_NSEC_PER_USEC : 0,
+         n ? (double)all[n - 1] / L1_NSEC_PER_USEC : 0, preemptions);
+}
+
+int main(int argc, char **argv)
+{
+  printf("policy,preemption,samples,p50_us,p99_us,max_us,preemptions\n");
+  for (l1_preempt_mode mode = L1_PREEMPT_OFF; mode <= L1_PREEMPT_ASYNC; mode++)
+  {
+    run("round_robin", &l1_round_robin_policy, mode);
+    run("mlfq", &l1_mlfq_policy, mode);
+  }
+  return 0;
+}
@@ -0,0 +1,318 @@
+/**
+ * @file bench_scheduler.c
+ * @brief Standard workloads run under every scheduling policy
+ *
+ * Every workload runs in a fresh scheduler, driven by a green thread:
+ *  - pingpong: two threads yield to each other BENCH_YIELDS times,
+ *  - spawn_join: batches of BENCH_BATCH threads that return at once, joined,
+ *  - join_chain: each thread creates the next one and joins it,
+ *  - mixed: CPU-bound threads that spin and yield, next to interactive
+ *    threads that sleep 1 ms and run briefly, for BENCH_BUDGET_NS,
+ *  - idle: pingpong next to idle threads blocked on a semaphore (100k by
+ *    default, or argv[1]).
+ * The benchmark reports, as CSV, per policy and workload:
+ *  - the switches per second over the measured phase,
+ *  - the creation plus join latency of a thread (spawn_join, join_chain),
+ *  - the Jain index of the CPU time of the threads that compete for it
+ *    (pingpong, mixed, idle),
+ *  - response time percentiles: the delay between the end of the sleep of
+ *    an interactive thread and its run for mixed, and the run-queue latency
+ *    of every switch otherwise (see stats.h).
+ * Empty fields do not apply to the workload.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "histogram.h"
+#include "sched_policy.h"
+#include "schedule.h"
+#include "stats.h"
+#include "sync.h"
+#include "thread.h"
+#include "thread_info.h"
+
+#define BENCH_YIELDS 100000
+#define BENCH_BATCH 64
+#define BENCH_BATCHES 64
+#define BENCH_CHAIN 1000
+#define BENCH_CPU_THREADS 4
+#define BENCH_INTERACTIVE_THREADS 4
+#define BENCH_BUDGET_NS (200 * L1_NSEC_PER_MSEC)
+#define BENCH_BURST_ITERS 20000
+#define BENCH_IDLE_THREADS 100000
+
+/* What a workload measured, NAN when it does not apply */
+typedef struct
+{
+  double switches_per_sec;
+  double create_join_us;
+  double jain;
+  double response_p50_us;
+  double response_p99_us;
+} bench_result;
+
+static bench_result result;
+static uint64_t phase_start_ns, phase_start_switches;
+static double run_ns[BENCH_CPU_THREADS];
+static l1_histogram response;
+static uint64_t deadline_ns;
+static long idle_threads = BENCH_IDLE_THREADS;
+
+static void phase_begin(void)
+{
+  phase_start_switches = l1_sched_stats()->switches;
+  phase_start_ns = l1_time_monotonic_ns();
+}
+
+/* Returns the length of the phase in ns */
+static uint64_t phase_end(void)
+{
+  uint64_t elapsed = l1_time_monotonic_ns() - phase_start_ns;
+  uint64_t switches = l1_sched_stats()->switches - phase_start_switches;
+  result.switches_per_sec = switches * (double)L1_NSEC_PER_SEC / elapsed;
+  return elapsed;
+}
+
+/* Time the calling thread ran so far */
+static double self_run_ns(void)
+{
+  l1_thread_info *self = get_scheduler()->current;
+  l1_time now, slice;
+  l1_time_get(&now);
+  l1_time_diff(&slice, now, self->slice_start);
+  return (double)self->total_time + slice;
+}
+
+static double jain(const double *x, int n)
+{
+  double sum = 0, sum_sq = 0;
+  for (int i = 0; i < n; i++)
+  {
+    sum += x[i];
+    sum_sq += x[i] * x[i];
+  }
+  return (sum_sq > 0) ? (sum * sum) / (n * sum_sq) : NAN;
+}
+
+static l1_tid spawn(void *(*routine)(void *), void *arg)
+{
+  l1_tid tid;
+  if (l1_thread_create(&tid, routine, arg) != SUCCESS)
+  {
+    fprintf(stderr, "Error: unable to create benchmark thread\n");
+    exit(1);
+  }
+  return tid;
+}
+//========================================================================================
+static void *yielder(void *arg)
+{
+  for (int i = 0; i < BENCH_YIELDS; i++)
+  {
+    yield(-1);
+  }
+  run_ns[(intptr_t)arg] = self_run_ns();
+  return NULL;
+}
+
+static void run_pingpong(void)
+{
+  l1_tid a = spawn(yielder, (void *)0);
+  l1_tid b = spawn(yielder, (void *)1);
+  phase_begin();
+  l1_thread_join(a, NULL);
+  l1_thread_join(b, NULL);
+  phase_end();
+  result.jain = jain(run_ns, 2);
+}
+
+static void *pingpong(void *arg)
+{
+  run_pingpong();
+  return NULL;
+}
+//========================================================================================
+static void *returner(void *arg)
+{
+  return arg;
+}
+
+static void *spawn_join(void *arg)
+{
+  l1_tid tids[BENCH_BATCH];
+  phase_begin();
+  for (int batch = 0; batch < BENCH_BATCHES; batch++)
+  {
+    for (int i = 0; i < BENCH_BATCH; i++)
+    {
+      tids[i] = spawn(returner, NULL);
+    }
+    for (int i = 0; i < BENCH_BATCH; i++)
+    {
+      l1_thread_join(tids[i], NULL);
+    }
+  }
+  uint64_t elapsed = phase_end();
+  result.create_join_us = (double)elapsed / (BENCH_BATCH * BENCH_BATCHES) / L1_NSEC_PER_USEC;
+  return NULL;
+}
+//========================================================================================
+static void *chain_link(void *arg)
+{
+  intptr_t depth = (intptr_t)arg;
+  if (depth > 1)
+  {
+    l1_thread_join(spawn(chain_link, (void *)(depth - 1)), NULL);
+  }
+  return NULL;
+}
+
+static void *join_chain(void *arg)
+{
+  phase_begin();
+  chain_link((void *)BENCH_CHAIN);
+  uint64_t elapsed = phase_end();
+  result.create_join_us = (double)elapsed / (BENCH_CHAIN - 1) / L1_NSEC_PER_USEC;
+  return NULL;
+}
+//========================================================================================
+static void *cpu_bound(void *arg)
+{
+  while (l1_time_monotonic_ns() < deadline_ns)
+  {
+    for (volatile int i = 0; i < BENCH_BURST_ITERS; i++)
+      ;
+    yield(-1);
+  }
+  run_ns[(intptr_t)arg] = self_run_ns();
+  return NULL;
+}
+
+static void *interactive(void *arg)
+{
+  while (l1_time_monotonic_ns() < deadline_ns)
+  {
+    uint64_t due = l1_time_monotonic_ns() + L1_NSEC_PER_MSEC;
+    l1_sleep(L1_NSEC_PER_MSEC);
+    uint64_t now = l1_time_monotonic_ns();
+    l1_histogram_record(&response, (now > due) ? now - due : 0);
+    for (volatile int i = 0; i < BENCH_BURST_ITERS / 20; i++)
+      ;
+  }
+  return NULL;
+}
+
+static void *mixed(void *arg)
+{
+  l1_tid tids[BENCH_CPU_THREADS + BENCH_INTERACTIVE_THREADS];
+  deadline_ns = l1_time_monotonic_ns() + BENCH_BUDGET_NS;
+  phase_begin();
+  for (intptr_t i = 0; i < BENCH_CPU_THREADS; i++)
+  {
+    tids[i] = spawn(cpu_bound, (void *)i);
+  }
+  for (int i = 0; i < BENCH_INTERACTIVE_THREADS; i++)
+  {
+    tids[BENCH_CPU_THREADS + i] = spawn(interactive, NULL);
+  }
+  for (int i = 0; i < BENCH_CPU_THREADS + BENCH_INTERACTIVE_THREADS; i++)
+  {
+    l1_thread_join(tids[i], NULL);
+  }
+  phase_end();
+  result.jain = jain(run_ns, BENCH_CPU_THREADS);
+  return NULL;
+}
+//========================================================================================
+static l1_sem idle_sem;
+
+static void *idler(void *arg)
+{
+  l1_sem_wait(&idle_sem);
+  return NULL;
+}
+
+static void *idle(void *arg)
+{
+  l1_thread_attr attr = {.detached = true};
+  l1_sem_init(&idle_sem, 0);
+  for (long i = 0; i < idle_threads; i++)
+  {
+    l1_tid tid;
+    if (l1_thread_create_attr(&tid, &attr, idler, NULL) != SUCCESS)
+    {
+      fprintf(stderr, "Error: unable to create idle thread\n");
+      exit(1);
+    }
+  }
+  /* Let every idle thread block */
+  yield(-1);
+  run_pingpong();
+  for (long i = 0; i < idle_threads; i++)
+  {
+    l1_sem_post(&idle_sem);
+  }
+  return NULL;
+}
+//========================================================================================
+static void print_field(double value, const char *format)
+{
+  printf(",");
+  if (!isnan(value))
+  {
+    printf(format, value);
+  }
+}
+
+static void run(const char *policy_name, const sched_policy *policy, const char *workload,
+                void *(*driver)(void *))
+{
+  result = (bench_result){NAN, NAN, NAN, NAN, NAN};
+  l1_histogram_init(&response);
+  initialize_scheduler(policy);
+  l1_tid tid;
+  l1_thread_create(&tid, driver, NULL);
+  schedule();
+  const l1_histogram *latency = (response.count > 0) ? &response : &l1_sched_stats()->runq_latency;
+  result.response_p50_us = (double)l1_histogram_quantile(latency, 0.5) / L1_NSEC_PER_USEC;
+  result.response_p99_us = (double)l1_histogram_quantile(latency, 0.99) / L1_NSEC_PER_USEC;
+  clean_up_scheduler();
+
+  printf("%s,%s", policy_name, workload);
+  print_field(result.switches_per_sec, "%.0f");
+  print_field(result.create_join_us, "%.2f");
+  print_field(result.jain, "%.4f");
+  print_field(result.response_p50_us, "%.2f");
+  print_field(result.response_p99_us, "%.2f");
+  printf("\n");
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+  {
+    idle_threads = strtol(argv[1], NULL, 10);
+  }
+  const struct
+  {
+    const char *name;
+    const sched_policy *policy;
+  } policies[] = {
+      {"round_robin", &l1_round_robin_policy},
+      {"smallest_cycles", &l1_smallest_cycles_policy},
+      {"mlfq", &l1_mlfq_policy},
+      {"fair_share", &l1_fair_share_policy},
+  };
+  printf("policy,workload,switches_per_sec,create_join_us,jain,response_p50_us,response_p99_us\n");
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+  {
+    run(policies[i].name, policies[i].policy, "pingpong", pingpong);
+    run(policies[i].name, policies[i].policy, "spawn_join", spawn_join);
+    run(policies[i].name, policies[i].policy, "join_chain", join_chain);
+    run(policies[i].name, policies[i].policy, "mixed", mixed);
+    run(policies[i].name, policies[i].policy, "idle", idle);
+  }
+  return 0;
+}
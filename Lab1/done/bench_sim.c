@@ -0,0 +1,101 @@
+/**
+ * @file bench_sim.c
+ * @brief Sweeps the MLFQ parameters in the scheduling simulator
+ *
+ * Simulates BENCH_SEEDS generated workloads of BENCH_TASKS tasks, a
+ * fraction BENCH_INTERACTIVE of them interactive, for every combination of
+ * MIN_SLICE, TIME_PRIORITY_THRESHOLD and SCHED_PERIOD below under the MLFQ
+ * policy, and once under each of the other policies for reference. Prints,
+ * as CSV, the metrics of sim.h averaged over the seeds, then the number of
+ * simulations and the time they took on stderr.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sched_policy.h"
+#include "sim.h"
+
+#define BENCH_TASKS 500
+#define BENCH_SEEDS 8
+#define BENCH_INTERACTIVE 0.5
+#define BENCH_INTERARRIVAL (50 * L1_NSEC_PER_MSEC)
+#define BENCH_SWITCH_COST (2 * L1_NSEC_PER_USEC)
+#define BENCH_STARVATION (100 * L1_NSEC_PER_MSEC)
+
+static const l1_time min_slices[] = {
+    L1_NSEC_PER_MSEC / 4, L1_NSEC_PER_MSEC / 2, L1_NSEC_PER_MSEC, 2 * L1_NSEC_PER_MSEC,
+    5 * L1_NSEC_PER_MSEC};
+static const l1_time thresholds[] = {
+    L1_NSEC_PER_MSEC, 5 * L1_NSEC_PER_MSEC, 10 * L1_NSEC_PER_MSEC, 50 * L1_NSEC_PER_MSEC};
+static const unsigned periods[] = {10, 50, 100, 500, 1000};
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+static l1_sim_task workloads[BENCH_SEEDS][BENCH_TASKS];
+static unsigned long simulations;
+
+static void run(const char *name, const sched_policy *policy, unsigned period)
+{
+  l1_sim_config config = {
+      .policy = policy,
+      .sched_period = period,
+      .preemptive = true,
+      .switch_cost = BENCH_SWITCH_COST,
+      .starvation = BENCH_STARVATION,
+  };
+  double turnaround = 0, p99_turnaround = 0, response = 0, p99_response = 0;
+  double switches = 0, starved = 0;
+  for (int seed = 0; seed < BENCH_SEEDS; seed++)
+  {
+    l1_sim_report report;
+    if (l1_sim_run(&config, workloads[seed], BENCH_TASKS, &report) != SUCCESS)
+    {
+      fprintf(stderr, "Error: simulation failed\n");
+      exit(1);
+    }
+    simulations++;
+    turnaround += report.mean_turnaround;
+    p99_turnaround += report.p99_turnaround;
+    response += report.mean_response;
+    p99_response += report.p99_response;
+    switches += report.switches;
+    starved += report.starved;
+  }
+  double ms = (double)BENCH_SEEDS * L1_NSEC_PER_MSEC;
+  printf("%s,%.2f,%.2f,%u,%.2f,%.2f,%.3f,%.3f,%.0f,%.1f\n", name,
+         (double)l1_priority_params.min_slice / L1_NSEC_PER_MSEC,
+         (double)l1_priority_params.priority_threshold / L1_NSEC_PER_MSEC, period,
+         turnaround / ms, p99_turnaround / ms, response / ms, p99_response / ms,
+         switches / BENCH_SEEDS, starved / BENCH_SEEDS);
+}
+
+int main(int argc, char **argv)
+{
+  for (int seed = 0; seed < BENCH_SEEDS; seed++)
+  {
+    l1_sim_generate(workloads[seed], BENCH_TASKS, seed, BENCH_INTERACTIVE, BENCH_INTERARRIVAL);
+  }
+  uint64_t start = l1_time_monotonic_ns();
+  l1_priority_tunables defaults = l1_priority_params;
+  printf("policy,min_slice_ms,threshold_ms,sched_period,turnaround_ms,turnaround_p99_ms,"
+         "response_ms,response_p99_ms,switches,starved\n");
+  run("round_robin", &l1_round_robin_policy, SCHED_PERIOD);
+  run("smallest_cycles", &l1_smallest_cycles_policy, SCHED_PERIOD);
+  run("fair_share", &l1_fair_share_policy, SCHED_PERIOD);
+  for (size_t i = 0; i < COUNT(min_slices); i++)
+  {
+    for (size_t j = 0; j < COUNT(thresholds); j++)
+    {
+      for (size_t k = 0; k < COUNT(periods); k++)
+      {
+        l1_priority_params.min_slice = min_slices[i];
+        l1_priority_params.priority_threshold = thresholds[j];
+        run("mlfq", &l1_mlfq_policy, periods[k]);
+      }
+    }
+  }
+  l1_priority_params = defaults;
+  double elapsed = (double)(l1_time_monotonic_ns() - start) / L1_NSEC_PER_SEC;
+  fprintf(stderr, "%lu simulations in %.2f s\n", simulations, elapsed);
+  return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file bench_task_group.c
+ * @brief Fan-out/fan-in overhead: one join per child versus a task group
+ *
+ * A parent spawns N children that yield 1 to BENCH_YIELDS times, so that
+ * they finish out of order, then waits for all of them, either with one
+ * l1_thread_join per child, or with l1_task_group_wait_all. The benchmark reports, as CSV, the time per child
+ * of each approach, which is mostly scheduler overhead since the children
+ * do nothing.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sched_policy.h"
+#include "schedule.h"
+#include "task_group.h"
+#include "thread.h"
+#include "thread_info.h"
+
+#define BENCH_MAX_CHILDREN 8192
+#define BENCH_YIELDS 4
+
+static l1_tid children[BENCH_MAX_CHILDREN];
+
+/* Yields arg times, so that the children finish out of order */
+static void *child(void *arg)
+{
+  for (intptr_t i = 0; i < (intptr_t)arg; i++)
+  {
+    yield(-1);
+  }
+  return (void *)1;
+}
+
+static void *join_parent(void *arg)
+{
+  intptr_t count = (intptr_t)arg, sum = 0;
+  for (intptr_t i = 0; i < count; i++)
+  {
+    l1_thread_create(&children[i], child, (void *)(BENCH_YIELDS - i % BENCH_YIELDS));
+  }
+  for (intptr_t i = 0; i < count; i++)
+  {
+    void *ret;
+    if (l1_thread_join(children[i], &ret) == SUCCESS)
+    {
+      sum += (intptr_t)ret;
+    }
+  }
+  return (void *)sum;
+}
+
+static void *group_parent(void *arg)
+{
+  intptr_t count = (intptr_t)arg;
+  l1_task_group group;
+  l1_task_group_init(&group);
+  for (intptr_t i = 0; i < count; i++)
+  {
+    l1_task_group_spawn(&group, NULL, NULL, child, (void *)(BENCH_YIELDS - i % BENCH_YIELDS));
+  }
+  return (void *)(intptr_t)l1_task_group_wait_all(&group);
+}
+
+/* Returns the elapsed time in ns */
+static uint64_t run(void *(*parent)(void *), intptr_t count)
+{
+  initialize_scheduler(&l1_round_robin_policy);
+  l1_tid tid;
+  l1_thread_create(&tid, parent, (void *)count);
+  uint64_t start = l1_time_monotonic_ns();
+  schedule();
+  uint64_t elapsed = l1_time_monotonic_ns() - start;
+
+  l1_thread_info *zombie = thread_list_find(&get_scheduler()->thread_arrays[ZOMBIE], tid);
+  if (zombie == NULL || (intptr_t)zombie->retval != count)
+  {
+    fprintf(stderr, "Error: lost children\n");
+    exit(1);
+  }
+  clean_up_scheduler();
+  return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+  printf("children,join_ns_per_child,group_ns_per_child,speedup\n");
+  for (intptr_t count = 256; count <= BENCH_MAX_CHILDREN; count *= 2)
+  {
+    uint64_t join = run(join_parent, count);
+    uint64_t group = run(group_parent, count);
+    printf("%ld,%.0f,%.0f,%.2f\n", (long)count, (double)join / count, (double)group / count,
+           (double)join / group);
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file bench_tasks.c
+ * @brief Cost of a stackless task versus a detached green thread
+ *
+ * Creates N items that only count their runs, then schedules them. The
+ * benchmark reports, as CSV, the creation and the scheduling time per item
+ * of each kind. The first round fills the caches, as a long-running
+ * program would.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sched_policy.h"
+#include "schedule.h"
+#include "thread.h"
+#include "thread_info.h"
+
+#define BENCH_MAX_ITEMS 65536
+#define BENCH_ROUNDS 4
+
+static intptr_t ran;
+
+static void *item(void *arg)
+{
+  ran++;
+  return NULL;
+}
+
+static l1_error create_task(l1_tid *tid)
+{
+  return l1_task_create(tid, item, NULL);
+}
+
+static l1_error create_thread(l1_tid *tid)
+{
+  static const l1_thread_attr attr = {.detached = true};
+  return l1_thread_create_attr(tid, &attr, item, NULL);
+}
+
+static void run(const char *kind, l1_error (*create)(l1_tid *), intptr_t count)
+{
+  uint64_t create_ns = 0, run_ns = 0;
+  initialize_scheduler(&l1_round_robin_policy);
+  for (int round = 0; round <= BENCH_ROUNDS; round++)
+  {
+    ran = 0;
+    uint64_t start = l1_time_monotonic_ns();
+    for (intptr_t i = 0; i < count; i++)
+    {
+      l1_tid tid;
+      if (create(&tid) != SUCCESS)
+      {
+        fprintf(stderr, "Error: unable to create the %s\n", kind);
+        exit(1);
+      }
+    }
+    uint64_t created = l1_time_monotonic_ns();
+    schedule();
+    uint64_t done = l1_time_monotonic_ns();
+    if (ran != count)
+    {
+      fprintf(stderr, "Error: lost items\n");
+      exit(1);
+    }
+    if (round > 0)
+    {
+      create_ns += created - start;
+      run_ns += done - created;
+    }
+  }
+  clean_up_scheduler();
+  double items = (double)count * BENCH_ROUNDS;
+  printf("%s,%ld,%.1f,%.1f\n", kind, (long)count, create_ns / items, run_ns / items);
+}
+
+int main(int argc, char **argv)
+{
+  printf("kind,count,create_ns_per_item,run_ns_per_item\n");
+  for (intptr_t count = 64; count <= BENCH_MAX_ITEMS; count *= 16)
+  {
+    run("task", create_task, count);
+    run("thread", create_thread, count);
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file bench_trace.c
+ * @brief Cost of the scheduler event tracing
+ *
+ * Measures the cost of recording one event, then the cost of a yield
+ * between two green threads, which records a switch-out and a switch-in
+ * when the scheduler is built with -DL1_TRACE. The benchmark reports both
+ * as CSV, and writes the trace of the yields to argv[1] if given.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sched_policy.h"
+#include "schedule.h"
+#include "thread.h"
+#include "thread_info.h"
+#include "trace.h"
+
+#define BENCH_EVENTS (1 << 22)
+#define BENCH_YIELDS (1 << 12)
+
+static void *yielder(void *arg)
+{
+  for (int i = 0; i < BENCH_YIELDS; i++)
+  {
+    yield(-1);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  initialize_scheduler(&l1_round_robin_policy);
+  uint64_t start = l1_time_monotonic_ns();
+  for (uint32_t i = 0; i < BENCH_EVENTS; i++)
+  {
+    l1_trace_record(L1_TRACE_UNBLOCK, i, 0);
+  }
+  uint64_t record = l1_time_monotonic_ns() - start;
+  l1_trace_clear();
+
+  l1_tid tid;
+  l1_thread_create(&tid, yielder, NULL);
+  l1_thread_create(&tid, yielder, NULL);
+  start = l1_time_monotonic_ns();
+  schedule();
+  uint64_t yields = l1_time_monotonic_ns() - start;
+  clean_up_scheduler();
+
+#ifdef L1_TRACE
+  const char *tracing = "on";
+#else
+  const char *tracing = "off";
+#endif
+  printf("tracing,ns_per_event,ns_per_yield\n");
+  printf("%s,%.1f,%.1f\n", tracing, (double)record / BENCH_EVENTS,
+         (double)yields / (2 * BENCH_YIELDS));
+  if (argc > 1 && l1_trace_dump(argv[1]) != SUCCESS)
+  {
+    fprintf(stderr, "Error: unable to write %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file bench_workers.c
+ * @brief Scaling of the M:N mode on embarrassingly parallel task graphs
+ *
+ * Two task graphs of independent CPU-bound leaves run with 1, 2, 4, ...
+ * workers, up to the number of online processors:
+ *  - flat: one thread spawns all the leaves, then joins them,
+ *  - tree: a binary fork-join tree, every inner thread spawns two children
+ *    and joins them, so the work spreads through stealing only.
+ * The benchmark reports, as CSV, the wall-clock time of each run and the
+ * speedup over a single worker.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "schedule.h"
+#include "thread.h"
+#include "thread_info.h"
+#include "worker.h"
+
+#define BENCH_TREE_DEPTH 9
+#define BENCH_LEAVES (1 << BENCH_TREE_DEPTH)
+#define BENCH_LEAF_ITERS 200000
+
+static l1_tid leaves[BENCH_LEAVES];
+
+static void *leaf(void *arg)
+{
+  for (volatile int i = 0; i < BENCH_LEAF_ITERS; i++)
+    ;
+  return (void *)1;
+}
+
+static void *flat(void *arg)
+{
+  intptr_t done = 0;
+  for (int i = 0; i < BENCH_LEAVES; i++)
+  {
+    l1_thread_create(&leaves[i], leaf, NULL);
+  }
+  for (int i = 0; i < BENCH_LEAVES; i++)
+  {
+    void *ret;
+    if (l1_thread_join(leaves[i], &ret) == SUCCESS)
+    {
+      done += (intptr_t)ret;
+    }
+  }
+  return (void *)done;
+}
+
+static void *tree(void *arg)
+{
+  intptr_t depth = (intptr_t)arg;
+  if (depth == 0)
+  {
+    return leaf(NULL);
+  }
+  l1_tid left, right;
+  void *left_ret = NULL, *right_ret = NULL;
+  l1_thread_create(&left, tree, (void *)(depth - 1));
+  l1_thread_create(&right, tree, (void *)(depth - 1));
+  l1_thread_join(left, &left_ret);
+  l1_thread_join(right, &right_ret);
+  return (void *)((intptr_t)left_ret + (intptr_t)right_ret);
+}
+
+/* Returns the elapsed time in ns */
+static uint64_t run(void *(*root)(void *), unsigned workers)
+{
+  initialize_scheduler(&l1_work_stealing_policy);
+  l1_tid tid;
+  l1_thread_create(&tid, root, (void *)(intptr_t)BENCH_TREE_DEPTH);
+  uint64_t start = l1_time_monotonic_ns();
+  if (l1_workers_run(workers) != SUCCESS)
+  {
+    fprintf(stderr, "Error: unable to start the workers\n");
+    exit(1);
+  }
+  uint64_t elapsed = l1_time_monotonic_ns() - start;
+
+  /* The root is the only zombie nobody joined */
+  l1_thread_info *zombie = thread_list_find(&get_scheduler()->thread_arrays[ZOMBIE], tid);
+  if (zombie == NULL || (intptr_t)zombie->retval != BENCH_LEAVES)
+  {
+    fprintf(stderr, "Error: lost leaves\n");
+    exit(1);
+  }
+  clean_up_scheduler();
+  return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned max_workers = (online > 1) ? online : 1;
+  if (max_workers > L1_MAX_WORKERS)
+  {
+    max_workers = L1_MAX_WORKERS;
+  }
+
+  struct
+  {
+    const char *name;
+    void *(*root)(void *);
+  } graphs[] = {{"flat", flat}, {"tree", tree}};
+
+  printf("graph,workers,leaves,elapsed_ms,leaves_per_sec,speedup\n");
+  for (size_t g = 0; g < sizeof(graphs) / sizeof(graphs[0]); g++)
+  {
+    uint64_t single = 0;
+    for (unsigned workers = 1; workers <= max_workers;
+         workers = (workers * 2 > max_workers && workers < max_workers) ? max_workers : workers * 2)
+    {
+      uint64_t elapsed = run(graphs[g].root, workers);
+      if (workers == 1)
+      {
+        single = elapsed;
+      }
+      printf("%s,%u,%d,%.2f,%.0f,%.2f\n", graphs[g].name, workers, BENCH_LEAVES,
+             (double)elapsed / L1_NSEC_PER_MSEC, BENCH_LEAVES * (double)L1_NSEC_PER_SEC / elapsed,
+             (double)single / elapsed);
+    }
+  }
+  return 0;
+}
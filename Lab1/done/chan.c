@@ -0,0 +1,393 @@
+/**
+ * @file chan.c
+ * @brief Implementation of the channels between green threads.
+ */
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chan.h"
+#include "preempt.h"
+#include "schedule.h"
+
+/* Shared by the waiters of one l1_chan_select call */
+struct l1_chan_select
+{
+  int fired; /* Index of the case that completed, -1 until then */
+};
+
+/* Start of the next l1_chan_select scan */
+static __thread unsigned select_start = 0;
+
+//========================================================================================
+static void chan_lock(l1_chan *chan)
+{
+  while (__atomic_test_and_set(&chan->guard, __ATOMIC_ACQUIRE))
+  {
+    /* Only another worker can hold it, let it run */
+    sched_yield();
+  }
+}
+
+static void chan_unlock(l1_chan *chan)
+{
+  __atomic_clear(&chan->guard, __ATOMIC_RELEASE);
+}
+
+static void queue_push(l1_chan_queue *queue, l1_chan_waiter *waiter)
+{
+  waiter->prev = queue->tail;
+  waiter->next = NULL;
+  if (queue->tail == NULL)
+  {
+    queue->head = waiter;
+  }
+  else
+  {
+    queue->tail->next = waiter;
+  }
+  queue->tail = waiter;
+  waiter->queued = true;
+}
+
+static void queue_remove(l1_chan_queue *queue, l1_chan_waiter *waiter)
+{
+  if (waiter->prev == NULL)
+  {
+    queue->head = waiter->next;
+  }
+  else
+  {
+    waiter->prev->next = waiter->next;
+  }
+  if (waiter->next == NULL)
+  {
+    queue->tail = waiter->prev;
+  }
+  else
+  {
+    waiter->next->prev = waiter->prev;
+  }
+  waiter->prev = waiter->next = NULL;
+  waiter->queued = false;
+}
+
+/* Dequeues the oldest waiter that can still be served. The waiters of a
+ * select that completed elsewhere are dropped on the way. */
+static l1_chan_waiter *queue_take(l1_chan_queue *queue)
+{
+  while (queue->head != NULL)
+  {
+    l1_chan_waiter *waiter = queue->head;
+    queue_remove(queue, waiter);
+    int expected = -1;
+    if (waiter->select == NULL ||
+        __atomic_compare_exchange_n(&waiter->select->fired, &expected, (int)waiter->index, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      return waiter;
+    }
+  }
+  return NULL;
+}
+
+/* Makes the thread of a served waiter RUNNABLE, its node is gone once it runs */
+static void waiter_wake(l1_chan_waiter *waiter)
+{
+  l1_thread_info *thread = waiter->thread;
+  lists_lock();
+  wake_thread(thread, SUCCESS);
+  lists_unlock();
+}
+//========================================================================================
+/* Makes room for one more element in an unbounded channel */
+static l1_error ring_grow(l1_chan *chan)
+{
+  size_t capacity = (chan->ring_capacity > 0) ? 2 * chan->ring_capacity : 16;
+  char *ring = malloc(capacity * chan->elem_size);
+  if (ring == NULL)
+  {
+    return ERRNOMEM;
+  }
+  /* Unwrap the elements at the start of the new ring */
+  size_t first = chan->ring_capacity - chan->head;
+  if (first > chan->len)
+  {
+    first = chan->len;
+  }
+  memcpy(ring, chan->ring + chan->head * chan->elem_size, first * chan->elem_size);
+  memcpy(ring + first * chan->elem_size, chan->ring, (chan->len - first) * chan->elem_size);
+  free(chan->ring);
+  chan->ring = ring;
+  chan->ring_capacity = capacity;
+  chan->head = 0;
+  return SUCCESS;
+}
+
+static void ring_push(l1_chan *chan, const void *elem)
+{
+  size_t slot = (chan->head + chan->len) % chan->ring_capacity;
+  memcpy(chan->ring + slot * chan->elem_size, elem, chan->elem_size);
+  chan->len++;
+}
+
+static void ring_pop(l1_chan *chan, void *elem)
+{
+  memcpy(elem, chan->ring + chan->head * chan->elem_size, chan->elem_size);
+  chan->head = (chan->head + 1) % chan->ring_capacity;
+  chan->len--;
+}
+//========================================================================================
+/* Sends elem if it does not have to wait, with the channel locked.
+ * Sets *receiver to the thread the element was handed to, if any. */
+static bool chan_try_send(l1_chan *chan, const void *elem, l1_error *err, l1_thread_info **receiver)
+{
+  if (chan->closed)
+  {
+    *err = ERRCLOSED;
+    return true;
+  }
+  l1_chan_waiter *waiter = queue_take(&chan->receivers);
+  if (waiter != NULL)
+  {
+    memcpy(waiter->data, elem, chan->elem_size);
+    waiter->err = SUCCESS;
+    *receiver = waiter->thread;
+    waiter_wake(waiter);
+    *err = SUCCESS;
+    return true;
+  }
+  if (chan->len < chan->capacity)
+  {
+    *err = (chan->len == chan->ring_capacity) ? ring_grow(chan) : SUCCESS;
+    if (*err == SUCCESS)
+    {
+      ring_push(chan, elem);
+    }
+    return true;
+  }
+  return false;
+}
+
+/* Receives into elem if it does not have to wait, with the channel locked */
+static bool chan_try_recv(l1_chan *chan, void *elem, l1_error *err)
+{
+  if (chan->len > 0)
+  {
+    ring_pop(chan, elem);
+    /* The freed slot goes to the oldest sender */
+    l1_chan_waiter *waiter = queue_take(&chan->senders);
+    if (waiter != NULL)
+    {
+      ring_push(chan, waiter->data);
+      waiter->err = SUCCESS;
+      waiter_wake(waiter);
+    }
+    *err = SUCCESS;
+    return true;
+  }
+  l1_chan_waiter *waiter = queue_take(&chan->senders);
+  if (waiter != NULL)
+  {
+    memcpy(elem, waiter->data, chan->elem_size);
+    waiter->err = SUCCESS;
+    waiter_wake(waiter);
+    *err = SUCCESS;
+    return true;
+  }
+  if (chan->closed)
+  {
+    memset(elem, 0, chan->elem_size);
+    *err = ERRCLOSED;
+    return true;
+  }
+  return false;
+}
+
+/* Runs the receiver of a direct handoff right away, when the policy can */
+static void chan_switch_to(l1_tid receiver)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (scheduler->runtime == NULL && scheduler->current != scheduler->tsys &&
+      scheduler->policy->dequeue != NULL)
+  {
+    yield(receiver);
+  }
+}
+
+/* Locks the distinct channels of the cases in address order, returns how many */
+static size_t chan_lock_all(l1_chan_case *cases, size_t count, l1_chan **locked)
+{
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t j = n;
+    while (j > 0 && locked[j - 1] > cases[i].chan)
+    {
+      j--;
+    }
+    if (j > 0 && locked[j - 1] == cases[i].chan)
+    {
+      continue;
+    }
+    memmove(&locked[j + 1], &locked[j], (n - j) * sizeof(l1_chan *));
+    locked[j] = cases[i].chan;
+    n++;
+  }
+  for (size_t i = 0; i < n; i++)
+  {
+    chan_lock(locked[i]);
+  }
+  return n;
+}
+
+static void chan_unlock_all(l1_chan **locked, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    chan_unlock(locked[i]);
+  }
+}
+//========================================================================================
+l1_error l1_chan_init(l1_chan *chan, size_t elem_size, size_t capacity)
+{
+  if (elem_size == 0)
+  {
+    return ERRINVAL;
+  }
+  memset(chan, 0, sizeof(l1_chan));
+  chan->elem_size = elem_size;
+  chan->capacity = capacity;
+  if (capacity != L1_CHAN_UNBOUNDED && capacity > 0)
+  {
+    chan->ring = malloc(capacity * elem_size);
+    if (chan->ring == NULL)
+    {
+      return ERRNOMEM;
+    }
+    chan->ring_capacity = capacity;
+  }
+  return SUCCESS;
+}
+
+void l1_chan_destroy(l1_chan *chan)
+{
+  free(chan->ring);
+  chan->ring = NULL;
+  chan->ring_capacity = chan->len = 0;
+}
+
+l1_error l1_chan_send(l1_chan *chan, const void *elem)
+{
+  l1_chan_case send = {.chan = chan, .op = L1_CHAN_SEND, .data = (void *)elem};
+  l1_chan_select(&send, 1, true);
+  return send.err;
+}
+
+l1_error l1_chan_recv(l1_chan *chan, void *elem)
+{
+  l1_chan_case recv = {.chan = chan, .op = L1_CHAN_RECV, .data = elem};
+  l1_chan_select(&recv, 1, true);
+  return recv.err;
+}
+
+l1_error l1_chan_close(l1_chan *chan)
+{
+  l1_preempt_disable();
+  chan_lock(chan);
+  if (chan->closed)
+  {
+    chan_unlock(chan);
+    l1_preempt_enable();
+    return ERRINVAL;
+  }
+  chan->closed = true;
+  l1_chan_waiter *waiter;
+  while ((waiter = queue_take(&chan->receivers)) != NULL)
+  {
+    memset(waiter->data, 0, chan->elem_size);
+    waiter->err = ERRCLOSED;
+    waiter_wake(waiter);
+  }
+  while ((waiter = queue_take(&chan->senders)) != NULL)
+  {
+    waiter->err = ERRCLOSED;
+    waiter_wake(waiter);
+  }
+  chan_unlock(chan);
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+int l1_chan_select(l1_chan_case *cases, size_t count, bool block)
+{
+  if (count == 0)
+  {
+    return -1;
+  }
+  l1_chan *locked[count];
+  l1_preempt_disable();
+  size_t n = chan_lock_all(cases, count, locked);
+
+  /* Complete a case that can proceed */
+  size_t start = select_start++;
+  for (size_t k = 0; k < count; k++)
+  {
+    size_t i = (start + k) % count;
+    l1_thread_info *receiver = NULL;
+    bool done = (cases[i].op == L1_CHAN_SEND)
+                    ? chan_try_send(cases[i].chan, cases[i].data, &cases[i].err, &receiver)
+                    : chan_try_recv(cases[i].chan, cases[i].data, &cases[i].err);
+    if (done)
+    {
+      l1_tid receiver_id = (receiver != NULL) ? receiver->id : -1;
+      chan_unlock_all(locked, n);
+      l1_preempt_enable();
+      if (receiver_id != -1)
+      {
+        chan_switch_to(receiver_id);
+      }
+      return i;
+    }
+  }
+  if (!block)
+  {
+    chan_unlock_all(locked, n);
+    l1_preempt_enable();
+    return -1;
+  }
+
+  /* Wait on every case, the first one served wins */
+  struct l1_chan_select select = {.fired = -1};
+  l1_chan_waiter waiters[count];
+  l1_thread_info *current = get_scheduler()->current;
+  for (size_t i = 0; i < count; i++)
+  {
+    waiters[i].thread = current;
+    waiters[i].data = cases[i].data;
+    waiters[i].err = SUCCESS;
+    waiters[i].select = (count > 1) ? &select : NULL;
+    waiters[i].index = i;
+    queue_push((cases[i].op == L1_CHAN_SEND) ? &cases[i].chan->senders : &cases[i].chan->receivers,
+               &waiters[i]);
+  }
+  current->state = BLOCKED;
+  current->wait_reason = L1_WAIT_SYNC;
+  chan_unlock_all(locked, n);
+  yield(-1);
+
+  /* Withdraw from the other cases */
+  n = chan_lock_all(cases, count, locked);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (waiters[i].queued)
+    {
+      queue_remove((cases[i].op == L1_CHAN_SEND) ? &cases[i].chan->senders : &cases[i].chan->receivers,
+                   &waiters[i]);
+    }
+  }
+  chan_unlock_all(locked, n);
+  l1_preempt_enable();
+  int fired = (count > 1) ? __atomic_load_n(&select.fired, __ATOMIC_ACQUIRE) : 0;
+  cases[fired].err = waiters[fired].err;
+  return fired;
+}
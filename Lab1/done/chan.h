@@ -0,0 +1,128 @@
+/**
+ * @file chan.h
+ * @brief Go-style channels between green threads
+ *
+ * A channel carries fixed-size elements, copied in and out with memcpy.
+ * Its buffer is a ring of `capacity` elements, or grows on demand when the
+ * channel is unbounded. With a capacity of 0 the channel is unbuffered and
+ * every send waits for a receive, and conversely.
+ *
+ * When a receiver already waits, a send copies the element straight into
+ * the receiver's destination, bypassing the buffer, makes it RUNNABLE and
+ * switches to it (a directed yield, see schedule.h). Likewise a receive
+ * that frees a slot, or meets a waiting sender on an unbuffered channel,
+ * takes over the sender's element and makes it RUNNABLE. Waiters are
+ * queued in FIFO order.
+ *
+ * Waiting threads are BLOCKED in L1_WAIT_SYNC, like with sync.h, and the
+ * same rules apply: only green threads may wait, and in M:N mode a directed
+ * yield is a plain yield so the sender keeps running.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "error.h"
+#include "thread_info.h"
+
+#define L1_CHAN_UNBOUNDED ((size_t)-1)
+
+struct l1_chan_select;
+
+/* A thread waiting on a channel, lives on its stack */
+typedef struct l1_chan_waiter
+{
+  l1_thread_info *thread;
+  struct l1_chan_waiter *prev;
+  struct l1_chan_waiter *next;
+  void *data;                    /* Destination of a receive, source of a send */
+  l1_error err;                  /* SUCCESS, or ERRCLOSED */
+  bool queued;                   /* In the queue of its channel */
+  struct l1_chan_select *select; /* NULL unless waiting in l1_chan_select */
+  size_t index;                  /* Case of the select */
+} l1_chan_waiter;
+
+typedef struct
+{
+  l1_chan_waiter *head;
+  l1_chan_waiter *tail;
+} l1_chan_queue;
+
+typedef struct
+{
+  size_t elem_size;
+  size_t capacity;         /* Maximum number of buffered elements */
+  char *ring;              /* Buffered elements */
+  size_t ring_capacity;    /* Slots allocated in ring */
+  size_t head;             /* Slot of the oldest element */
+  size_t len;              /* Buffered elements */
+  bool closed;
+  char guard;              /* Spinlock, only contended in M:N mode */
+  l1_chan_queue receivers;
+  l1_chan_queue senders;
+} l1_chan;
+
+typedef enum
+{
+  L1_CHAN_SEND,
+  L1_CHAN_RECV,
+} l1_chan_op;
+
+/* One operation of l1_chan_select */
+typedef struct
+{
+  l1_chan *chan;
+  l1_chan_op op;
+  void *data;   /* Element to send, or where to store the received one */
+  l1_error err; /* Set when the case is the one that completed */
+} l1_chan_case;
+
+/**
+ * @brief Initializes an open channel.
+ *
+ * @param capacity  Elements buffered before a send waits: 0 for an
+ *                  unbuffered channel, L1_CHAN_UNBOUNDED for no limit.
+ * @return SUCCESS, ERRINVAL if elem_size is 0, ERRNOMEM.
+ */
+l1_error l1_chan_init(l1_chan *chan, size_t elem_size, size_t capacity);
+
+/**
+ * @brief Frees the buffer of chan. No thread may wait on it.
+ */
+void l1_chan_destroy(l1_chan *chan);
+
+/**
+ * @brief Sends the element at elem, waiting while the channel is full.
+ *
+ * @return SUCCESS, ERRCLOSED if chan is or gets closed, ERRNOMEM if an
+ *         unbounded channel cannot grow.
+ */
+l1_error l1_chan_send(l1_chan *chan, const void *elem);
+
+/**
+ * @brief Receives an element into elem, waiting while the channel is empty.
+ *
+ * @return SUCCESS, or ERRCLOSED once chan is closed and drained, in which
+ *         case elem is zeroed.
+ */
+l1_error l1_chan_recv(l1_chan *chan, void *elem);
+
+/**
+ * @brief Closes chan: the waiting and later senders fail, the receivers
+ * drain the buffer and then fail.
+ *
+ * @return SUCCESS, or ERRINVAL if chan was already closed.
+ */
+l1_error l1_chan_close(l1_chan *chan);
+
+/**
+ * @brief Performs exactly one of the operations that can proceed.
+ *
+ * The cases are tried from a rotating start so that no ready case starves
+ * the others. If none can proceed, the thread waits on all of them when
+ * block is true, and the function returns -1 otherwise. An operation on a
+ * closed channel can always proceed, and fails with ERRCLOSED in the err
+ * field of its case.
+ *
+ * @return The index of the completed case, or -1.
+ */
+int l1_chan_select(l1_chan_case *cases, size_t count, bool block);
@@ -0,0 +1,112 @@
+/**
+ * @file coro.c
+ * @brief Implementation of the coroutines.
+ */
+#include <stdlib.h>
+#include "coro.h"
+#include "preempt.h"
+#include "schedule.h"
+
+/* Put on top of the constructed stack of every coroutine */
+static void l1_coro_start(void)
+{
+  l1_coro *coro = get_scheduler()->current->coro;
+  /* Disabled by l1_coro_resume */
+  l1_preempt_enable();
+  void *ret = coro->routine(coro->arg);
+  l1_preempt_disable();
+  coro->value = ret;
+  coro->state = L1_CORO_DONE;
+  /* Never resumed again */
+  uint64_t *top;
+  switch_asm(coro->resumer_top, &top);
+}
+
+l1_error l1_coro_create(l1_coro **coro, void *(*routine)(void *), void *arg)
+{
+  l1_coro *fresh = malloc(sizeof(l1_coro));
+  if (fresh == NULL)
+  {
+    return ERRNOMEM;
+  }
+  fresh->stack = reuse_stack();
+  if (fresh->stack == NULL)
+  {
+    free(fresh);
+    return ERRNOMEM;
+  }
+  /* Same frame as a new thread, see l1_thread_create */
+  l1_stack_push(fresh->stack, (uint64_t)0);
+  l1_stack_push(fresh->stack, (uint64_t)l1_coro_start);
+#define M_SAVED_REGS_COUNT 6
+  for (unsigned i = 0; i < M_SAVED_REGS_COUNT; i++)
+  {
+    l1_stack_push(fresh->stack, (uint64_t)0);
+  }
+#undef M_SAVED_REGS_COUNT
+  fresh->resumer_top = NULL;
+  fresh->resumer = NULL;
+  fresh->routine = routine;
+  fresh->arg = arg;
+  fresh->value = NULL;
+  fresh->state = L1_CORO_SUSPENDED;
+  *coro = fresh;
+  return SUCCESS;
+}
+
+l1_error l1_coro_resume(l1_coro *coro, void **value)
+{
+  if (coro == NULL || coro->state != L1_CORO_SUSPENDED)
+  {
+    return ERRINVAL;
+  }
+  /* No tick may switch away halfway, with current->coro out of date */
+  l1_preempt_disable();
+  l1_thread_info *current = get_scheduler()->current;
+  coro->resumer = current->coro;
+  coro->state = L1_CORO_RUNNING;
+  current->coro = coro;
+  switch_asm(coro->stack->top, &coro->resumer_top);
+  /* Back from l1_coro_yield or l1_coro_start, on the same thread */
+  current->coro = coro->resumer;
+  coro->resumer = NULL;
+  l1_preempt_enable();
+  if (value != NULL)
+  {
+    *value = coro->value;
+  }
+  return SUCCESS;
+}
+
+l1_error l1_coro_yield(void *value)
+{
+  l1_preempt_disable();
+  l1_coro *coro = get_scheduler()->current->coro;
+  if (coro == NULL)
+  {
+    l1_preempt_enable();
+    return ERRINVAL;
+  }
+  coro->value = value;
+  coro->state = L1_CORO_SUSPENDED;
+  switch_asm(coro->resumer_top, &coro->stack->top);
+  /* Resumed, preemption was disabled by l1_coro_resume */
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+bool l1_coro_is_done(l1_coro *coro)
+{
+  return coro->state == L1_CORO_DONE;
+}
+
+l1_error l1_coro_destroy(l1_coro *coro)
+{
+  if (coro->state == L1_CORO_RUNNING)
+  {
+    return ERRINVAL;
+  }
+  release_stack(coro->stack);
+  free(coro);
+  return SUCCESS;
+}
@@ -13,6 +13,8 @@ const char *error_strings[] = {
     "SUCCESS",
     "Out of memory",
     "Invalid argument",
+    "Timed out",
+    "Channel closed",
     "Example error",
     "Error code out of bounds"
 };
@@ -10,6 +10,8 @@ typedef enum {
     SUCCESS = 0,
     ERRNOMEM,
     ERRINVAL,
+    ERRTIMEDOUT,
+    ERRCLOSED,
     EXAMPLE_ERROR,
     MAX_ERROR,
 } l1_error;
@@ -0,0 +1,472 @@
+/**
+ * @file event_loop.c
+ * @brief Implementation of the epoll event loop of the scheduler.
+ */
+#define _GNU_SOURCE /* accept4 */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "preempt.h"
+#include "schedule.h"
+/* After thread_info.h: the errno macro would rename l1_thread_info.errno */
+#include <errno.h>
+
+//========================================================================================
+static l1_event_loop *l1_event_loop_get(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (scheduler->event_loop != NULL)
+  {
+    return scheduler->event_loop;
+  }
+  l1_event_loop *loop = calloc(1, sizeof(l1_event_loop));
+  if (loop == NULL)
+  {
+    fprintf(stderr, "Error: unable to allocate the event loop\n");
+    exit(-1);
+  }
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event timer_event = {.events = EPOLLIN, .data.fd = loop->timer_fd};
+  /* Edge-triggered, every write reports wake_fd again without a read */
+  struct epoll_event wake_event = {.events = EPOLLIN | EPOLLET, .data.fd = loop->wake_fd};
+  if (loop->epoll_fd < 0 || loop->timer_fd < 0 || loop->wake_fd < 0 ||
+      epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &timer_event) != 0 ||
+      epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &wake_event) != 0)
+  {
+    fprintf(stderr, "Error: unable to create the event loop\n");
+    exit(-1);
+  }
+  pthread_mutex_init(&loop->wake_lock, NULL);
+  scheduler->event_loop = loop;
+  return loop;
+}
+
+/* Returns the entry of fd, growing the table if needed */
+static l1_event_fd *l1_event_fd_get(l1_event_loop *loop, int fd)
+{
+  if (fd >= loop->fd_capacity)
+  {
+    int capacity = (loop->fd_capacity > 0) ? loop->fd_capacity : 64;
+    while (capacity <= fd)
+    {
+      capacity *= 2;
+    }
+    l1_event_fd *fds = realloc(loop->fds, capacity * sizeof(l1_event_fd));
+    if (fds == NULL)
+    {
+      fprintf(stderr, "Error: unable to grow the event loop\n");
+      exit(-1);
+    }
+    memset(fds + loop->fd_capacity, 0, (capacity - loop->fd_capacity) * sizeof(l1_event_fd));
+    loop->fds = fds;
+    loop->fd_capacity = capacity;
+  }
+  return &loop->fds[fd];
+}
+
+/* Interest is one-shot, so a ready descriptor is reported once per wait */
+static int l1_event_fd_arm(l1_event_loop *loop, int fd, l1_event_fd *entry)
+{
+  struct epoll_event event = {.events = EPOLLONESHOT, .data.fd = fd};
+  if (entry->reader != NULL)
+  {
+    event.events |= EPOLLIN;
+  }
+  if (entry->writer != NULL)
+  {
+    event.events |= EPOLLOUT;
+  }
+  int op = entry->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  int ret = epoll_ctl(loop->epoll_fd, op, fd, &event);
+  /* The descriptor was closed and reopened behind our back */
+  if (ret != 0 && errno == ENOENT)
+  {
+    ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+  }
+  else if (ret != 0 && errno == EEXIST)
+  {
+    ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+  }
+  entry->registered = (ret == 0);
+  return ret;
+}
+
+/* Green thread that can be parked by the calling code, NULL if none */
+static l1_thread_info *l1_event_parkable(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (scheduler == NULL || scheduler->runtime != NULL ||
+      scheduler->current == NULL || scheduler->current == scheduler->tsys)
+  {
+    return NULL;
+  }
+  return scheduler->current;
+}
+
+static int l1_event_set_nonblocking(int fd)
+{
+  int ret = 0;
+  l1_preempt_disable();
+  l1_event_fd *entry = l1_event_fd_get(l1_event_loop_get(), fd);
+  if (!entry->nonblocking)
+  {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+      ret = -1;
+    }
+    entry->nonblocking = (ret == 0);
+  }
+  l1_preempt_enable();
+  return ret;
+}
+
+/* Parks the current thread until fd is ready for reading or writing.
+ * Returns -1, with errno set, if fd cannot be polled. */
+static int l1_event_wait_fd(int fd, bool write)
+{
+  l1_thread_info *current = get_scheduler()->current;
+  l1_preempt_disable();
+  l1_event_loop *loop = l1_event_loop_get();
+  l1_event_fd *entry = l1_event_fd_get(loop, fd);
+  if (write)
+  {
+    entry->writer = current;
+  }
+  else
+  {
+    entry->reader = current;
+  }
+  if (l1_event_fd_arm(loop, fd, entry) != 0)
+  {
+    int err = errno;
+    if (write)
+    {
+      entry->writer = NULL;
+    }
+    else
+    {
+      entry->reader = NULL;
+    }
+    l1_preempt_enable();
+    errno = err;
+    return -1;
+  }
+  loop->io_waiters++;
+  current->state = BLOCKED;
+  current->wait_reason = L1_WAIT_IO;
+  yield(-1);
+  l1_preempt_enable();
+  return 0;
+}
+//========================================================================================
+ssize_t l1_read(int fd, void *buf, size_t count)
+{
+  if (l1_event_parkable() == NULL)
+  {
+    return read(fd, buf, count);
+  }
+  if (l1_event_set_nonblocking(fd) != 0)
+  {
+    return -1;
+  }
+  for (;;)
+  {
+    ssize_t n = read(fd, buf, count);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+      return n;
+    }
+    if (errno != EINTR && l1_event_wait_fd(fd, false) != 0)
+    {
+      return -1;
+    }
+  }
+}
+
+ssize_t l1_write(int fd, const void *buf, size_t count)
+{
+  if (l1_event_parkable() == NULL)
+  {
+    return write(fd, buf, count);
+  }
+  if (l1_event_set_nonblocking(fd) != 0)
+  {
+    return -1;
+  }
+  for (;;)
+  {
+    ssize_t n = write(fd, buf, count);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+      return n;
+    }
+    if (errno != EINTR && l1_event_wait_fd(fd, true) != 0)
+    {
+      return -1;
+    }
+  }
+}
+
+int l1_accept(int fd, struct sockaddr *addr, socklen_t *addrlen)
+{
+  if (l1_event_parkable() == NULL)
+  {
+    return accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  }
+  if (l1_event_set_nonblocking(fd) != 0)
+  {
+    return -1;
+  }
+  for (;;)
+  {
+    int conn = accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn >= 0)
+    {
+      l1_preempt_disable();
+      l1_event_fd *entry = l1_event_fd_get(l1_event_loop_get(), conn);
+      memset(entry, 0, sizeof(l1_event_fd));
+      entry->nonblocking = true;
+      l1_preempt_enable();
+      return conn;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+      return -1;
+    }
+    if (errno != EINTR && l1_event_wait_fd(fd, false) != 0)
+    {
+      return -1;
+    }
+  }
+}
+
+int l1_close(int fd)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (scheduler != NULL && scheduler->event_loop != NULL &&
+      fd >= 0 && fd < scheduler->event_loop->fd_capacity)
+  {
+    l1_event_fd *entry = &scheduler->event_loop->fds[fd];
+    if (entry->registered)
+    {
+      epoll_ctl(scheduler->event_loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    memset(entry, 0, sizeof(l1_event_fd));
+  }
+  return close(fd);
+}
+//========================================================================================
+void l1_notifier_init(l1_notifier *notifier)
+{
+  memset(notifier, 0, sizeof(l1_notifier));
+  pthread_mutex_init(&notifier->lock, NULL);
+  pthread_cond_init(&notifier->cond, NULL);
+}
+
+void l1_notifier_destroy(l1_notifier *notifier)
+{
+  pthread_cond_destroy(&notifier->cond);
+  pthread_mutex_destroy(&notifier->lock);
+}
+
+void l1_notifier_wait(l1_notifier *notifier)
+{
+  l1_thread_info *current = l1_event_parkable();
+  pthread_mutex_lock(&notifier->lock);
+  if (current == NULL)
+  {
+    while (!notifier->signaled)
+    {
+      pthread_cond_wait(&notifier->cond, &notifier->lock);
+    }
+  }
+  if (notifier->signaled)
+  {
+    notifier->signaled = false;
+    pthread_mutex_unlock(&notifier->lock);
+    return;
+  }
+  /* The scheduler only wakes the thread once it has parked it, in
+   * schedule(), so a signal may come in as soon as the lock is released */
+  l1_preempt_disable();
+  l1_event_loop *loop = l1_event_loop_get();
+  notifier->waiter = current;
+  notifier->loop = loop;
+  loop->notifier_waiters++;
+  current->state = BLOCKED;
+  current->wait_reason = L1_WAIT_NOTIFIER;
+  pthread_mutex_unlock(&notifier->lock);
+  yield(-1);
+  l1_preempt_enable();
+}
+
+void l1_notifier_signal(l1_notifier *notifier)
+{
+  pthread_mutex_lock(&notifier->lock);
+  l1_thread_info *waiter = notifier->waiter;
+  if (waiter == NULL)
+  {
+    notifier->signaled = true;
+    pthread_cond_signal(&notifier->cond);
+    pthread_mutex_unlock(&notifier->lock);
+    return;
+  }
+  l1_event_loop *loop = notifier->loop;
+  notifier->waiter = NULL;
+  notifier->woken = waiter;
+  /* Only the first notifier queued needs to wake up the scheduler */
+  pthread_mutex_lock(&loop->wake_lock);
+  bool idle = (loop->wakeups == NULL);
+  notifier->next = loop->wakeups;
+  loop->wakeups = notifier;
+  pthread_mutex_unlock(&loop->wake_lock);
+  pthread_mutex_unlock(&notifier->lock);
+  if (idle)
+  {
+    uint64_t one = 1;
+    ssize_t ret = write(loop->wake_fd, &one, sizeof(one));
+    (void)ret;
+  }
+}
+
+/* Wakes the waiters of the signaled notifiers */
+static size_t l1_event_loop_wake_notified(l1_event_loop *loop)
+{
+  size_t woken = 0;
+  pthread_mutex_lock(&loop->wake_lock);
+  l1_notifier *notifier = loop->wakeups;
+  loop->wakeups = NULL;
+  pthread_mutex_unlock(&loop->wake_lock);
+  while (notifier != NULL)
+  {
+    /* The waiter may reuse the notifier as soon as it runs */
+    l1_notifier *next = notifier->next;
+    wake_thread(notifier->woken, SUCCESS);
+    woken++;
+    notifier = next;
+  }
+  loop->notifier_waiters -= woken;
+  return woken;
+}
+//========================================================================================
+bool l1_event_loop_has_waiters(void)
+{
+  l1_event_loop *loop = get_scheduler()->event_loop;
+  return loop != NULL && (loop->io_waiters > 0 || loop->notifier_waiters > 0);
+}
+
+/* Arms the timer to the next timer of the wheel, relative to now */
+static void l1_event_loop_arm_timer(l1_event_loop *loop, l1_timer_wheel *timers, l1_time now)
+{
+  struct itimerspec timer;
+  memset(&timer, 0, sizeof(timer));
+  if (!timer_wheel_is_empty(timers))
+  {
+    l1_time delay;
+    l1_time_diff(&delay, timer_wheel_next_expiry(timers), now);
+    /* A zero it_value disarms the timer */
+    if (l1_time_are_equal(delay, 0))
+    {
+      delay = 1;
+    }
+#ifdef USE_UNIX_TIME
+    timer.it_value.tv_sec = delay;
+#else
+    timer.it_value.tv_sec = delay / L1_NSEC_PER_SEC;
+    timer.it_value.tv_nsec = delay % L1_NSEC_PER_SEC;
+#endif
+  }
+  timerfd_settime(loop->timer_fd, 0, &timer, NULL);
+}
+
+/* Wakes the waiters of a ready descriptor, re-arms it for the others */
+static size_t l1_event_loop_dispatch(l1_event_loop *loop, struct epoll_event *event)
+{
+  size_t woken = 0;
+  int fd = event->data.fd;
+  if (fd == loop->timer_fd)
+  {
+    /* Only acknowledges the expiration, schedule() advances the wheel */
+    uint64_t expirations;
+    ssize_t ret = read(loop->timer_fd, &expirations, sizeof(expirations));
+    (void)ret;
+    return 0;
+  }
+  if (fd == loop->wake_fd)
+  {
+    return l1_event_loop_wake_notified(loop);
+  }
+  l1_event_fd *entry = &loop->fds[fd];
+  uint32_t broken = EPOLLERR | EPOLLHUP;
+  if (entry->reader != NULL && (event->events & (EPOLLIN | broken)))
+  {
+    wake_thread(entry->reader, SUCCESS);
+    entry->reader = NULL;
+    woken++;
+  }
+  if (entry->writer != NULL && (event->events & (EPOLLOUT | broken)))
+  {
+    wake_thread(entry->writer, SUCCESS);
+    entry->writer = NULL;
+    woken++;
+  }
+  loop->io_waiters -= woken;
+  if (entry->reader != NULL || entry->writer != NULL)
+  {
+    l1_event_fd_arm(loop, fd, entry);
+  }
+  return woken;
+}
+
+void l1_event_loop_poll(bool block)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (!block && !l1_event_loop_has_waiters())
+  {
+    return;
+  }
+  l1_event_loop *loop = l1_event_loop_get();
+  if (block)
+  {
+    l1_time now;
+    l1_time_get(&now);
+    l1_event_loop_arm_timer(loop, &scheduler->timers, now);
+  }
+  struct epoll_event events[L1_EVENT_LOOP_MAX_EVENTS];
+  int n = epoll_wait(loop->epoll_fd, events, L1_EVENT_LOOP_MAX_EVENTS, block ? -1 : 0);
+  if (n < 0 && errno != EINTR)
+  {
+    fprintf(stderr, "Error: epoll_wait failed in the event loop\n");
+    exit(-1);
+  }
+  for (int i = 0; i < n; i++)
+  {
+    l1_event_loop_dispatch(loop, &events[i]);
+  }
+}
+
+void l1_event_loop_destroy(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_event_loop *loop = scheduler->event_loop;
+  if (loop == NULL)
+  {
+    return;
+  }
+  close(loop->timer_fd);
+  close(loop->wake_fd);
+  close(loop->epoll_fd);
+  pthread_mutex_destroy(&loop->wake_lock);
+  free(loop->fds);
+  free(loop);
+  scheduler->event_loop = NULL;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file event_loop.h
+ * @brief Green-thread-aware blocking I/O
+ *
+ * The wrappers below behave like the system calls they are named after, but
+ * only block the calling green thread: the file descriptor is switched to
+ * non-blocking mode and, when the call would block, the thread is parked
+ * BLOCKED (L1_WAIT_IO) until an epoll instance owned by the scheduler
+ * reports the descriptor ready. schedule() polls it every SCHED_PERIOD
+ * ticks, and waits on it, with a timerfd armed to the next timer of the
+ * scheduler's wheel, when no thread is runnable.
+ *
+ * Called from tsys or in M:N mode, where a blocking call only holds up its
+ * worker, the wrappers fall back to the plain blocking system calls.
+ *
+ * An l1_notifier wakes a green thread from any OS thread: the signal queues
+ * the waiter on its event loop and writes to an eventfd that the epoll
+ * instance watches. A thread parked on a notifier keeps schedule() alive,
+ * which then sleeps in epoll_wait instead of returning while nothing is
+ * runnable, and resumes as soon as a timer, a descriptor or a notifier
+ * fires.
+ */
+#pragma once
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include "error.h"
+#include "thread_info.h"
+
+#define L1_EVENT_LOOP_MAX_EVENTS 256
+
+/* Green threads waiting on a file descriptor */
+typedef struct
+{
+  l1_thread_info *reader;        /* Waits for EPOLLIN */
+  l1_thread_info *writer;        /* Waits for EPOLLOUT */
+  bool registered;               /* Added to the epoll instance */
+  bool nonblocking;              /* O_NONBLOCK was set */
+} l1_event_fd;
+
+/* Wakes a green thread from another OS thread, see l1_notifier_wait */
+typedef struct l1_notifier
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;          /* For the waiters that cannot park */
+  bool signaled;                /* Signaled while nobody waited */
+  l1_thread_info *waiter;       /* Green thread parked on the notifier */
+  struct l1_event_loop *loop;   /* Event loop of the waiter */
+  l1_thread_info *woken;        /* Waiter to wake, while queued on loop */
+  struct l1_notifier *next;     /* In the wakeups of loop */
+} l1_notifier;
+
+/* Per scheduler, created by the first call that has to park a thread */
+typedef struct l1_event_loop
+{
+  int epoll_fd;
+  int timer_fd;      /* Armed to the next timer while waiting */
+  int wake_fd;       /* eventfd written when wakeups gets a notifier */
+  l1_event_fd *fds;  /* Indexed by file descriptor */
+  int fd_capacity;   /* Length of fds */
+  size_t io_waiters; /* Threads BLOCKED in L1_WAIT_IO */
+  size_t notifier_waiters;   /* Threads BLOCKED in L1_WAIT_NOTIFIER */
+  pthread_mutex_t wake_lock; /* Protects wakeups, taken by other OS threads */
+  l1_notifier *wakeups;      /* Signaled notifiers whose waiter is not woken yet */
+} l1_event_loop;
+
+/**
+ * @brief read(2) that parks the green thread until fd is readable.
+ */
+ssize_t l1_read(int fd, void *buf, size_t count);
+
+/**
+ * @brief write(2) that parks the green thread until fd is writable.
+ *
+ * Like write(2), it may write less than count bytes.
+ */
+ssize_t l1_write(int fd, const void *buf, size_t count);
+
+/**
+ * @brief accept(2) that parks the green thread until a connection arrives.
+ *
+ * The returned socket is already non-blocking.
+ */
+int l1_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief close(2) that also forgets the state kept for fd, so the number
+ * can be reused by a new descriptor. No thread may wait on fd.
+ */
+int l1_close(int fd);
+
+/**
+ * @brief Initializes a notifier, not signaled.
+ */
+void l1_notifier_init(l1_notifier *notifier);
+
+/**
+ * @brief Destroys a notifier nobody waits on.
+ */
+void l1_notifier_destroy(l1_notifier *notifier);
+
+/**
+ * @brief Parks the green thread until the notifier is signaled, and consumes
+ * the signal. Returns at once if it was signaled since the last wait.
+ *
+ * A single thread may wait on a notifier at a time. Called from tsys or in
+ * M:N mode, it blocks the OS thread on a condition variable instead.
+ */
+void l1_notifier_wait(l1_notifier *notifier);
+
+/**
+ * @brief Signals the notifier, from any OS thread. Signals that arrive
+ * before the waiter consumed the previous one are merged.
+ *
+ * The scheduler of the waiter wakes it at its next poll of the event loop,
+ * at once if it is idle. That scheduler must not be cleaned up before.
+ */
+void l1_notifier_signal(l1_notifier *notifier);
+
+/**
+ * @brief Returns true if threads of the calling scheduler wait for I/O or
+ * for a notifier.
+ */
+bool l1_event_loop_has_waiters(void);
+
+/**
+ * @brief Wakes the threads whose descriptor is ready.
+ *
+ * @param block  Wait until a descriptor is ready or the next timer of the
+ *               scheduler is due.
+ */
+void l1_event_loop_poll(bool block);
+
+/**
+ * @brief Closes the epoll instance of the calling scheduler.
+ */
+void l1_event_loop_destroy(void);
@@ -0,0 +1,59 @@
+/**
+ * @file histogram.c
+ * @brief Implementation of the log-linear histograms.
+ */
+#include <string.h>
+#include "histogram.h"
+
+static unsigned bucket_index(uint64_t value) {
+  if (value < L1_HISTOGRAM_SUBS) {
+    return value;
+  }
+  unsigned shift = 63 - __builtin_clzll(value) - L1_HISTOGRAM_SUB_BITS;
+  return shift * L1_HISTOGRAM_SUBS + (value >> shift);
+}
+
+/* Largest value counted by the bucket */
+static uint64_t bucket_upper(unsigned index) {
+  if (index < 2 * L1_HISTOGRAM_SUBS) {
+    return index;
+  }
+  unsigned shift = index / L1_HISTOGRAM_SUBS - 1;
+  uint64_t low = (uint64_t)(index - shift * L1_HISTOGRAM_SUBS) << shift;
+  return low + ((1ULL << shift) - 1);
+}
+
+void l1_histogram_init(l1_histogram* histogram) {
+  memset(histogram, 0, sizeof(l1_histogram));
+}
+
+void l1_histogram_record(l1_histogram* histogram, uint64_t value) {
+  if (histogram->count == 0 || value < histogram->min) {
+    histogram->min = value;
+  }
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+  histogram->count++;
+  histogram->sum += value;
+  histogram->buckets[bucket_index(value)]++;
+}
+
+uint64_t l1_histogram_quantile(const l1_histogram* histogram, double quantile) {
+  if (histogram->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(quantile * histogram->count);
+  if (rank < quantile * histogram->count || rank == 0) {
+    rank++;
+  }
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < L1_HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t upper = bucket_upper(i);
+      return (upper < histogram->max) ? upper : histogram->max;
+    }
+  }
+  return histogram->max;
+}
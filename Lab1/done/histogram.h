@@ -0,0 +1,41 @@
+/**
+ * @file histogram.h
+ * @brief Header file for the log-linear latency histograms of the scheduler
+ */
+#pragma once
+#include <stdint.h>
+
+/* Values below 2^SUB_BITS have a bucket each, every larger power of two is
+ * split in 2^SUB_BITS buckets, so a bucket is within 1/2^SUB_BITS (6%) of
+ * the values it counts, from 1 ns to 2^64 ns. */
+#define L1_HISTOGRAM_SUB_BITS 4
+#define L1_HISTOGRAM_SUBS (1 << L1_HISTOGRAM_SUB_BITS)
+#define L1_HISTOGRAM_BUCKETS ((64 - L1_HISTOGRAM_SUB_BITS + 1) * L1_HISTOGRAM_SUBS)
+
+/**
+ * @brief A histogram with a bounded relative error, like HdrHistogram.
+ */
+typedef struct l1_histogram {
+  uint64_t count; /* Recorded values */
+  uint64_t sum;
+  uint64_t min;   /* Exact, valid if count > 0 */
+  uint64_t max;
+  uint64_t buckets[L1_HISTOGRAM_BUCKETS];
+} l1_histogram;
+
+/**
+ * @brief Empties a histogram.
+ */
+void l1_histogram_init(l1_histogram* histogram);
+
+/**
+ * @brief Counts value once.
+ */
+void l1_histogram_record(l1_histogram* histogram, uint64_t value);
+
+/**
+ * @brief Returns the smallest value v such that at least a fraction
+ * `quantile` of the recorded values is <= v, up to the precision of the
+ * buckets. Returns 0 if the histogram is empty.
+ */
+uint64_t l1_histogram_quantile(const l1_histogram* histogram, double quantile);
@@ -3,22 +3,59 @@
  *
  * @author Adrien Ghosn, Mark Sutherland
  */
+#include <cpuid.h>
 #include <time.h>
 #include "l1_time.h"
 
+/* Calibration window of the TSC against CLOCK_MONOTONIC_RAW */
+#define L1_TSC_CALIBRATION_NS (10 * L1_NSEC_PER_MSEC)
 
-void l1_time_init(l1_time* t) {
-  *t = 0;
+uint64_t l1_ns_base = 0;
+uint64_t l1_tsc_base = 0;
+uint64_t l1_tsc_mult = 0;
+
+#if !defined(USE_UNIX_TIME) && !defined(USE_CLOCK_GETTIME)
+/* CPUID.80000007H:EDX[8] advertises a TSC ticking at a constant rate in
+ * all power states, rdtscp is CPUID.80000001H:EDX[27]. */
+static int l1_tsc_is_usable(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 27))) {
+    return 0;
+  }
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  return (edx & (1u << 8)) != 0;
+}
+
+static uint64_t l1_rdtscp(void) {
+  unsigned int lo, hi, aux;
+  asm volatile("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+  return ((uint64_t)hi << 32) | lo;
 }
-  
-void l1_time_get(l1_time* t) {
-#ifdef USE_UNIX_TIME
-    time(t);
-#else
-  unsigned int lo, hi; 
-  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
-  *t = ((uint64_t)hi << 32) | lo;
 #endif
+
+void l1_time_calibrate(void) {
+#if !defined(USE_UNIX_TIME) && !defined(USE_CLOCK_GETTIME)
+  if (l1_tsc_mult != 0 || !l1_tsc_is_usable()) {
+    return;
+  }
+  uint64_t ns_start = l1_time_monotonic_ns();
+  uint64_t tsc_start = l1_rdtscp();
+  uint64_t ns_end, tsc_end;
+  do {
+    ns_end = l1_time_monotonic_ns();
+    tsc_end = l1_rdtscp();
+  } while (ns_end - ns_start < L1_TSC_CALIBRATION_NS);
+
+  l1_ns_base = ns_end;
+  l1_tsc_base = tsc_end;
+  l1_tsc_mult = ((ns_end - ns_start) << 32) / (tsc_end - tsc_start);
+#endif
+}
+
+void l1_time_init(l1_time* t) {
+  *t = 0;
 }
 
 void l1_time_diff(l1_time* result, l1_time end, l1_time start) {
@@ -7,7 +7,14 @@
 #include <stdint.h>
 #include <time.h>
 
-#define USE_UNIX_TIME
+/* Time backends. Unless USE_UNIX_TIME is defined, l1_time counts nanoseconds:
+ *  - by default, the invariant TSC is read with rdtscp and converted to
+ *    nanoseconds with a multiplier calibrated by l1_time_calibrate against
+ *    CLOCK_MONOTONIC_RAW. Without an invariant TSC, or before calibration,
+ *    clock_gettime(CLOCK_MONOTONIC_RAW) is used instead.
+ *  - USE_CLOCK_GETTIME forces clock_gettime(CLOCK_MONOTONIC_RAW).
+ *  - USE_UNIX_TIME uses time(), with a resolution of one second. */
+// #define USE_UNIX_TIME
 
 /* Definition of time type */
 #ifdef USE_UNIX_TIME
@@ -16,6 +23,18 @@ typedef time_t l1_time;
 typedef uint64_t l1_time;
 #endif
 
+#define L1_NSEC_PER_USEC 1000ULL
+#define L1_NSEC_PER_MSEC (1000 * L1_NSEC_PER_USEC)
+#define L1_NSEC_PER_SEC (1000 * L1_NSEC_PER_MSEC)
+
+/**
+ * @brief Calibrates the TSC against the monotonic clock.
+ *
+ * Spins for a few milliseconds. Called once by initialize_scheduler, calling
+ * it again is a no-op.
+ */
+void l1_time_calibrate(void);
+
 /**
  * @brief initializes time variable
  */
@@ -24,7 +43,7 @@ void l1_time_init(l1_time* t);
 /**
  * @brief puts the current time in t.
  */
- void l1_time_get(l1_time* t);
+static inline void l1_time_get(l1_time* t);
 
 /**
  * @brief Puts the time difference between start and end in result.
@@ -36,7 +55,7 @@ void l1_time_diff(l1_time* result, l1_time end, l1_time start);
  */
 void l1_time_add(l1_time* accumulator, l1_time delta);
 
-/** 
+/**
  * @brief return 1 if a < b, 0 if a >= b
  */
 int l1_time_is_smaller(l1_time a, l1_time b);
@@ -45,3 +64,34 @@ int l1_time_is_smaller(l1_time a, l1_time b);
  * @brief return 1 if a == b, 0 otherwise
  */
 int l1_time_are_equal(l1_time a, l1_time b);
+
+/* l1_time_get is on the context switch path, so it is inlined here.
+ * Calibration state: ns = l1_ns_base + ((tsc - l1_tsc_base) * l1_tsc_mult) >> 32,
+ * on the same time line as CLOCK_MONOTONIC_RAW. */
+extern uint64_t l1_ns_base;
+extern uint64_t l1_tsc_base;
+extern uint64_t l1_tsc_mult;
+
+static inline uint64_t l1_time_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t)ts.tv_sec * L1_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline void l1_time_get(l1_time* t) {
+#if defined(USE_UNIX_TIME)
+  time(t);
+#elif defined(USE_CLOCK_GETTIME)
+  *t = l1_time_monotonic_ns();
+#else
+  if (l1_tsc_mult == 0) {
+    *t = l1_time_monotonic_ns();
+    return;
+  }
+  unsigned int lo, hi, aux;
+  asm volatile("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+  __extension__ typedef unsigned __int128 l1_u128;
+  uint64_t cycles = (((uint64_t)hi << 32) | lo) - l1_tsc_base;
+  *t = l1_ns_base + (uint64_t)(((l1_u128)cycles * l1_tsc_mult) >> 32);
+#endif
+}
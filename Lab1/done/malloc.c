@@ -33,21 +33,24 @@ l1_error libc_free(void *ptr)
  */
 char (*l1_chunk_arena)[CHUNK_SIZE];
 l1_chunk_desc_t *l1_chunk_meta;
-max_align_t l1_region_magic;
+l1_region_hdr_t *l1_chunk_regions;
+size_t l1_chunk_rover;
+uint64_t l1_region_magic;
 //=========================================================
 void l1_chunk_init(void)
 {
   /* Allocate chunk arena and metadata */
   l1_chunk_arena = malloc(ALLOC8R_HEAP_SIZE);
   /* Allocate space for metadata */
-  l1_chunk_meta = calloc(sizeof(l1_chunk_desc_t), CHUNK_ARENA_LENGTH);
-  if ((l1_chunk_arena == NULL) || (l1_chunk_meta == NULL))
+  l1_chunk_meta = calloc(sizeof(l1_chunk_desc_t), CHUNK_META_LENGTH);
+  l1_chunk_regions = calloc(sizeof(l1_region_hdr_t), CHUNK_ARENA_LENGTH);
+  l1_chunk_rover = 0;
+  if ((l1_chunk_arena == NULL) || (l1_chunk_meta == NULL) || (l1_chunk_regions == NULL))
   {
     //free before exiting
-    if (l1_chunk_arena == NULL)
-      free(l1_chunk_arena);
-    else
-      free(l1_chunk_meta);
+    free(l1_chunk_arena);
+    free(l1_chunk_meta);
+    free(l1_chunk_regions);
 
     printf("Unable to allocate %d bytes for the chunk allocator\n", ALLOC8R_HEAP_SIZE);
     exit(1);
@@ -55,7 +58,7 @@ void l1_chunk_init(void)
 
   /* Generate random chunk magic */
   srand(time(NULL));
-  for (unsigned i = 0; i < sizeof(max_align_t); ++i)
+  for (unsigned i = 0; i < sizeof(uint64_t); ++i)
     *(((char *)&l1_region_magic) + i) = rand();
 }
 //=========================================================
@@ -63,46 +66,109 @@ void l1_chunk_deinit(void)
 {
   free(l1_chunk_arena);
   free(l1_chunk_meta);
+  free(l1_chunk_regions);
 }
 //=========================================================
 /**
- * verify that chunks are free, and if not, tells position of last occupied position
+ * Returns the first chunk of a run of len free chunks that lies within
+ * [from, to), or to if there is none.
+ *
+ * The bitmap is scanned a word at a time, whatever the number of runs in the
+ * word: and-ing the free bits with themselves shifted by 1, 2, 4... chunks
+ * leaves set only the chunks that start len free chunks in the word, and
+ * carry counts the free chunks at the top of the previous words, which a run
+ * that spans words starts with.
  */
-unsigned l1_verify_chunks_free(size_t from, size_t len, size_t *last_occupied)
+size_t l1_chunk_find_run(size_t from, size_t to, size_t len)
+{
+  if (from >= to || len == 0 || len > to - from)
+  {
+    return to;
+  }
+  size_t carry = 0;
+  size_t const last_word = (to - 1) / CHUNK_META_BITS;
+  for (size_t word = from / CHUNK_META_BITS; word <= last_word; word++)
+  {
+    size_t const base = word * CHUNK_META_BITS;
+    l1_chunk_desc_t free_bits = ~l1_chunk_meta[word];
+    /* Chunks out of [from, to) count as taken */
+    if (from > base)
+    {
+      free_bits &= ~(l1_chunk_desc_t)0 << (from - base);
+    }
+    if (to - base < CHUNK_META_BITS)
+    {
+      free_bits &= ((l1_chunk_desc_t)1 << (to - base)) - 1;
+    }
+    if (free_bits == ~(l1_chunk_desc_t)0)
+    {
+      carry += CHUNK_META_BITS;
+      if (carry >= len)
+      {
+        return base + CHUNK_META_BITS - carry;
+      }
+      continue;
+    }
+    /* A run from the previous words that ends in this one */
+    if (carry + __builtin_ctzll(~free_bits) >= len)
+    {
+      return base - carry;
+    }
+    if (len <= CHUNK_META_BITS)
+    {
+      l1_chunk_desc_t starts = free_bits;
+      for (size_t run = 1; run < len && starts != 0;)
+      {
+        size_t const shift = (run < len - run) ? run : len - run;
+        starts &= starts >> shift;
+        run += shift;
+      }
+      if (starts != 0)
+      {
+        return base + __builtin_ctzll(starts);
+      }
+    }
+    carry = __builtin_clzll(~free_bits);
+  }
+  return to;
+}
+//=========================================================
+/* Sets the bits of the chunks in [from, from + len) to taken, a word at a time */
+void l1_chunk_set_run(size_t from, size_t len, unsigned taken)
 {
-  unsigned is_free = 1;
   size_t const bound = from + len;
-  for (size_t i = from; i < bound; i++)
+  while (from < bound)
   {
-    if (IS_CHUNK_TAKEN(i))
+    size_t const offset = from % CHUNK_META_BITS;
+    size_t const count = (bound - from < CHUNK_META_BITS - offset) ? bound - from
+                                                                   : CHUNK_META_BITS - offset;
+    l1_chunk_desc_t const mask = ((count == CHUNK_META_BITS) ? ~(l1_chunk_desc_t)0
+                                                             : (((l1_chunk_desc_t)1 << count) - 1))
+                                 << offset;
+    if (taken)
+    {
+      l1_chunk_meta[from / CHUNK_META_BITS] |= mask;
+    }
+    else
     {
-      is_free = 0; /*This chunk cannot be used */
-      *last_occupied = i;
+      l1_chunk_meta[from / CHUNK_META_BITS] &= ~mask;
     }
+    from += count;
   }
-  return is_free;
 }
 //=========================================================
-/* Create header and copy it in alloc_start's chunk*/
-void l1_set_hdr_chunk(size_t alloc_start, size_t size)
+/* Record the region starting at alloc_start in the region table */
+void l1_set_region_hdr(size_t alloc_start, size_t chunk_count)
 {
-  l1_region_hdr_t hdr;
-  hdr.magic0 = l1_region_magic;
-  hdr.magic1 = l1_region_magic;
-  hdr.size = size;
-
-  //Instead of for loop
-  memcpy((void *)l1_chunk_arena[alloc_start],
-         (void *)&hdr,
-         sizeof(l1_region_hdr_t));
+  l1_region_hdr_t *hdr = &l1_chunk_regions[alloc_start];
+  hdr->magic = l1_region_magic;
+  hdr->chunks = chunk_count;
 }
 //=========================================================
 size_t l1_chunk_count(size_t byte_size)
 {
   return byte_size / CHUNK_SIZE +
-         /* up rounding */ (byte_size % CHUNK_SIZE != 0 ? 1 : 0)
-         /*metadata header */
-         + 1;
+         /* up rounding */ (byte_size % CHUNK_SIZE != 0 ? 1 : 0);
 }
 //=========================================================
 void *l1_chunk_malloc(size_t size)
@@ -118,48 +184,39 @@ void *l1_chunk_malloc(size_t size)
   }
 
   size_t const req_chunk_count = l1_chunk_count(size);
-  //Need signed type
-  long chunk_bound = CHUNK_ARENA_LENGTH - req_chunk_count + 1;
-  size_t alloc_start = 0;
-  unsigned can_alloc = 0;
-
-  while (!can_alloc && alloc_start < chunk_bound)
+  if (req_chunk_count > CHUNK_ARENA_LENGTH)
   {
-    if (IS_CHUNK_FREE(alloc_start))
-    {
-      size_t last_occupied; //Set by function when chunks are not free
-      if (l1_verify_chunks_free(alloc_start, req_chunk_count, &last_occupied))
-      {
-        can_alloc = 1;
-      }
-      else
-      {
-        //Could not alloc here, so jump to last occupied chunk
-        alloc_start = last_occupied + 1;
-      }
-    }
-    else
-    {
-      alloc_start++;
-    }
+    l1_errno = ERRNOMEM;
+    return NULL;
   }
 
-  if (can_alloc)
+  /* Next fit: from the rover to the end of the arena, then from the start,
+   * which also finds the runs that straddle the rover */
+  size_t rover = l1_chunk_rover;
+  size_t alloc_start = l1_chunk_find_run(rover, CHUNK_ARENA_LENGTH, req_chunk_count);
+  if (alloc_start == CHUNK_ARENA_LENGTH && rover > 0)
   {
-    //lock metadata chunks
-    size_t lock_bound = alloc_start + req_chunk_count;
-    for (size_t s = alloc_start; s < lock_bound; s++)
+    size_t const wrap_bound = (rover + req_chunk_count - 1 < CHUNK_ARENA_LENGTH)
+                                  ? rover + req_chunk_count - 1
+                                  : CHUNK_ARENA_LENGTH;
+    alloc_start = l1_chunk_find_run(0, wrap_bound, req_chunk_count);
+    if (alloc_start == wrap_bound)
     {
-      SET_CHUNK_TAKEN(s);
+      alloc_start = CHUNK_ARENA_LENGTH;
     }
-    l1_set_hdr_chunk(alloc_start, size);
-    return &(l1_chunk_arena[alloc_start + 1]);
   }
-  else
+
+  if (alloc_start == CHUNK_ARENA_LENGTH)
   {
     l1_errno = ERRNOMEM;
     return NULL;
   }
+
+  //lock metadata chunks
+  l1_chunk_set_run(alloc_start, req_chunk_count, 1);
+  l1_chunk_rover = (alloc_start + req_chunk_count) % CHUNK_ARENA_LENGTH;
+  l1_set_region_hdr(alloc_start, req_chunk_count);
+  return &(l1_chunk_arena[alloc_start]);
 }
 //=========================================================
 /* Compares max_align_t structs */
@@ -187,27 +244,24 @@ l1_error l1_chunk_free(void *ptr)
   if (ptr == NULL)
     return SUCCESS;
 
-  if (ptr < (void *)l1_chunk_arena)
+  //Compare addresses as integers, ptr may point anywhere
+  uintptr_t const arena_start = (uintptr_t)l1_chunk_arena;
+  uintptr_t const addr = (uintptr_t)ptr;
+  if (addr < arena_start || addr >= arena_start + ALLOC8R_HEAP_SIZE ||
+      (addr - arena_start) % CHUNK_SIZE != 0)
   {
     return ERRINVAL;
   }
 
-  char(*chunks)[CHUNK_SIZE] = ptr; // cast
-  char(*header_chunk)[CHUNK_SIZE] = &(chunks[-1]);
-  l1_region_hdr_t hdr;
-  memcpy(&hdr, header_chunk, sizeof(l1_region_hdr_t)); //Get header content
+  //Chunk count between ptr and start of memory
+  size_t start_offset = (addr - arena_start) / CHUNK_SIZE;
+  l1_region_hdr_t *hdr = &l1_chunk_regions[start_offset];
 
-  if (l1_align_equals(&hdr.magic0, &l1_region_magic) &&
-      l1_align_equals(&hdr.magic1, &l1_region_magic))
+  if (hdr->magic == l1_region_magic && hdr->chunks != 0)
   {
-    //Find position in chunk meta list
-    //Chunk count between ptr and start of memory
-    size_t start_offset = (header_chunk - l1_chunk_arena);
-    size_t chunk_count = l1_chunk_count(hdr.size);
-    for (size_t i = 0; i < chunk_count; i++)
-    {
-      SET_CHUNK_FREE(start_offset + i);
-    }
+    l1_chunk_set_run(start_offset, hdr->chunks, 0);
+    //Forget the region, a second free must fail
+    memset(hdr, 0, sizeof(l1_region_hdr_t));
     return SUCCESS;
   }
   else
@@ -6,6 +6,7 @@
  */
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include "error.h"
 
@@ -26,53 +27,56 @@ l1_error libc_free(void *ptr);
  * with a fixed-size heap region, it divides the region into fixed-size chunks.
  * The collection of all available chunks is henceforth called the "arena". The
  * arena has `CHUNK_ARENA_LENGTH` consecutive chunks, each `CHUNK_SIZE` bytes
- * long, starting at `l1_chunk_arena`. The chunk allocator also maintains, for
- * each chunk, a data structure of type `l1_chunk_desc_t` which describes the
- * status of that chunk. These data structures are stored in an array starting
- * at `l1_chunk_meta`. This array is mainly used to check whether a chunk is
- * allocated or free.
+ * long, starting at `l1_chunk_arena`. The chunk allocator also maintains a
+ * bitmap, `l1_chunk_meta`, with one bit per chunk set while the chunk is
+ * allocated. Chunk x is bit x % 64 of the word x / 64, so a search for free
+ * chunks tests 64 of them at a time and skips whole words that are taken or
+ * free.
+ *
+ * Searches are next-fit: they start at `l1_chunk_rover`, just past the last
+ * region allocated, and wrap around the end of the arena. Freed chunks in
+ * front of the rover are found again once the search wraps.
  * 
  * To allocate a region of some size S, a contiguous sequence of chunks is
- * reserved to fit the requested size, and an additional chunk directly
- * preceding that region must be allocated to store metadata describing that
- * region. For instance, with a chunk size of 4KiB, a requested region size of
- * 10KiB, and starting with an empty arena, one possible allocation output could
- * be:
- *   - Chunk 0: region metadata
+ * reserved to fit the requested size. The metadata describing that region is
+ * kept out of the arena, in the entry of its first chunk in `l1_chunk_regions`,
+ * a table of `l1_region_hdr_t` with one entry per chunk. For instance, with a
+ * chunk size of 4KiB, a requested region size of 10KiB, and starting with an
+ * empty arena, one possible allocation output could be:
+ *   - Chunk 0: data chunk, region metadata in l1_chunk_regions[0]
  *   - Chunk 1: data chunk
- *   - Chunk 2: data chunk
- *   - Chunk 3: data chunk (partially used, but entirely allocated)
- * 
- * The chunk storing region metadata accesses a data structure of type
- * `l1_region_hdr_t`, stored at the beginning of that chunk.
+ *   - Chunk 2: data chunk (partially used, but entirely allocated)
  */
 
 #define CHUNK_SIZE (1 << 12) // 4KiB 
 #define CHUNK_ARENA_LENGTH (ALLOC8R_HEAP_SIZE / CHUNK_SIZE)
 
-#define IS_CHUNK_FREE(x) (l1_chunk_meta[x] == 0)
-#define IS_CHUNK_TAKEN(x) (l1_chunk_meta[x] == 1)
-#define SET_CHUNK_FREE(x) (l1_chunk_meta[x] = 0)
-#define SET_CHUNK_TAKEN(x) (l1_chunk_meta[x] = 1)
+#define CHUNK_META_BITS 64
+#define CHUNK_META_LENGTH ((CHUNK_ARENA_LENGTH + CHUNK_META_BITS - 1) / CHUNK_META_BITS)
+
+#define CHUNK_META_BIT(x) ((l1_chunk_desc_t)1 << ((x) % CHUNK_META_BITS))
+#define IS_CHUNK_TAKEN(x) ((l1_chunk_meta[(x) / CHUNK_META_BITS] & CHUNK_META_BIT(x)) != 0)
+#define IS_CHUNK_FREE(x) (!IS_CHUNK_TAKEN(x))
+#define SET_CHUNK_FREE(x) (l1_chunk_meta[(x) / CHUNK_META_BITS] &= ~CHUNK_META_BIT(x))
+#define SET_CHUNK_TAKEN(x) (l1_chunk_meta[(x) / CHUNK_META_BITS] |= CHUNK_META_BIT(x))
 
 /**
- * The data structure used to store the metadata for each allocated chunk.
+ * A word of the chunk bitmap, describing CHUNK_META_BITS chunks.
  */
-typedef char l1_chunk_desc_t;
+typedef uint64_t l1_chunk_desc_t;
 
 /**
  * The data structure used to store the metadata for each allocated region. It
- * is stored in a header chunk directly preceding the region.
+ * is stored in the entry of the first chunk of the region in `l1_chunk_regions`.
  * 
- * Every allocated region of contiguous chunks is preceded by a chunk solely
- * dedicated to store metadata about that region. This metadata includes the
- * size of the region and a couple magic values surrounding the size field, used
- * as a sanity check when freeing the region.
+ * This metadata includes the length of the region in chunks and a magic value,
+ * used as a sanity check when freeing the region. The entries of the other
+ * chunks, and of the freed regions, are zeroed, so a pointer that is not the
+ * start of a live region fails the check.
  */
 typedef struct {
-  max_align_t magic0;
-  size_t size;
-  max_align_t magic1;
+  uint64_t magic;
+  size_t chunks;
 } l1_region_hdr_t;
 
 /**
@@ -82,22 +86,33 @@ typedef struct {
 extern char (*l1_chunk_arena)[CHUNK_SIZE];
 
 /**
- * A pointer to an array of chunk metadata structures. This is expected to be
- * allocated during initialization.
+ * A pointer to the chunk bitmap, `CHUNK_META_LENGTH` words long. This is
+ * expected to be allocated during initialization.
  */
 extern l1_chunk_desc_t *l1_chunk_meta;
 
+/**
+ * A pointer to the region metadata table, `CHUNK_ARENA_LENGTH` entries long,
+ * indexed by chunk. This is expected to be allocated during initialization.
+ */
+extern l1_region_hdr_t *l1_chunk_regions;
+
+/**
+ * The chunk where the next search for free chunks starts.
+ */
+extern size_t l1_chunk_rover;
+
 /**
  * A random magic value used for verifying that the region header is valid.
  */
-extern max_align_t l1_region_magic;
+extern uint64_t l1_region_magic;
 
 /**
  * @brief      Initializes the chunk arena and metadata
  * 
  * Allocates the entire chunk arena, consisting of `CHUNK_ARENA_LENGTH` chunks,
  * each `CHUNK_SIZE` bytes long. Additionally, it allocates the chunk metadata
- * storage region, `l1_chunk_meta`.
+ * storage regions, `l1_chunk_meta` and `l1_chunk_regions`.
  * 
  * If this function fails to allocate any of the required memory areas, it must
  *  exit with a status code of 1.
@@ -118,9 +133,9 @@ void l1_chunk_deinit(void);
 /**
  * @brief      Allocates a region of chunks
  * 
- * Searches in the arena for a contiguous sequence of chunks to store the
- * requested size, in addition to a chunk directly preceding that region, which
- * serves as a region header.
+ * Searches in the arena, from `l1_chunk_rover`, for a contiguous sequence of
+ * chunks to store the requested size, and records the region in
+ * `l1_chunk_regions`.
  * 
  * If the requested size is 0, the function must return a NULL pointer.
  * 
@@ -138,8 +153,10 @@ void *l1_chunk_malloc(size_t size);
  * @brief      Releases a region of chunks
  *
  * Returns all chunks in the provided region back to a "free" state. The
- * function must first verify that the provided pointer lies on valid chunk
- * boundaries, and that the region header chunk has valid magic values.
+ * function must first verify that the provided pointer lies on a chunk
+ * boundary within the arena, and that the entry of that chunk in
+ * `l1_chunk_regions` has valid magic values. The entry is then cleared, so
+ * freeing the region twice fails.
  * 
  * If the provided pointer is NULL, the function must return SUCCESS.
  * 
@@ -0,0 +1,184 @@
+/**
+ * @file preempt.c
+ * @brief Implementation of the timer-driven preemption.
+ *
+ * All scheduler code runs with `preempt_count` > 0. Every switch out of a
+ * green thread (yield or tick) saves the count on the thread's stack and
+ * raises it, the matching resume restores it, and a new thread starts at 0
+ * in l1_start. The count is therefore 0 exactly when a green thread runs
+ * its own code outside of a l1_preempt_disable section.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include "preempt.h"
+#include "schedule.h"
+
+static timer_t l1_preempt_timer;
+static struct sigaction l1_preempt_old_action;
+
+/* Tick: checks the slice of the running thread and preempts it if needed */
+static void l1_preempt_handler(int sig)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (scheduler == NULL)
+  {
+    return;
+  }
+  l1_thread_info *current = scheduler->current;
+  if (current == NULL || current == scheduler->tsys)
+  {
+    return;
+  }
+
+  l1_time now, ran;
+  l1_time_get(&now);
+  l1_time_diff(&ran, now, current->slice_start);
+  if (l1_time_is_smaller(ran, l1_priority_slice_size(current->priority_level)))
+  {
+    return;
+  }
+  scheduler->need_resched = 1;
+  if (scheduler->preempt_count != 0 || scheduler->preempt_mode != L1_PREEMPT_ASYNC)
+  {
+    return;
+  }
+
+  /* Same protocol as yield. SIGALRM stays blocked until the count is raised,
+   * then it is unblocked so the next thread can be preempted while this
+   * handler frame is parked on the current stack. Resuming returns from the
+   * handler, which restores the full interrupted context. */
+  scheduler->preempt_count = 1;
+  scheduler->preemptions++;
+  current->stats.preempted = true;
+  current->yield_target = -1;
+  sigset_t alarm;
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  sigprocmask(SIG_UNBLOCK, &alarm, NULL);
+  switch_asm((uint64_t *)scheduler->tsys->thread_stack->top,
+             (uint64_t **)&current->thread_stack->top);
+  get_scheduler()->preempt_count = 0;
+}
+
+unsigned l1_preempt_stack_capacity(void)
+{
+  unsigned long frame = 0;
+#ifdef AT_MINSIGSTKSZ
+  frame = getauxval(AT_MINSIGSTKSZ);
+#endif
+  if (frame < SIGSTKSZ)
+  {
+    frame = SIGSTKSZ;
+  }
+  return MAX_STACK_CAPACITY + (frame + L1_PREEMPT_HANDLER_BYTES) / sizeof(uint64_t);
+}
+
+/* Checks that every thread that may run again can take a signal frame */
+static int l1_preempt_stacks_fit(l1_thread_list *list, unsigned capacity)
+{
+  for (l1_thread_info *cur = list->head; cur != NULL; cur = cur->next)
+  {
+    /* Stackless tasks run on the stack of tsys */
+    if (cur->thread_stack != NULL && cur->thread_stack->capacity < capacity)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+l1_error l1_preempt_start(l1_preempt_mode mode)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  /* SIGALRM goes to any OS thread, so M:N mode stays cooperative */
+  if (scheduler == NULL || mode == L1_PREEMPT_OFF || scheduler->runtime != NULL)
+  {
+    return ERRINVAL;
+  }
+  l1_preempt_stop();
+
+  /* In both modes the handler runs on the stack of the interrupted thread */
+  unsigned capacity = l1_preempt_stack_capacity();
+  if (!l1_preempt_stacks_fit(&scheduler->thread_arrays[RUNNABLE], capacity) ||
+      !l1_preempt_stacks_fit(&scheduler->thread_arrays[BLOCKED], capacity))
+  {
+    fprintf(stderr, "Error: threads created before l1_preempt_start cannot take a signal\n");
+    return ERRINVAL;
+  }
+  if (scheduler->stack_capacity < capacity)
+  {
+    scheduler->stack_capacity = capacity;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = l1_preempt_handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGALRM, &action, &l1_preempt_old_action) != 0)
+  {
+    return ERRINVAL;
+  }
+
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = SIGALRM;
+  if (timer_create(CLOCK_MONOTONIC, &event, &l1_preempt_timer) != 0)
+  {
+    sigaction(SIGALRM, &l1_preempt_old_action, NULL);
+    return ERRINVAL;
+  }
+
+  struct itimerspec tick;
+  tick.it_interval.tv_sec = L1_PREEMPT_TICK_NS / L1_NSEC_PER_SEC;
+  tick.it_interval.tv_nsec = L1_PREEMPT_TICK_NS % L1_NSEC_PER_SEC;
+  tick.it_value = tick.it_interval;
+  scheduler->preempt_mode = mode;
+  if (timer_settime(l1_preempt_timer, 0, &tick, NULL) != 0)
+  {
+    l1_preempt_stop();
+    return ERRINVAL;
+  }
+  return SUCCESS;
+}
+
+void l1_preempt_stop(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (scheduler == NULL || scheduler->preempt_mode == L1_PREEMPT_OFF)
+  {
+    return;
+  }
+  timer_delete(l1_preempt_timer);
+  sigaction(SIGALRM, &l1_preempt_old_action, NULL);
+  scheduler->preempt_mode = L1_PREEMPT_OFF;
+  scheduler->need_resched = 0;
+}
+
+void l1_preempt_disable(void)
+{
+  get_scheduler()->preempt_count++;
+}
+
+void l1_preempt_enable(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  scheduler->preempt_count--;
+  l1_preempt_point();
+}
+
+void l1_preempt_point(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  /* tsys, e.g. main creating the first threads, never yields */
+  if (scheduler->need_resched && scheduler->preempt_count == 0 &&
+      scheduler->current != NULL && scheduler->current != scheduler->tsys)
+  {
+    scheduler->preemptions++;
+    scheduler->current->stats.preempted = true;
+    yield(-1);
+  }
+}
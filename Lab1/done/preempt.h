@@ -0,0 +1,74 @@
+/**
+ * @file preempt.h
+ * @brief Optional timer-driven preemption of green threads
+ */
+#pragma once
+#include "error.h"
+#include "l1_time.h"
+#include "priority.h"
+
+/* Period of the SIGALRM tick. A thread is preempted at the first tick after
+ * it has run for l1_priority_slice_size(priority_level) in its slice. */
+#ifdef USE_UNIX_TIME
+#define L1_PREEMPT_TICK_NS (MIN_SLICE * L1_NSEC_PER_SEC / 2)
+#else
+#define L1_PREEMPT_TICK_NS (MIN_SLICE / 2)
+#endif
+
+/* Room left for the thread itself on top of the signal frame, in bytes */
+#define L1_PREEMPT_HANDLER_BYTES 1024
+
+typedef enum {
+  L1_PREEMPT_OFF = 0, /* Cooperative scheduling only */
+  L1_PREEMPT_DEFERRED, /* The tick only requests a switch, honored at the
+                        * next safe point: l1_preempt_point, the end of a
+                        * l1_preempt_disable section or a runtime call */
+  L1_PREEMPT_ASYNC,    /* The tick switches to tsys from the signal handler,
+                        * unless preemption is disabled */
+} l1_preempt_mode;
+
+/**
+ * @brief Starts the per-process SIGALRM tick.
+ *
+ * Must be called after initialize_scheduler. In both modes the signal frame
+ * is pushed on the stack of the interrupted green thread, so the function
+ * raises the capacity of the stacks created afterwards, and fails if an
+ * existing thread has a stack too small to take a signal.
+ *
+ * Library code that is not async-signal-safe (malloc, stdio, ...) must be
+ * called between l1_preempt_disable and l1_preempt_enable in that mode,
+ * l1_malloc included.
+ *
+ * @return SUCCESS, or ERRINVAL if the timer could not be armed.
+ */
+l1_error l1_preempt_start(l1_preempt_mode mode);
+
+/**
+ * @brief Stops the tick and restores the previous SIGALRM disposition.
+ */
+void l1_preempt_stop(void);
+
+/**
+ * @brief Enters a section where the running green thread cannot be
+ * preempted. Sections nest.
+ */
+void l1_preempt_disable(void);
+
+/**
+ * @brief Leaves a l1_preempt_disable section, yielding if a tick asked for a
+ * switch in the meantime.
+ */
+void l1_preempt_enable(void);
+
+/**
+ * @brief Safe point: yields if a tick asked for a switch.
+ *
+ * Cheap enough to be called in the inner loop of CPU-bound threads that run
+ * in L1_PREEMPT_DEFERRED mode.
+ */
+void l1_preempt_point(void);
+
+/**
+ * @brief Returns the stack capacity, in words, needed to take a signal.
+ */
+unsigned l1_preempt_stack_capacity(void);
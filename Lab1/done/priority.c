@@ -8,12 +8,17 @@
 #include "priority.h"
 #include "l1_time.h"
 
+l1_priority_tunables l1_priority_params = {
+  .min_slice = MIN_SLICE,
+  .priority_threshold = TIME_PRIORITY_THRESHOLD,
+};
+
 l1_time l1_priority_slice_size(l1_priority val) {
   if (val < LOWEST_PRIORITY || val > TOP_PRIORITY) {
     fprintf(stderr, "Error: invalid priority value in l1_priority_slice_size\n");
     exit(-1);
   }
-  return MIN_SLICE * (TOP_PRIORITY - val + 1);
+  return l1_priority_params.min_slice * (TOP_PRIORITY - val + 1);
 }
 
 void l1_priority_decrease(l1_priority* p) {
@@ -18,11 +18,22 @@ typedef int l1_priority;
 /* Maximum total time you can run at certain priority */
 #define TIME_PRIORITY_THRESHOLD ((uint64_t)200)
 #else
-#define MIN_SLICE 1000
+/* Slice at TOP_PRIORITY, the slice at level p is MIN_SLICE * (TOP_PRIORITY - p + 1) */
+#define MIN_SLICE (1 * L1_NSEC_PER_MSEC)
 /* Maximum total time you can run at certain priority */
-#define TIME_PRIORITY_THRESHOLD ((uint64_t)1000000)
+#define TIME_PRIORITY_THRESHOLD ((uint64_t)20 * L1_NSEC_PER_MSEC)
 #endif
 
+/* Values in use of MIN_SLICE and TIME_PRIORITY_THRESHOLD, which default to
+ * the macros and can be tuned at run time, e.g. by parameter sweeps in the
+ * simulator (see sim.h) */
+typedef struct {
+  l1_time min_slice;
+  l1_time priority_threshold;
+} l1_priority_tunables;
+
+extern l1_priority_tunables l1_priority_params;
+
 /**
  * @brief Returns the value of a time slice at priority level val
  */
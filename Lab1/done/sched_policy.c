@@ -6,113 +6,197 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "sched_policy.h"
 #include "schedule.h"
 //========================================================================================
-/** Round robin just returns the oldest thread in RUNNABLE state */
-l1_thread_info *l1_round_robin_policy(l1_thread_info *prev, l1_thread_info *next)
+/** Allocate zeroed private data for the policy of the scheduler */
+static void *l1_policy_state_alloc(size_t size)
 {
-  if (next != NULL)
+  l1_scheduler_info *scheduler = get_scheduler();
+  scheduler->policy_state = calloc(1, size);
+  if (scheduler->policy_state == NULL)
   {
-    return next;
+    fprintf(stderr, "Error: unable to allocate the policy run queue\n");
+    exit(-1);
   }
+  return scheduler->policy_state;
+}
+//========================================================================================
+/** Shared destroy callback, all policy states are flat */
+static void l1_policy_state_free(void)
+{
   l1_scheduler_info *scheduler = get_scheduler();
-  return thread_list_rotate(&scheduler->thread_arrays[RUNNABLE]);
+  free(scheduler->policy_state);
+  scheduler->policy_state = NULL;
 }
 //========================================================================================
-/** Find thread with smallest total run time and return it. NULL if list is empty*/
-l1_thread_info *l1_find_smallest_cycle(l1_thread_list *list)
+/** Nothing to account for */
+static void l1_policy_no_tick(l1_thread_info *prev)
 {
-  if (list->head == NULL)
+}
+//========================================================================================
+/** Append thread to the fifo */
+static void l1_rq_fifo_push(l1_rq_fifo *fifo, l1_thread_info *thread)
+{
+  thread->rq_next = NULL;
+  thread->rq_prev = fifo->tail;
+  if (fifo->tail == NULL)
   {
-    return NULL;
+    fifo->head = thread;
   }
-
-  l1_thread_info *current = list->head;
-  l1_thread_info *smallest_cycles = current;
-  while (current->next != NULL)
+  else
   {
-    current = current->next;
-    if (l1_time_is_smaller(current->total_time, smallest_cycles->total_time))
-    {
-      smallest_cycles = current;
-    }
+    fifo->tail->rq_next = thread;
   }
-  return smallest_cycles;
+  fifo->tail = thread;
 }
 //========================================================================================
-/** Schedules the thread with the smallest amount of cycles so far */
-l1_thread_info *l1_smallest_cycles_policy(l1_thread_info *prev, l1_thread_info *next)
+/** Unlink thread from the fifo */
+static void l1_rq_fifo_unlink(l1_rq_fifo *fifo, l1_thread_info *thread)
 {
-  if (next != NULL)
+  if (thread->rq_prev == NULL)
   {
-    return next;
+    fifo->head = thread->rq_next;
   }
-
-  l1_scheduler_info *scheduler = get_scheduler();
-  return l1_find_smallest_cycle(&scheduler->thread_arrays[RUNNABLE]);
+  else
+  {
+    thread->rq_prev->rq_next = thread->rq_next;
+  }
+  if (thread->rq_next == NULL)
+  {
+    fifo->tail = thread->rq_prev;
+  }
+  else
+  {
+    thread->rq_next->rq_prev = thread->rq_prev;
+  }
+  thread->rq_prev = thread->rq_next = NULL;
 }
 //========================================================================================
-/**
- * Find next thread to run in RR and make sure it is at back of list before running
- * (To achieve Round Robin, need min at tail of list)
- */
-l1_thread_info *l1_mlfq_next_thread(l1_thread_list *list)
+/** Round robin just returns the oldest thread in RUNNABLE state */
+static void l1_rr_init(void)
 {
-  if (list == NULL)
-  {
-    return NULL;
-  }
+  l1_policy_state_alloc(sizeof(l1_rq_fifo));
+}
 
-  l1_thread_info *max = list->head;
-  l1_thread_info *current = list->head;
+static void l1_rr_enqueue(l1_thread_info *thread)
+{
+  l1_rq_fifo_push(get_scheduler()->policy_state, thread);
+}
 
-  const l1_thread_info *const tail = list->tail;
+static void l1_rr_dequeue(l1_thread_info *thread)
+{
+  l1_rq_fifo_unlink(get_scheduler()->policy_state, thread);
+}
 
-  //Search for min, until again in original disposition
-  while (current != tail)
+static l1_thread_info *l1_rr_pick_next(l1_thread_info *prev)
+{
+  l1_rq_fifo *fifo = get_scheduler()->policy_state;
+  l1_thread_info *next = fifo->head;
+  if (next != NULL)
   {
-    current = current->next;
-    if (current->priority_level > max->priority_level)
-    {
-      max = current;
-    }
+    l1_rq_fifo_unlink(fifo, next);
   }
-  //No need to set current at back: done in schedule after running
-  return max;
+  return next;
 }
+
+const sched_policy l1_round_robin_policy = {
+    .init = l1_rr_init,
+    .enqueue = l1_rr_enqueue,
+    .dequeue = l1_rr_dequeue,
+    .pick_next = l1_rr_pick_next,
+    .tick = l1_policy_no_tick,
+    .destroy = l1_policy_state_free,
+};
 //========================================================================================
-/** increase priority of threads that dit not run at their current priority */
-void l1_mlfq_boost(l1_thread_list *list)
+/** Smallest total_time first, enqueue order between equals */
+static bool l1_cycles_before(const l1_thread_info *a, const l1_thread_info *b)
 {
-  if (list == NULL)
-  {
-    return;
-  }
+  return l1_time_is_smaller(a->total_time, b->total_time) ||
+         (l1_time_are_equal(a->total_time, b->total_time) && a->rq_epoch < b->rq_epoch);
+}
+
+static void l1_cycles_init(void)
+{
+  l1_cycles_state *state = l1_policy_state_alloc(sizeof(l1_cycles_state));
+  thread_heap_init(&state->by_cycles, l1_cycles_before);
+}
+
+static void l1_cycles_enqueue(l1_thread_info *thread)
+{
+  l1_cycles_state *state = get_scheduler()->policy_state;
+  thread->rq_epoch = state->seq++;
+  thread_heap_insert(&state->by_cycles, thread);
+}
+
+static void l1_cycles_dequeue(l1_thread_info *thread)
+{
+  l1_cycles_state *state = get_scheduler()->policy_state;
+  thread_heap_remove(&state->by_cycles, thread);
+}
 
-  const l1_thread_info *const tail = list->tail;
-  l1_thread_info *current = list->head;
+/** Schedules the thread with the smallest amount of cycles so far */
+static l1_thread_info *l1_cycles_pick_next(l1_thread_info *prev)
+{
+  l1_cycles_state *state = get_scheduler()->policy_state;
+  return thread_heap_pop(&state->by_cycles);
+}
 
-  while (current != tail)
+const sched_policy l1_smallest_cycles_policy = {
+    .init = l1_cycles_init,
+    .enqueue = l1_cycles_enqueue,
+    .dequeue = l1_cycles_dequeue,
+    .pick_next = l1_cycles_pick_next,
+    .tick = l1_policy_no_tick,
+    .destroy = l1_policy_state_free,
+};
+//========================================================================================
+_Static_assert(TOP_PRIORITY < 32, "MLFQ level bitmap is 32 bits wide");
+
+/** Append thread to the FIFO of its priority level */
+static void l1_mlfq_push(l1_mlfq_state *state, l1_thread_info *thread)
+{
+  l1_rq_fifo_push(&state->levels[thread->priority_level], thread);
+  thread->rq_epoch = state->epoch;
+  state->non_empty |= 1u << thread->priority_level;
+}
+
+/** Unlink thread from the FIFO of its priority level */
+static void l1_mlfq_unlink(l1_mlfq_state *state, l1_thread_info *thread)
+{
+  l1_priority lvl = thread->priority_level;
+  l1_rq_fifo_unlink(&state->levels[lvl], thread);
+  if (state->levels[lvl].head == NULL)
   {
-    if (!current->got_scheduled)
-    {
-      l1_time_init(&current->total_time);
-      l1_priority_increase(&current->priority_level);
-    }
-    current = current->next;
+    state->non_empty &= ~(1u << lvl);
   }
 }
-//========================================================================================
-/** Schedules threads according to mlfq policy */
-l1_thread_info *l1_mlfq_policy(l1_thread_info *prev, l1_thread_info *next)
+
+static void l1_mlfq_init(void)
+{
+  l1_policy_state_alloc(sizeof(l1_mlfq_state));
+}
+
+static void l1_mlfq_enqueue(l1_thread_info *thread)
+{
+  l1_mlfq_push(get_scheduler()->policy_state, thread);
+}
+
+static void l1_mlfq_dequeue(l1_thread_info *thread)
+{
+  l1_mlfq_unlink(get_scheduler()->policy_state, thread);
+}
+
+/** Demote prev if it used its whole slice or ran too long at its level */
+static void l1_mlfq_tick(l1_thread_info *prev)
 {
   l1_scheduler_info *scheduler = get_scheduler();
-  l1_thread_list *runnable_list = &scheduler->thread_arrays[RUNNABLE];
-  //Boost threads that didn't run when SCHED_PERDIOD wraps (i.e ran SCHED_PERIOD threads)
+  l1_mlfq_state *state = scheduler->policy_state;
+  //A new epoch starts when SCHED_PERIOD wraps (i.e ran SCHED_PERIOD threads)
   if (scheduler->sched_ticks == 0)
   {
-    l1_mlfq_boost(runnable_list);
+    state->epoch++;
   }
 
   //Check whole time slice use
@@ -123,17 +207,361 @@ l1_thread_info *l1_mlfq_policy(l1_thread_info *prev, l1_thread_info *next)
       l1_priority_slice_size(prev->priority_level), curr_slice_time);
 
   //Check total run time use
-  const int above_threshold = l1_time_is_smaller(TIME_PRIORITY_THRESHOLD, prev->total_time);
+  const int above_threshold = l1_time_is_smaller(l1_priority_params.priority_threshold, prev->total_time);
 
   //Demote thread if needed, update total_time, got_scheduled, ...
+  //prev is not queued yet, so it will go last in its new level
   if (used_whole_slice || above_threshold)
   {
     l1_priority_decrease(&prev->priority_level);
     l1_time_init(&prev->total_time);
     prev->got_scheduled = 0;
   }
+}
 
-  //No need to change sched_ticks -> done in schedule
+/**
+ * Lazy boost: the head of a level is its longest waiter, so if it was queued
+ * before the current epoch, move it one level up. got_scheduled is reset at
+ * each epoch: a thread queued before the current epoch did not run in it,
+ * whether or not it ran at its priority before. Otherwise a head that ran
+ * once would never be boosted and would hold back every thread behind it.
+ * Bounded by the number of levels, whatever the number of threads.
+ */
+static void l1_mlfq_promote(l1_mlfq_state *state)
+{
+  uint32_t below_top = state->non_empty & ((1u << TOP_PRIORITY) - 1);
+  while (below_top != 0)
+  {
+    l1_priority lvl = __builtin_ctz(below_top);
+    below_top &= below_top - 1;
+
+    l1_thread_info *head = state->levels[lvl].head;
+    if (head->rq_epoch < state->epoch)
+    {
+      l1_mlfq_unlink(state, head);
+      head->got_scheduled = 0;
+      l1_time_init(&head->total_time);
+      l1_priority_increase(&head->priority_level);
+      l1_mlfq_push(state, head);
+    }
+  }
+}
+
+/** Schedules threads according to mlfq policy */
+static l1_thread_info *l1_mlfq_pick_next(l1_thread_info *prev)
+{
+  l1_mlfq_state *state = get_scheduler()->policy_state;
+  l1_mlfq_promote(state);
+
+  if (state->non_empty == 0)
+  {
+    return NULL;
+  }
   //No need to set got_schedule -> done in schedule
-  return l1_mlfq_next_thread(runnable_list);
-}
\ No newline at end of file
+  l1_thread_info *head = state->levels[31 - __builtin_clz(state->non_empty)].head;
+  l1_mlfq_unlink(state, head);
+  return head;
+}
+
+const sched_policy l1_mlfq_policy = {
+    .init = l1_mlfq_init,
+    .enqueue = l1_mlfq_enqueue,
+    .dequeue = l1_mlfq_dequeue,
+    .pick_next = l1_mlfq_pick_next,
+    .tick = l1_mlfq_tick,
+    .destroy = l1_policy_state_free,
+};
+//========================================================================================
+/* Same 1.25x step between levels as the nice levels of Linux CFS */
+static const uint64_t l1_fair_weights[TOP_PRIORITY + 1] = {
+    110, 137, 172, 215, 272, 335, 423, 526, 655, 820, FAIR_WEIGHT_NICE0};
+
+uint64_t l1_fair_weight(l1_priority val)
+{
+  if (val < LOWEST_PRIORITY || val > TOP_PRIORITY)
+  {
+    fprintf(stderr, "Error: invalid priority value in l1_fair_weight\n");
+    exit(-1);
+  }
+  return l1_fair_weights[val];
+}
+
+/** Smallest vruntime first, enqueue order between equals */
+static bool l1_fair_before(const l1_thread_info *a, const l1_thread_info *b)
+{
+  return a->vruntime < b->vruntime ||
+         (a->vruntime == b->vruntime && a->rq_epoch < b->rq_epoch);
+}
+
+static void l1_fair_init(void)
+{
+  l1_fair_state *state = l1_policy_state_alloc(sizeof(l1_fair_state));
+  thread_heap_init(&state->timeline, l1_fair_before);
+}
+
+static void l1_fair_enqueue(l1_thread_info *thread)
+{
+  l1_fair_state *state = get_scheduler()->policy_state;
+  /* Sleeper clamp, a no-op for the thread that just ran */
+  uint64_t floor = state->min_vruntime > FAIR_WAKEUP_CREDIT ? state->min_vruntime - FAIR_WAKEUP_CREDIT : 0;
+  if (thread->vruntime < floor)
+  {
+    thread->vruntime = floor;
+  }
+  thread->rq_epoch = state->seq++;
+  thread_heap_insert(&state->timeline, thread);
+}
+
+static void l1_fair_dequeue(l1_thread_info *thread)
+{
+  l1_fair_state *state = get_scheduler()->policy_state;
+  thread_heap_remove(&state->timeline, thread);
+}
+
+/** Charge prev for its last slice */
+static void l1_fair_tick(l1_thread_info *prev)
+{
+  if (prev->state == SYSTHREAD)
+  {
+    return;
+  }
+  l1_time slice;
+  l1_time_diff(&slice, prev->slice_end, prev->slice_start);
+  prev->vruntime += (uint64_t)slice * FAIR_WEIGHT_NICE0 / l1_fair_weight(prev->priority_level);
+}
+
+/** Schedules the thread with the smallest weighted virtual runtime */
+static l1_thread_info *l1_fair_pick_next(l1_thread_info *prev)
+{
+  l1_fair_state *state = get_scheduler()->policy_state;
+  l1_thread_info *next = thread_heap_pop(&state->timeline);
+  if (next != NULL && next->vruntime > state->min_vruntime)
+  {
+    state->min_vruntime = next->vruntime;
+  }
+  return next;
+}
+
+const sched_policy l1_fair_share_policy = {
+    .init = l1_fair_init,
+    .enqueue = l1_fair_enqueue,
+    .dequeue = l1_fair_dequeue,
+    .pick_next = l1_fair_pick_next,
+    .tick = l1_fair_tick,
+    .destroy = l1_policy_state_free,
+};
+//========================================================================================
+/** Earliest deadline first, enqueue order between equals */
+static bool l1_edf_before(const l1_thread_info *a, const l1_thread_info *b)
+{
+  return l1_time_is_smaller(a->deadline, b->deadline) ||
+         (l1_time_are_equal(a->deadline, b->deadline) && a->rq_epoch < b->rq_epoch);
+}
+
+static void l1_edf_init(void)
+{
+  l1_edf_state *state = l1_policy_state_alloc(sizeof(l1_edf_state));
+  thread_heap_init(&state->by_deadline, l1_edf_before);
+}
+
+/* The deadline of a thread only changes while it runs, so it tells which
+ * queue holds a RUNNABLE thread */
+static void l1_edf_enqueue(l1_thread_info *thread)
+{
+  l1_edf_state *state = get_scheduler()->policy_state;
+  if (l1_time_are_equal(thread->deadline, 0))
+  {
+    l1_rq_fifo_push(&state->background, thread);
+  }
+  else
+  {
+    thread->rq_epoch = state->seq++;
+    thread_heap_insert(&state->by_deadline, thread);
+  }
+}
+
+static void l1_edf_dequeue(l1_thread_info *thread)
+{
+  l1_edf_state *state = get_scheduler()->policy_state;
+  if (l1_time_are_equal(thread->deadline, 0))
+  {
+    l1_rq_fifo_unlink(&state->background, thread);
+  }
+  else
+  {
+    thread_heap_remove(&state->by_deadline, thread);
+  }
+}
+
+/** Schedules the thread with the earliest deadline, else the background */
+static l1_thread_info *l1_edf_pick_next(l1_thread_info *prev)
+{
+  l1_edf_state *state = get_scheduler()->policy_state;
+  l1_thread_info *next = thread_heap_pop(&state->by_deadline);
+  if (next == NULL)
+  {
+    next = state->background.head;
+    if (next != NULL)
+    {
+      l1_rq_fifo_unlink(&state->background, next);
+    }
+  }
+  return next;
+}
+
+const sched_policy l1_edf_policy = {
+    .init = l1_edf_init,
+    .enqueue = l1_edf_enqueue,
+    .dequeue = l1_edf_dequeue,
+    .pick_next = l1_edf_pick_next,
+    .tick = l1_policy_no_tick,
+    .destroy = l1_policy_state_free,
+};
+//========================================================================================
+/* Like the real-time throttling of Linux, realtime threads leave 5% of the
+ * processor to the others */
+l1_sched_class_tunables l1_sched_class_params[L1_SCHED_CLASSES] = {
+    [L1_CLASS_REALTIME] = {&l1_edf_policy, 95},
+    [L1_CLASS_INTERACTIVE] = {&l1_mlfq_policy, 100},
+    [L1_CLASS_BATCH] = {&l1_fair_share_policy, 100},
+};
+
+/* Strict priority between the classes */
+static const l1_sched_class l1_class_order[L1_SCHED_CLASSES] = {
+    L1_CLASS_REALTIME, L1_CLASS_INTERACTIVE, L1_CLASS_BATCH};
+
+/** Hands the policy_state of the scheduler to class cls, returns the state
+ * of the classes */
+static l1_class_state *l1_class_enter(l1_sched_class cls)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_class_state *state = scheduler->policy_state;
+  scheduler->policy_state = state->states[cls];
+  return state;
+}
+
+/** Takes the policy_state back from class cls */
+static void l1_class_leave(l1_class_state *state, l1_sched_class cls)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  state->states[cls] = scheduler->policy_state;
+  scheduler->policy_state = state;
+}
+
+static void l1_class_init(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  void *states[L1_SCHED_CLASSES];
+  for (int cls = 0; cls < L1_SCHED_CLASSES; cls++)
+  {
+    const sched_policy *policy = l1_sched_class_params[cls].policy;
+    if (policy == NULL || policy == &l1_class_policy || policy->dequeue == NULL)
+    {
+      fprintf(stderr, "Error: invalid policy for a scheduling class\n");
+      exit(-1);
+    }
+    policy->init();
+    states[cls] = scheduler->policy_state;
+  }
+  l1_class_state *state = l1_policy_state_alloc(sizeof(l1_class_state));
+  memcpy(state->params, l1_sched_class_params, sizeof(state->params));
+  memcpy(state->states, states, sizeof(states));
+}
+
+static void l1_class_enqueue(l1_thread_info *thread)
+{
+  l1_sched_class cls = thread->sched_class;
+  l1_class_state *state = l1_class_enter(cls);
+  state->params[cls].policy->enqueue(thread);
+  l1_class_leave(state, cls);
+  state->runnable[cls]++;
+}
+
+static void l1_class_dequeue(l1_thread_info *thread)
+{
+  l1_sched_class cls = thread->sched_class;
+  l1_class_state *state = l1_class_enter(cls);
+  state->params[cls].policy->dequeue(thread);
+  l1_class_leave(state, cls);
+  state->runnable[cls]--;
+}
+
+/** Charge the class of prev for its slice, and let every class tick */
+static void l1_class_tick(l1_thread_info *prev)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_class_state *state = scheduler->policy_state;
+  l1_time elapsed;
+  l1_time_diff(&elapsed, prev->slice_end, state->period_start);
+  if (!l1_time_is_smaller(elapsed, L1_CLASS_PERIOD))
+  {
+    memset(state->used, 0, sizeof(state->used));
+    state->period_start = prev->slice_end;
+  }
+  if (prev != scheduler->tsys)
+  {
+    l1_time slice;
+    l1_time_diff(&slice, prev->slice_end, prev->slice_start);
+    l1_time_add(&state->used[prev->sched_class], slice);
+  }
+  for (int cls = 0; cls < L1_SCHED_CLASSES; cls++)
+  {
+    l1_class_enter(cls);
+    state->params[cls].policy->tick((cls == prev->sched_class) ? prev : scheduler->tsys);
+    l1_class_leave(state, cls);
+  }
+}
+
+/** The class used its share of the period */
+static bool l1_class_throttled(l1_class_state *state, l1_sched_class cls)
+{
+  return state->params[cls].cap < 100 &&
+         state->used[cls] * 100 >= (l1_time)state->params[cls].cap * L1_CLASS_PERIOD;
+}
+
+/** Picks from the first class with a RUNNABLE thread, skipping the
+ * throttled classes unless they are the only ones left */
+static l1_thread_info *l1_class_pick_next(l1_thread_info *prev)
+{
+  l1_class_state *state = get_scheduler()->policy_state;
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (int i = 0; i < L1_SCHED_CLASSES; i++)
+    {
+      l1_sched_class cls = l1_class_order[i];
+      if (state->runnable[cls] == 0 || (pass == 0 && l1_class_throttled(state, cls)))
+      {
+        continue;
+      }
+      l1_class_enter(cls);
+      l1_thread_info *next = state->params[cls].policy->pick_next(prev);
+      l1_class_leave(state, cls);
+      if (next != NULL)
+      {
+        state->runnable[cls]--;
+        return next;
+      }
+    }
+  }
+  return NULL;
+}
+
+static void l1_class_destroy(void)
+{
+  for (int cls = 0; cls < L1_SCHED_CLASSES; cls++)
+  {
+    l1_class_state *state = l1_class_enter(cls);
+    state->params[cls].policy->destroy();
+    l1_class_leave(state, cls);
+  }
+  l1_policy_state_free();
+}
+
+const sched_policy l1_class_policy = {
+    .init = l1_class_init,
+    .enqueue = l1_class_enqueue,
+    .dequeue = l1_class_dequeue,
+    .pick_next = l1_class_pick_next,
+    .tick = l1_class_tick,
+    .destroy = l1_class_destroy,
+};
@@ -6,8 +6,113 @@
  */
 #pragma once
 #include "thread_info.h"
+#include "thread_heap.h"
+#include "schedule.h"
 
-l1_thread_info* l1_round_robin_policy(l1_thread_info* prev, l1_thread_info* next);
-l1_thread_info* l1_smallest_cycles_policy(l1_thread_info* prev, l1_thread_info* next);
+/* Every policy is a `sched_policy` object (see schedule.h) keeping its own
+ * run queue in the scheduler's `policy_state`. */
 
-l1_thread_info* l1_mlfq_policy(l1_thread_info* prev, l1_thread_info* next);
+/* FIFO of threads linked through rq_prev/rq_next */
+typedef struct {
+  l1_thread_info* head;
+  l1_thread_info* tail;
+} l1_rq_fifo;
+
+/* Round robin: a single FIFO */
+extern const sched_policy l1_round_robin_policy;
+
+/* Smallest cycles: a heap ordered by total_time */
+typedef struct {
+  l1_thread_heap by_cycles; /* RUNNABLE threads by (total_time, seq) */
+  uint64_t seq;             /* Enqueue counter, keeps ties FIFO */
+} l1_cycles_state;
+
+extern const sched_policy l1_smallest_cycles_policy;
+
+/* MLFQ keeps one FIFO per priority level and a bitmap of the non-empty
+ * levels, so picking the next thread is a find-last-set plus a pop.
+ * Instead of walking every thread each SCHED_PERIOD ticks, the period only
+ * bumps an epoch: a thread waiting at the head of its level since an older
+ * epoch is promoted one level when the next pick happens, even if it ran at
+ * its level before that epoch. */
+typedef struct {
+  l1_rq_fifo levels[TOP_PRIORITY + 1];
+  uint32_t non_empty; /* Bit i is set iff levels[i] holds a thread */
+  uint64_t epoch;     /* Number of SCHED_PERIOD wraps so far */
+} l1_mlfq_state;
+
+extern const sched_policy l1_mlfq_policy;
+
+/* Fair share keeps RUNNABLE threads in a pairing heap ordered by weighted
+ * virtual runtime, so picking is O(log n) instead of the linear scan of
+ * smallest cycles, which it supersedes. A thread running for d time units
+ * at priority p is charged d * FAIR_WEIGHT_NICE0 / weight(p).
+ * Threads waking up (or created) are placed no lower than
+ * min_vruntime - FAIR_WAKEUP_CREDIT, so a long sleeper gets a small bonus
+ * but cannot monopolize the processor. */
+#define FAIR_WEIGHT_NICE0 1024
+#define FAIR_WAKEUP_CREDIT ((uint64_t)MIN_SLICE)
+
+typedef struct {
+  l1_thread_heap timeline; /* RUNNABLE threads by (vruntime, seq) */
+  uint64_t min_vruntime;   /* Monotonic floor of the vruntimes */
+  uint64_t seq;            /* Enqueue counter, keeps ties FIFO */
+} l1_fair_state;
+
+extern const sched_policy l1_fair_share_policy;
+
+/**
+ * @brief Returns the load weight of priority level val
+ */
+uint64_t l1_fair_weight(l1_priority val);
+
+/* Earliest deadline first: threads with a deadline (see
+ * l1_thread_set_deadline) run by increasing deadline, from a heap. The
+ * others form a background class scheduled round robin, only when no thread
+ * with a deadline is RUNNABLE. A late thread keeps its place, so an
+ * overloaded scheduler misses deadlines in cascade, and a thread with a
+ * deadline that never blocks starves the background class. */
+typedef struct {
+  l1_thread_heap by_deadline; /* RUNNABLE threads with a deadline by (deadline, seq) */
+  l1_rq_fifo background;      /* RUNNABLE threads without one */
+  uint64_t seq;               /* Enqueue counter, keeps ties FIFO */
+} l1_edf_state;
+
+extern const sched_policy l1_edf_policy;
+
+/* Scheduling classes stack policies: every class (see l1_sched_class, set
+ * with l1_thread_attr.sched_class) has its own run queue ordered by its own
+ * policy, and the classes run in strict priority, realtime first, so a
+ * batch class of any size does not delay the others.
+ *
+ * A class may also be capped to a share of every L1_CLASS_PERIOD. A class
+ * that used its share only runs when no uncapped class has a RUNNABLE
+ * thread, so the caps never leave the processor idle. A class policy runs
+ * unchanged: the hooks swap the scheduler's policy_state to the state of
+ * the class around each call. The classes other than the one of the
+ * thread being charged get a tick of tsys, which keeps their periodic work
+ * (the MLFQ epochs) going.
+ *
+ * l1_sched_class_params is read when the scheduler is initialized. */
+#ifdef USE_UNIX_TIME
+#define L1_CLASS_PERIOD 1
+#else
+#define L1_CLASS_PERIOD (100 * L1_NSEC_PER_MSEC)
+#endif
+
+typedef struct {
+  const sched_policy *policy; /* Orders the run queue of the class */
+  unsigned cap;               /* Percentage of L1_CLASS_PERIOD, 100 for no cap */
+} l1_sched_class_tunables;
+
+extern l1_sched_class_tunables l1_sched_class_params[L1_SCHED_CLASSES];
+
+typedef struct {
+  l1_sched_class_tunables params[L1_SCHED_CLASSES];
+  void *states[L1_SCHED_CLASSES];   /* policy_state of every class */
+  size_t runnable[L1_SCHED_CLASSES];
+  l1_time used[L1_SCHED_CLASSES];   /* Run time in the current period */
+  l1_time period_start;
+} l1_class_state;
+
+extern const sched_policy l1_class_policy;
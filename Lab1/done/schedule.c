@@ -4,17 +4,25 @@
  *
  * @author Mark Sutherland
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "schedule.h"
 #include "stack.h"
+#include "stack_usage.h"
 #include "thread.h"
 #include "l1_time.h"
+#include "event_loop.h"
+#include "preempt.h"
+#include "task_group.h"
+#include "trace.h"
+#include "worker.h"
 
-l1_scheduler_info *scheduler = NULL;
+/* One scheduler per OS thread, i.e. per worker in M:N mode */
+__thread l1_scheduler_info *scheduler = NULL;
 
-void initialize_scheduler(sched_policy policy)
+void initialize_scheduler(const sched_policy *policy)
 {
   scheduler = (l1_scheduler_info *)malloc(sizeof(l1_scheduler_info));
   if (!scheduler)
@@ -26,6 +34,7 @@ void initialize_scheduler(sched_policy policy)
   /* Initialize scheduler */
   memset(scheduler, 0, sizeof(l1_scheduler_info));
   scheduler->next_tid = 0;
+  scheduler->thread_arrays = scheduler->local_arrays;
 
   /* Create tsys */
   scheduler->tsys = malloc(sizeof(l1_thread_info));
@@ -40,8 +49,14 @@ void initialize_scheduler(sched_policy policy)
   scheduler->current = scheduler->tsys;
   scheduler->tsys->yield_target = -1;
   scheduler->tsys->thread_stack = malloc(sizeof(l1_stack));
-  scheduler->select_next = policy;
+  scheduler->policy = policy;
   scheduler->sched_ticks = 0;
+  scheduler->stack_capacity = MAX_STACK_CAPACITY;
+  scheduler->policy->init();
+  l1_time_calibrate();
+  l1_time now;
+  l1_time_get(&now);
+  timer_wheel_init(&scheduler->timers, now);
 }
 
 void clean_up_scheduler()
@@ -50,6 +65,24 @@ void clean_up_scheduler()
   {
     return;
   }
+  l1_preempt_stop();
+  l1_event_loop_destroy();
+  /* Free the policy's private data */
+  scheduler->policy->destroy();
+  l1_thread_info *cached;
+  while ((cached = thread_list_pop(&scheduler->thread_cache)) != NULL)
+  {
+    l1_stack_free(cached->thread_stack);
+    free(cached);
+  }
+  while ((cached = thread_list_pop(&scheduler->task_cache)) != NULL)
+  {
+    free(cached);
+  }
+  while (scheduler->stack_cache_size > 0)
+  {
+    l1_stack_free(scheduler->stack_cache[--scheduler->stack_cache_size]);
+  }
   /* Free system thread */
   if (scheduler->tsys)
   {
@@ -61,14 +94,66 @@ void clean_up_scheduler()
   scheduler = NULL;
 }
 
-l1_scheduler_info *get_scheduler()
+/* A green thread may resume on another worker, so the address of the
+ * thread local must be computed anew by every call: neither inlined into
+ * the caller nor treated as a pure function whose result can be reused */
+__attribute__((noinline)) l1_scheduler_info *get_scheduler()
 {
+  asm volatile("" ::: "memory");
   return scheduler;
 }
 
+void lists_lock(void)
+{
+  if (scheduler->runtime != NULL)
+  {
+    pthread_mutex_lock(&scheduler->runtime->lock);
+  }
+}
+
+void lists_unlock(void)
+{
+  if (scheduler->runtime != NULL)
+  {
+    pthread_mutex_unlock(&scheduler->runtime->lock);
+  }
+}
+
+static bool runnable_is_empty(void)
+{
+  lists_lock();
+  bool empty = thread_list_is_empty(&scheduler->thread_arrays[RUNNABLE]);
+  lists_unlock();
+  return empty;
+}
+
 l1_tid get_uniq_tid()
 {
-  return scheduler->next_tid++;
+  return get_uniq_tids(1);
+}
+
+l1_tid get_uniq_tids(size_t count)
+{
+  l1_tid tid;
+  if (scheduler->runtime != NULL)
+  {
+    lists_lock();
+    tid = scheduler->runtime->next_tid;
+    scheduler->runtime->next_tid += count;
+    lists_unlock();
+    return tid;
+  }
+  tid = scheduler->next_tid;
+  scheduler->next_tid += count;
+  return tid;
+}
+
+/* Add to RUNNABLE and let the policy index the thread in its run queue.
+ * Called with the lists locked */
+static void runnable_add(l1_thread_info *thread)
+{
+  thread_list_add(&scheduler->thread_arrays[RUNNABLE], thread);
+  scheduler->policy->enqueue(thread);
 }
 
 /* Put yourself on the tail of the associated scheduler queue*/
@@ -81,7 +166,118 @@ void add_to_scheduler(l1_thread_info *thread, l1_thread_state state)
   }
   thread->prev = thread->next = NULL;
   thread->state = state;
-  thread_list_add(&scheduler->thread_arrays[state], thread);
+  lists_lock();
+  if (state == RUNNABLE)
+  {
+    runnable_add(thread);
+  }
+  else
+  {
+    thread_list_add(&scheduler->thread_arrays[state], thread);
+  }
+  lists_unlock();
+}
+
+void add_batch_to_scheduler(l1_thread_info *head, l1_thread_info *tail, size_t count)
+{
+  lists_lock();
+  thread_list_splice(&scheduler->thread_arrays[RUNNABLE], head, tail, count);
+  /* The policies index every thread */
+  for (l1_thread_info *thread = head; thread != NULL; thread = thread->next)
+  {
+    thread->state = RUNNABLE;
+    scheduler->policy->enqueue(thread);
+  }
+  lists_unlock();
+}
+
+//========================================================================================
+/* Statistics, see stats.h. A RUNNABLE or BLOCKED period starts at stats.since */
+
+static void stats_switch_out(l1_thread_info *thread, l1_time slice, l1_time now)
+{
+  l1_histogram_record(&scheduler->stats.slice_length, (uint64_t)slice);
+  if (thread->stats.preempted)
+  {
+    thread->stats.involuntary++;
+    thread->stats.preempted = false;
+  }
+  else
+  {
+    thread->stats.voluntary++;
+  }
+  thread->stats.since = now;
+  /* It returned */
+  if (thread->state == ZOMBIE || thread->state == DEAD)
+  {
+    l1_stats_retire_deadline(thread, now);
+    L1_STACK_RECORD(thread);
+  }
+}
+
+static void stats_switch_in(l1_thread_info *thread, l1_time now)
+{
+  l1_time wait;
+  l1_time_diff(&wait, now, thread->stats.since);
+  l1_time_add(&thread->stats.wait_time, wait);
+  l1_histogram_record(&scheduler->stats.runq_latency, (uint64_t)wait);
+  thread->stats.switches++;
+  scheduler->stats.switches++;
+}
+
+/* The thread leaves BLOCKED for RUNNABLE */
+static void stats_wake(l1_thread_info *thread)
+{
+  l1_time now, blocked;
+  l1_time_get(&now);
+  l1_time_diff(&blocked, now, thread->stats.since);
+  l1_time_add(&thread->stats.blocked_time, blocked);
+  thread->stats.since = now;
+}
+//========================================================================================
+/* Makes the threads whose timer expired RUNNABLE */
+static void expire_timers(l1_time now)
+{
+  l1_timer *timer = timer_wheel_expire(&scheduler->timers, now);
+  while (timer != NULL)
+  {
+    l1_timer *next = timer->next;
+    l1_thread_info *thread = (l1_thread_info *)((char *)timer - offsetof(l1_thread_info, timer));
+    wake_thread(thread, (thread->wait_reason == L1_WAIT_JOIN) ? ERRTIMEDOUT : SUCCESS);
+    timer = next;
+  }
+}
+
+/* Threads that will become RUNNABLE without another thread running */
+static bool has_waiters(void)
+{
+  return l1_event_loop_has_waiters() || !timer_wheel_is_empty(&scheduler->timers);
+}
+
+/* Wakes the threads of l1_yield_for, as nothing else is runnable */
+static void wake_timed_yielders(void)
+{
+  l1_thread_info *blocked = scheduler->thread_arrays[BLOCKED].head;
+  while (blocked != NULL && scheduler->timed_yielders > 0)
+  {
+    l1_thread_info *next = blocked->next;
+    if (blocked->wait_reason == L1_WAIT_YIELD)
+    {
+      wake_thread(blocked, SUCCESS);
+    }
+    blocked = next;
+  }
+}
+
+/* Runs a stackless task to completion on the stack of tsys. It runs as
+ * tsys, then shows up as current at the next tick, DEAD like a detached
+ * thread that returned. */
+static void run_task(l1_thread_info *task)
+{
+  scheduler->current = scheduler->tsys;
+  task->retval = task->thread_func(task->thread_func_args);
+  scheduler->current = task;
+  task->state = DEAD;
 }
 
 /**
@@ -89,7 +285,9 @@ void add_to_scheduler(l1_thread_info *thread, l1_thread_state state)
  */
 void schedule()
 {
-  while (!thread_list_is_empty(&scheduler->thread_arrays[RUNNABLE]))
+  /* tsys is never preempted */
+  scheduler->preempt_count = 1;
+  while (!runnable_is_empty() || has_waiters())
   {
     if (scheduler == NULL || scheduler->current == NULL)
     {
@@ -111,20 +309,34 @@ void schedule()
     l1_thread_info *next = NULL;
     l1_tid target = scheduler->current->yield_target;
 
-    /*Timestamp the end of slice*/
-    l1_time_get(&current->slice_end);
+    /*Timestamp the end of slice, the same read starts the next slice*/
+    l1_time now;
+    l1_time_get(&now);
+    current->slice_end = now;
     l1_time diff;
     l1_time_diff(&diff, current->slice_end, current->slice_start);
     l1_time_add(&current->total_time, diff);
 
+    if (current != scheduler->tsys)
+    {
+      L1_TRACE_EVENT(L1_TRACE_SWITCH_OUT, current, current->state);
+      stats_switch_out(current, diff, now);
+    }
+
     /* Enforce non-global state */
     scheduler->current = NULL;
     current->errno = SUCCESS;
 
+    /* Let the policy account for the slice before requeueing */
+    scheduler->policy->tick(current);
+
+    /* Once requeued or unlocked, current may already run on another
+     * worker in M:N mode, so it must not be read past this point */
+    bool dead = false;
     if (current->state == RUNNING)
     {
       current->state = RUNNABLE;
-      if (target != -1)
+      if (target != -1 && scheduler->policy->dequeue != NULL)
       {
         next = thread_list_find(&scheduler->thread_arrays[RUNNABLE], target);
         if (next == NULL)
@@ -132,26 +344,68 @@ void schedule()
           current->errno = ERRINVAL;
         }
       }
-      /* fake rotate the list. */
-      thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
-      thread_list_add(&scheduler->thread_arrays[RUNNABLE], current);
+      scheduler->policy->enqueue(current);
+    }
+    /* A detached thread returned, nobody will join it */
+    else if (current->state == DEAD)
+    {
+      lists_lock();
+      /* A task of a group is collected by the group */
+      if (!l1_task_group_complete(current))
+      {
+        thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
+        dead = true;
+      }
+      lists_unlock();
     }
-
     /* The thread is blocking */
-    if (current != scheduler->tsys &&
-        (current->state == BLOCKED || current->state == ZOMBIE))
+    else if (current != scheduler->tsys &&
+             (current->state == BLOCKED || current->state == ZOMBIE))
     {
+      lists_lock();
       handle_non_runnable(current);
+      dead = (current->state == DEAD);
+      lists_unlock();
     }
 
-    /* Give a chance to the scheduling algorithm to bypass yield*/
-    next = scheduler->select_next(current, next);
+    /* Batch the timers due by now, then the ready I/O once in a while */
+    expire_timers(now);
+    if (scheduler->sched_ticks == 0)
+    {
+      l1_event_loop_poll(false);
+    }
+
+    /* Directed yields bypass the policy */
+    if (next != NULL)
+    {
+      scheduler->policy->dequeue(next);
+    }
+    else
+    {
+      next = scheduler->policy->pick_next(current);
+    }
+
+    /* Nothing runnable, cut the timed yields short or sleep until I/O,
+     * the next timer or a notifier */
+    while (next == NULL && has_waiters())
+    {
+      if (scheduler->timed_yielders > 0)
+      {
+        wake_timed_yielders();
+      }
+      else
+      {
+        l1_event_loop_poll(true);
+        l1_time_get(&now);
+        expire_timers(now);
+      }
+      next = scheduler->policy->pick_next(current);
+    }
 
     /* Now it is safe to free the thread if it is dead */
-    if (current->state == DEAD)
+    if (dead)
     {
-      l1_stack_free(current->thread_stack);
-      free(current);
+      release_thread(current);
       current = NULL;
     }
 
@@ -163,14 +417,30 @@ void schedule()
     scheduler->current = next;
     next->state = RUNNING;
     next->got_scheduled = 1;
-    /*Make the thread the head of the list*/
-    thread_list_remove(&scheduler->thread_arrays[RUNNABLE], next);
-    thread_list_prepend(&scheduler->thread_arrays[RUNNABLE], next);
     l1_time_init(&next->slice_end);
-    l1_time_get(&next->slice_start);
+    next->slice_start = now;
+    stats_switch_in(next, now);
+    scheduler->need_resched = 0;
+    L1_TRACE_EVENT(L1_TRACE_SWITCH_IN, next, 0);
+    if (next->thread_stack == NULL)
+    {
+      run_task(next);
+      continue;
+    }
+    /* A thread of l1_thread_create_many that never ran */
+    if (next->thread_stack->size == 0)
+    {
+      l1_thread_prepare_stack(next->thread_stack);
+    }
     switch_asm((uint64_t *)next->thread_stack->top, (uint64_t **)&scheduler->tsys->thread_stack->top);
   }
-  printf("Program terminating!\n");
+  /* Back on tsys, schedule() may be called again */
+  scheduler->current = scheduler->tsys;
+  scheduler->preempt_count = 0;
+  if (scheduler->worker_id == 0)
+  {
+    fprintf(stderr, "Program terminating!\n");
+  }
 }
 
 void handle_non_runnable(l1_thread_info *current)
@@ -186,9 +456,49 @@ void handle_non_runnable(l1_thread_info *current)
     exit(-1);
   }
 
+  if (current->state == ZOMBIE)
+  {
+    L1_TRACE_EVENT(L1_TRACE_ZOMBIE, current, 0);
+  }
+
+  /* Children of a task group skip the ZOMBIE list */
+  if (current->state == ZOMBIE && l1_task_group_complete(current))
+  {
+    return;
+  }
+
+  /* Detached while it was returning */
+  if (current->state == ZOMBIE && current->detached)
+  {
+    thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
+    current->state = DEAD;
+    return;
+  }
+
+  /* Woken up on another worker before we could park it */
+  if (current->state == BLOCKED && current->wake_pending)
+  {
+    current->wake_pending = false;
+    current->state = RUNNABLE;
+    current->wait_reason = L1_WAIT_JOIN;
+    scheduler->policy->enqueue(current);
+    return;
+  }
+
   /* Move the thread to the appropriate list */
   thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
   thread_list_add(&scheduler->thread_arrays[current->state], current);
+  current->parked = (current->state == BLOCKED);
+  if (current->parked)
+  {
+    L1_TRACE_EVENT(L1_TRACE_BLOCK, current, current->wait_reason);
+  }
+
+  /* The event loop wakes the other waits up */
+  if (current->state == BLOCKED && current->wait_reason != L1_WAIT_JOIN)
+  {
+    return;
+  }
 
   /* Thread called join */
   if (current->state == BLOCKED)
@@ -206,16 +516,17 @@ void handle_non_runnable(l1_thread_info *current)
     if (joined != NULL)
     {
       unblock_thread(current, joined);
+      /* The zombie does not run, only current is freed by schedule */
+      release_thread(joined);
       return;
     }
     joined = thread_list_find(&scheduler->thread_arrays[BLOCKED], target);
-    if (joined != NULL)
+    if (joined == NULL)
     {
-      return;
+      joined = thread_list_find(&scheduler->thread_arrays[RUNNABLE], target);
     }
-
-    joined = thread_list_find(&scheduler->thread_arrays[RUNNABLE], target);
-    if (joined != NULL)
+    /* Detached threads and task group children cannot be joined */
+    if (joined != NULL && !joined->detached && joined->group == NULL)
     {
       return;
     }
@@ -264,6 +575,10 @@ void unblock_thread(l1_thread_info *blocked, l1_thread_info *zombie)
     fprintf(stderr, "Error: unblock_thread zombie thread invalid state\n");
     exit(-1);
   }
+  timer_wheel_cancel(&scheduler->timers, &blocked->timer);
+  blocked->parked = false;
+  L1_TRACE_EVENT(L1_TRACE_UNBLOCK, blocked, zombie != NULL ? SUCCESS : ERRINVAL);
+  stats_wake(blocked);
   /* Spurious wake up */
   if (!zombie)
   {
@@ -271,7 +586,7 @@ void unblock_thread(l1_thread_info *blocked, l1_thread_info *zombie)
     blocked->errno = ERRINVAL;
     blocked->joined_target = -1;
     thread_list_remove(&scheduler->thread_arrays[BLOCKED], blocked);
-    thread_list_add(&scheduler->thread_arrays[RUNNABLE], blocked);
+    runnable_add(blocked);
     return;
   }
 
@@ -283,21 +598,170 @@ void unblock_thread(l1_thread_info *blocked, l1_thread_info *zombie)
   blocked->errno = SUCCESS;
   blocked->joined_target = -1;
   thread_list_remove(&scheduler->thread_arrays[BLOCKED], blocked);
-  thread_list_add(&scheduler->thread_arrays[RUNNABLE], blocked);
+  runnable_add(blocked);
   thread_list_remove(&scheduler->thread_arrays[ZOMBIE], zombie);
   /* Mark as dead to free it in schedule */
   zombie->state = DEAD;
 }
 
+void release_thread(l1_thread_info *thread)
+{
+  l1_preempt_disable();
+  L1_TRACE_EVENT(L1_TRACE_DEAD, thread, 0);
+  if (thread->batch != NULL)
+  {
+    /* The last thread may be released by another worker in M:N mode */
+    if (__atomic_sub_fetch(&thread->batch->live, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      free(thread->batch);
+    }
+  }
+  else if (thread->thread_stack == NULL)
+  {
+    if (scheduler->task_cache.size < THREAD_CACHE_SIZE)
+    {
+      thread_list_prepend(&scheduler->task_cache, thread);
+    }
+    else
+    {
+      free(thread);
+    }
+  }
+  else if (scheduler->thread_cache.size < THREAD_CACHE_SIZE &&
+      thread->thread_stack->capacity == scheduler->stack_capacity)
+  {
+    /* Last in, first out: its stack is likely still in the cache */
+    thread_list_prepend(&scheduler->thread_cache, thread);
+  }
+  else
+  {
+    l1_stack_free(thread->thread_stack);
+    free(thread);
+  }
+  l1_preempt_enable();
+}
+
+l1_thread_info *reuse_thread(bool stackless)
+{
+  l1_preempt_disable();
+  l1_thread_info *thread = thread_list_pop(stackless ? &scheduler->task_cache : &scheduler->thread_cache);
+  l1_preempt_enable();
+  if (stackless)
+  {
+    return thread;
+  }
+  /* stack_capacity changed since */
+  if (thread != NULL && thread->thread_stack->capacity != scheduler->stack_capacity)
+  {
+    l1_stack_free(thread->thread_stack);
+    free(thread);
+    return NULL;
+  }
+  if (thread != NULL)
+  {
+    l1_stack *stack = thread->thread_stack;
+    stack->size = 0;
+    stack->top = stack->base + stack->capacity;
+  }
+  return thread;
+}
+
+void release_stack(l1_stack *stack)
+{
+  l1_preempt_disable();
+  if (scheduler->stack_cache_size < THREAD_CACHE_SIZE &&
+      stack->capacity == scheduler->stack_capacity)
+  {
+    scheduler->stack_cache[scheduler->stack_cache_size++] = stack;
+    stack = NULL;
+  }
+  l1_preempt_enable();
+  if (stack != NULL)
+  {
+    l1_stack_free(stack);
+  }
+}
+
+l1_stack *reuse_stack(void)
+{
+  l1_stack *stack = NULL;
+  l1_preempt_disable();
+  if (scheduler->stack_cache_size > 0)
+  {
+    stack = scheduler->stack_cache[--scheduler->stack_cache_size];
+  }
+  l1_preempt_enable();
+  /* stack_capacity changed since */
+  if (stack != NULL && stack->capacity != scheduler->stack_capacity)
+  {
+    l1_stack_free(stack);
+    stack = NULL;
+  }
+  if (stack != NULL)
+  {
+    stack->size = 0;
+    stack->top = stack->base + stack->capacity;
+    return stack;
+  }
+  /* Borrow the stack of a dead thread */
+  l1_thread_info *thread = reuse_thread(false);
+  if (thread != NULL)
+  {
+    stack = thread->thread_stack;
+    free(thread);
+    return stack;
+  }
+  return l1_stack_new_capacity(scheduler->stack_capacity);
+}
+
+void wake_thread(l1_thread_info *blocked, l1_error err)
+{
+  if (!blocked)
+  {
+    fprintf(stderr, "Error: wake_thread called with null blocked.\n");
+    exit(-1);
+  }
+  /* Still on its way to handle_non_runnable, which will requeue it */
+  if (!blocked->parked)
+  {
+    blocked->wake_pending = true;
+    return;
+  }
+  if (blocked->state != BLOCKED)
+  {
+    fprintf(stderr, "Error: wake_thread called with a thread that is not blocked.\n");
+    exit(-1);
+  }
+  blocked->parked = false;
+  L1_TRACE_EVENT(L1_TRACE_UNBLOCK, blocked, err);
+  stats_wake(blocked);
+  timer_wheel_cancel(&scheduler->timers, &blocked->timer);
+  if (blocked->wait_reason == L1_WAIT_YIELD)
+  {
+    scheduler->timed_yielders--;
+  }
+  blocked->state = RUNNABLE;
+  blocked->errno = err;
+  blocked->joined_target = -1;
+  blocked->wait_reason = L1_WAIT_JOIN;
+  thread_list_remove(&scheduler->thread_arrays[BLOCKED], blocked);
+  runnable_add(blocked);
+}
+
 void yield(l1_tid tid)
 {
+  /* No tick may switch us while we are switching. Our nesting level
+   * is kept on our stack, tsys and other threads reset the count */
+  sig_atomic_t preempt_count = scheduler->preempt_count;
+  scheduler->preempt_count = preempt_count + 1;
   /* Setup the target */
   scheduler->current->yield_target = tid;
 
   /* Always go back to tsys */
   switch_asm((uint64_t *)scheduler->tsys->thread_stack->top,
              (uint64_t **)&scheduler->current->thread_stack->top);
-  /* Nothing to do, we are rescheduled.  */
+  /* We are rescheduled, maybe by another worker in M:N mode */
+  get_scheduler()->preempt_count = preempt_count;
 }
 
 void switch_asm(uint64_t *dest, uint64_t **orig)
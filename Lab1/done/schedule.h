@@ -5,30 +5,77 @@
  * @author Mark Sutherland
  */
 #pragma once
+#include <signal.h>
+#include "stats.h"
 #include "thread_info.h"
 #include "thread_list.h"
 
-/* Week 4: Interface for scheduling */
-typedef l1_thread_info *(*sched_policy)(l1_thread_info *, l1_thread_info *);
+/* Week 4: Interface for scheduling
+ * A policy owns the run queue. The scheduler hands it every thread entering
+ * the RUNNABLE state and asks it for the next one to run, so the policy can
+ * keep whatever index it needs in the scheduler's `policy_state`.
+ * A thread is in the policy's run queue iff it is RUNNABLE: the running
+ * thread is not, until it is descheduled and enqueued again. */
+typedef struct sched_policy
+{
+  void (*init)(void);                                 /** Allocates policy_state */
+  void (*enqueue)(l1_thread_info *thread);            /** thread became RUNNABLE */
+  void (*dequeue)(l1_thread_info *thread);            /** thread leaves the run queue without being picked, may be NULL */
+  l1_thread_info *(*pick_next)(l1_thread_info *prev); /** Removes and returns the next thread, NULL if none */
+  void (*tick)(l1_thread_info *prev);                 /** Accounts for the slice prev just ran, before it is requeued */
+  void (*destroy)(void);                              /** Releases policy_state */
+} sched_policy;
 
 /* Answers the question "what does periodically mean?" in terms of sched_ticks*/
 /* Meanst that every SCHED_PERIOD, must boost priority of thread not ran */
 #define SCHED_PERIOD 10
 
+/* Dead threads kept, with their stack, for reuse by l1_thread_create */
+#define THREAD_CACHE_SIZE 64
+
+/* Single allocation holding the descriptors and stacks of the threads of an
+ * l1_thread_create_many, freed once all of them are released. Its threads
+ * are never cached. */
+typedef struct l1_thread_batch
+{
+  size_t live; /** Threads of the batch not released yet */
+} l1_thread_batch;
+
 typedef struct
 {
   l1_thread_info *current;                         /** Current thread */
   l1_tid next_tid;                                 /** Next thread */
   l1_thread_info *tsys;                            /** System thread */
-  sched_policy select_next;                        /** Scheduler policy */
-  l1_thread_list thread_arrays[NUM_THREAD_STATES]; /** Lists for the threads in different states. */
+  const sched_policy *policy;                       /** Scheduler policy */
+  l1_thread_list *thread_arrays;                   /** Lists for the threads in different states.
+                                                    * RUNNABLE also holds the running threads and
+                                                    * has no order, the policy orders the run queue.
+                                                    * Points to local_arrays, or to the lists shared
+                                                    * by the workers in M:N mode */
+  l1_thread_list local_arrays[NUM_THREAD_STATES];  /** Lists of a single scheduler */
   uint64_t sched_ticks;                            /** Scheduler ticks */
+  void *policy_state;                              /** Private policy data (run queue) */
+  unsigned stack_capacity;                         /** Capacity of new thread stacks, in words */
+  int preempt_mode;                                /** l1_preempt_mode, see preempt.h */
+  volatile sig_atomic_t preempt_count;             /** Preemption is allowed only at 0 */
+  volatile sig_atomic_t need_resched;              /** A tick asked for a switch */
+  uint64_t preemptions;                            /** Switches forced by the tick or at a safe point */
+  struct l1_runtime *runtime;                      /** Workers of the M:N mode (see worker.h), NULL otherwise */
+  unsigned worker_id;                              /** Index of this scheduler among the workers */
+  struct l1_event_loop *event_loop;                /** I/O waiters (see event_loop.h), lazily created */
+  l1_timer_wheel timers;                           /** Timeouts of the BLOCKED threads */
+  size_t timed_yielders;                           /** Threads BLOCKED in L1_WAIT_YIELD */
+  l1_thread_list thread_cache;                     /** Dead threads, see release_thread */
+  l1_thread_list task_cache;                       /** Dead stackless tasks, see release_thread */
+  l1_stack *stack_cache[THREAD_CACHE_SIZE];        /** Free coroutine stacks, see release_stack */
+  unsigned stack_cache_size;
+  l1_sched_stats_info stats;                       /** See stats.h */
 } l1_scheduler_info;
 
 /**
  * @brief initializes the scheduler and tsys.
  */
-void initialize_scheduler(sched_policy policy);
+void initialize_scheduler(const sched_policy *policy);
 
 /**
  * @brief Cleans up the scheduler
@@ -36,7 +83,10 @@ void initialize_scheduler(sched_policy policy);
 void clean_up_scheduler();
 
 /**
- * @brief get a reference to the scheduler
+ * @brief get a reference to the scheduler of the calling OS thread
+ *
+ * In M:N mode a green thread may resume on another worker after any switch,
+ * so callers must not keep the result across a yield.
  */
 l1_scheduler_info *get_scheduler();
 
@@ -45,24 +95,76 @@ l1_scheduler_info *get_scheduler();
  */
 l1_tid get_uniq_tid();
 
+/**
+ * @brief Reserves count consecutive TIDs.
+ *
+ * @return The first of them.
+ */
+l1_tid get_uniq_tids(size_t count);
+
 /**
  * @brief Adds a thread to the scheduler data structure in an associated
- * state.
+ * state. A RUNNABLE thread is also handed to the policy's enqueue.
  */
 void add_to_scheduler(l1_thread_info *thread, l1_thread_state state);
 
+/**
+ * @brief add_to_scheduler in the RUNNABLE state for a chain of count
+ * threads linked from head to tail through prev/next, which are appended to
+ * the RUNNABLE list at once.
+ */
+void add_batch_to_scheduler(l1_thread_info *head, l1_thread_info *tail, size_t count);
+
+/**
+ * @brief Disposes of a thread that no longer runs and is in no list.
+ *
+ * Up to THREAD_CACHE_SIZE descriptors are kept with their stack in the
+ * cache of the calling scheduler, the others are freed. A thread of a batch
+ * (see l1_thread_batch) frees the batch if it is the last one released.
+ */
+void release_thread(l1_thread_info *thread);
+
+/**
+ * @brief Takes a thread out of the cache of the calling scheduler, with an
+ * empty stack of stack_capacity words, or without stack if stackless.
+ *
+ * @return The thread, or NULL if there is none to reuse.
+ */
+l1_thread_info *reuse_thread(bool stackless);
+
+/**
+ * @brief Disposes of a stack that is no longer used, keeping up to
+ * THREAD_CACHE_SIZE of them in the calling scheduler.
+ */
+void release_stack(l1_stack *stack);
+
+/**
+ * @brief Returns an empty stack of stack_capacity words, taken from the
+ * stacks released before, or from the cached threads, or allocated.
+ *
+ * @return The stack, or NULL if unable to allocate it.
+ */
+l1_stack *reuse_stack(void);
+
 /**
  * @brief The scheduler's main loop logic.
  *
  * This function is called by tsys and simulates a kernel scheduler.
- * tsys runs this loop as long as the runnable list is not empty.
+ * tsys runs this loop as long as the runnable list is not empty or threads
+ * wait for I/O or a timer.
  * The main loop logic is as follows: 
- * 1. Check the currently scheduled thread. If it has a yield target,
+ * 1. Let the policy account for the slice of the current thread (tick).
+ * 2. If it is still runnable, enqueue it back. If it has a yield target,
  * find the corresponding thread.
- * 2. If the current thread state is non-runnable, deschedule it.
- * 3. If the yield target is undefined, call the scheduler's select_next method.
- * 4. Change the state of the current thread.
- * 5. Schedule the next thread.
+ * 3. If the current thread state is non-runnable, deschedule it.
+ * 4. If the yield target is defined, dequeue it from the policy, otherwise
+ * call the policy's pick_next method. Policies without dequeue ignore the
+ * yield target.
+ * Expired timers make their threads RUNNABLE at every tick. Every
+ * SCHED_PERIOD ticks, the event loop wakes the threads whose I/O is ready.
+ * When nothing is runnable, the timed yielders are woken up early, or tsys
+ * waits in the event loop for I/O or the next timer.
+ * 5. Change the state of the next thread.
  * 6. Switch from tsys to the next thread.
  *
  */
@@ -77,8 +179,10 @@ void handle_non_runnable(l1_thread_info *current);
  * @brief unblocks blocked thread and collects zombie if not null.
  *
  * This is a helper function that assumes blocked is in the BLOCKED list
- * and zombie is in ZOMBIE list or null. The function moves blocked
- * to the RUNNABLE list. If zombie is not null, it puts zombie into dead mode.
+ * and zombie is in ZOMBIE list or null, and that the caller holds the lock
+ * of the thread lists in M:N mode. The function moves blocked
+ * to the RUNNABLE list and enqueues it in the policy. If zombie is not null,
+ * it puts zombie into dead mode.
  * The free of the zombie happens in schedule.
  *
  * @warning The function changes errno value for a l1_thread_info and moves 
@@ -91,6 +195,30 @@ void handle_non_runnable(l1_thread_info *current);
  */
 void unblock_thread(l1_thread_info *blocked, l1_thread_info *zombie);
 
+/**
+ * @brief Locks the thread lists, which are shared by the workers in M:N
+ * mode. No-op otherwise.
+ */
+void lists_lock(void);
+
+/**
+ * @brief Unlocks the thread lists, see lists_lock.
+ */
+void lists_unlock(void);
+
+/**
+ * @brief Makes a BLOCKED thread RUNNABLE without a joined zombie.
+ *
+ * Used by the event loop, when a timer expires and by sync.h. The thread's
+ * timer is cancelled, it is moved from the BLOCKED list to the RUNNABLE list
+ * and enqueued in the policy, and its errno is set to err.
+ * In M:N mode the caller holds the lock of the thread lists, and a thread
+ * that its worker did not park yet, BLOCKED or still RUNNING, is only marked
+ * wake_pending: it is requeued with errno SUCCESS as soon as it reaches
+ * handle_non_runnable.
+ */
+void wake_thread(l1_thread_info *blocked, l1_error err);
+
 /**
  * @brief Yields to the scheduler
  * 
@@ -99,7 +227,8 @@ void unblock_thread(l1_thread_info *blocked, l1_thread_info *zombie);
  * function's execution.
  * 
  * The function will resume from this point at some later point in time as
- * decide by the scheduler (may be immediately).
+ * decide by the scheduler (may be immediately). The thread cannot be
+ * preempted while it is switching.
  * 
  * yield(-1) yields to the system thread
  */
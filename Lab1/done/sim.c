@@ -0,0 +1,358 @@
+/**
+ * @file sim.c
+ * @brief Implementation of the scheduling simulator.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+#include "sim.h"
+
+/* A simulated thread, info first so the policy's pointers convert back */
+typedef struct
+{
+  l1_thread_info info;
+  const l1_sim_task *task;
+  unsigned bursts_done;
+  l1_time burst_left;     /* CPU time left in the current burst */
+  l1_time runnable_since;
+  l1_time max_wait;
+  bool arrived;
+  bool started;
+  bool finished;
+  bool joining;           /* BLOCKED in the join of task->joins */
+} sim_thread;
+
+/* Arrival or end of an I/O wait */
+typedef struct
+{
+  l1_time time;
+  uint64_t seq; /* Keeps simultaneous events in the order they were posted */
+  sim_thread *thread;
+} sim_event;
+
+typedef struct
+{
+  const l1_sim_config *config;
+  l1_scheduler_info *scheduler;
+  sim_thread *threads;
+  sim_event *events; /* Binary min-heap on (time, seq) */
+  size_t event_count;
+  uint64_t event_seq;
+  l1_time now;
+  l1_histogram turnaround;
+  l1_histogram response;
+  l1_sim_report *report;
+} sim_state;
+
+//========================================================================================
+static bool sim_event_before(const sim_event *a, const sim_event *b)
+{
+  return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+/* The heap holds at most one event per thread */
+static void sim_post(sim_state *sim, sim_thread *thread, l1_time time)
+{
+  size_t i = sim->event_count++;
+  sim_event event = {time, sim->event_seq++, thread};
+  while (i > 0 && sim_event_before(&event, &sim->events[(i - 1) / 2]))
+  {
+    sim->events[i] = sim->events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  sim->events[i] = event;
+}
+
+static sim_event sim_pop(sim_state *sim)
+{
+  sim_event top = sim->events[0];
+  sim_event last = sim->events[--sim->event_count];
+  size_t i = 0;
+  for (;;)
+  {
+    size_t child = 2 * i + 1;
+    if (child >= sim->event_count)
+    {
+      break;
+    }
+    if (child + 1 < sim->event_count && sim_event_before(&sim->events[child + 1], &sim->events[child]))
+    {
+      child++;
+    }
+    if (!sim_event_before(&sim->events[child], &last))
+    {
+      break;
+    }
+    sim->events[i] = sim->events[child];
+    i = child;
+  }
+  sim->events[i] = last;
+  return top;
+}
+//========================================================================================
+static void sim_make_runnable(sim_state *sim, sim_thread *thread)
+{
+  thread->info.state = RUNNABLE;
+  thread->runnable_since = sim->now;
+  sim->config->policy->enqueue(&thread->info);
+}
+
+/* Same initial state as l1_thread_create */
+static void sim_arrive(sim_state *sim, sim_thread *thread)
+{
+  l1_thread_info *info = &thread->info;
+  thread->arrived = true;
+  info->id = thread - sim->threads;
+  info->joined_target = -1;
+  info->yield_target = -1;
+  info->priority_level = thread->task->priority;
+  l1_time_init(&info->total_time);
+  l1_time_init(&info->slice_start);
+  l1_time_init(&info->slice_end);
+  thread->burst_left = thread->task->cpu;
+  sim_make_runnable(sim, thread);
+}
+
+static void sim_finish(sim_state *sim, sim_thread *thread, size_t count)
+{
+  thread->finished = true;
+  thread->info.state = ZOMBIE;
+  l1_time turnaround = sim->now - thread->task->arrival;
+  l1_histogram_record(&sim->turnaround, turnaround);
+  sim->report->finished++;
+  sim->report->makespan = sim->now;
+  for (size_t i = 0; i < count; i++)
+  {
+    sim_thread *joiner = &sim->threads[i];
+    if (joiner->joining && &sim->threads[joiner->task->joins] == thread)
+    {
+      joiner->joining = false;
+      sim_finish(sim, joiner, count);
+    }
+  }
+}
+
+/* The current burst of thread is over */
+static void sim_burst_done(sim_state *sim, sim_thread *thread, size_t count)
+{
+  const l1_sim_task *task = thread->task;
+  if (++thread->bursts_done < task->bursts)
+  {
+    thread->burst_left = task->cpu;
+    if (task->io > 0)
+    {
+      thread->info.state = BLOCKED;
+      sim_post(sim, thread, sim->now + task->io);
+    }
+    else
+    {
+      sim_make_runnable(sim, thread);
+    }
+    return;
+  }
+  if (task->joins >= 0 && !sim->threads[task->joins].finished)
+  {
+    thread->info.state = BLOCKED;
+    thread->joining = true;
+    return;
+  }
+  sim_finish(sim, thread, count);
+}
+
+/* Runs next for one slice, then accounts for it as schedule() does */
+static void sim_dispatch(sim_state *sim, sim_thread *thread, size_t count)
+{
+  const l1_sim_config *config = sim->config;
+  l1_thread_info *info = &thread->info;
+  sim->now += config->switch_cost;
+  sim->report->switches++;
+
+  l1_time wait = sim->now - thread->runnable_since;
+  if (wait > thread->max_wait)
+  {
+    thread->max_wait = wait;
+  }
+  if (!thread->started)
+  {
+    thread->started = true;
+    l1_histogram_record(&sim->response, sim->now - thread->task->arrival);
+  }
+
+  info->state = RUNNING;
+  info->got_scheduled = 1;
+  info->slice_start = sim->now;
+  l1_time run = thread->burst_left;
+  if (config->preemptive)
+  {
+    l1_time slice = l1_priority_slice_size(info->priority_level);
+    run = (run < slice) ? run : slice;
+  }
+  sim->now += run;
+  thread->burst_left -= run;
+
+  sim->scheduler->sched_ticks = (sim->scheduler->sched_ticks + 1) % config->sched_period;
+  info->slice_end = sim->now;
+  l1_time_add(&info->total_time, run);
+  config->policy->tick(info);
+
+  if (thread->burst_left > 0)
+  {
+    sim_make_runnable(sim, thread);
+  }
+  else
+  {
+    sim_burst_done(sim, thread, count);
+  }
+}
+//========================================================================================
+static void sim_summarize(sim_state *sim, size_t count)
+{
+  l1_sim_report *report = sim->report;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (sim->threads[i].max_wait > report->max_wait)
+    {
+      report->max_wait = sim->threads[i].max_wait;
+    }
+    if (sim->threads[i].max_wait > sim->config->starvation)
+    {
+      report->starved++;
+    }
+  }
+  if (sim->turnaround.count > 0)
+  {
+    report->mean_turnaround = (double)sim->turnaround.sum / sim->turnaround.count;
+    report->p99_turnaround = l1_histogram_quantile(&sim->turnaround, 0.99);
+  }
+  if (sim->response.count > 0)
+  {
+    report->mean_response = (double)sim->response.sum / sim->response.count;
+    report->p99_response = l1_histogram_quantile(&sim->response, 0.99);
+  }
+}
+
+l1_error l1_sim_run(const l1_sim_config *config, const l1_sim_task *tasks, size_t count,
+                    l1_sim_report *report)
+{
+  memset(report, 0, sizeof(l1_sim_report));
+  if (get_scheduler() != NULL || config->sched_period == 0)
+  {
+    return ERRINVAL;
+  }
+  sim_state *sim = calloc(1, sizeof(sim_state));
+  sim_thread *threads = calloc(count, sizeof(sim_thread));
+  sim_event *events = malloc((count + 1) * sizeof(sim_event));
+  if (sim == NULL || threads == NULL || events == NULL)
+  {
+    free(sim);
+    free(threads);
+    free(events);
+    return ERRNOMEM;
+  }
+  sim->config = config;
+  sim->threads = threads;
+  sim->events = events;
+  sim->report = report;
+  l1_histogram_init(&sim->turnaround);
+  l1_histogram_init(&sim->response);
+
+  /* Provides the policy with its policy_state and sched_ticks */
+  initialize_scheduler(config->policy);
+  sim->scheduler = get_scheduler();
+  for (size_t i = 0; i < count; i++)
+  {
+    threads[i].task = &tasks[i];
+    sim_post(sim, &threads[i], tasks[i].arrival);
+  }
+
+  l1_error err = SUCCESS;
+  l1_thread_info *prev = sim->scheduler->tsys;
+  while (report->finished < count)
+  {
+    while (sim->event_count > 0 && sim->events[0].time <= sim->now)
+    {
+      sim_thread *thread = sim_pop(sim).thread;
+      if (thread->arrived)
+      {
+        sim_make_runnable(sim, thread);
+      }
+      else
+      {
+        sim_arrive(sim, thread);
+      }
+    }
+    l1_thread_info *next = config->policy->pick_next(prev);
+    if (next != NULL)
+    {
+      sim_dispatch(sim, (sim_thread *)next, count);
+      prev = next;
+    }
+    else if (sim->event_count > 0)
+    {
+      /* Idle until the next event */
+      sim->now = sim->events[0].time;
+    }
+    else
+    {
+      /* The remaining tasks join each other */
+      err = ERRINVAL;
+      break;
+    }
+  }
+
+  sim_summarize(sim, count);
+  clean_up_scheduler();
+  free(events);
+  free(threads);
+  free(sim);
+  return err;
+}
+//========================================================================================
+/* xorshift64*, the same sequence on every platform */
+static uint64_t sim_random(uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in [0, 1) */
+static double sim_uniform(uint64_t *state)
+{
+  return (sim_random(state) >> 11) * (1.0 / (1ULL << 53));
+}
+
+/* Uniform in [low, high] */
+static l1_time sim_between(uint64_t *state, l1_time low, l1_time high)
+{
+  return low + (l1_time)(sim_uniform(state) * (high - low + 1));
+}
+
+void l1_sim_generate(l1_sim_task *tasks, size_t count, uint64_t seed, double interactive,
+                     l1_time interarrival)
+{
+  uint64_t state = seed * 2 + 1; /* Never 0 */
+  l1_time arrival = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    l1_sim_task *task = &tasks[i];
+    task->arrival = arrival;
+    arrival += (l1_time)(-log(1.0 - sim_uniform(&state)) * interarrival);
+    if (sim_uniform(&state) < interactive)
+    {
+      task->cpu = sim_between(&state, 100 * L1_NSEC_PER_USEC, 500 * L1_NSEC_PER_USEC);
+      task->io = sim_between(&state, L1_NSEC_PER_MSEC, 5 * L1_NSEC_PER_MSEC);
+      task->bursts = sim_between(&state, 10, 50);
+    }
+    else
+    {
+      task->cpu = sim_between(&state, 5 * L1_NSEC_PER_MSEC, 50 * L1_NSEC_PER_MSEC);
+      task->io = 0;
+      task->bursts = sim_between(&state, 1, 4);
+    }
+    task->joins = (i > 0 && sim_random(&state) % 8 == 0) ? (int)(sim_random(&state) % i) : -1;
+    task->priority = TOP_PRIORITY;
+  }
+}
@@ -0,0 +1,82 @@
+/**
+ * @file sim.h
+ * @brief Discrete-event simulation of a scheduling policy
+ *
+ * Runs a sched_policy, unchanged, against a synthetic workload in virtual
+ * time: nothing runs and l1_time_get is never read, so a run is fast and
+ * depends only on its inputs. The simulator plays the part of schedule():
+ * it gives each task its CPU bursts in turn, preempts it at the end of its
+ * slice (l1_priority_slice_size) if the configuration asks for it, blocks
+ * it between bursts and in joins, and calls the enqueue, pick_next and tick
+ * hooks of the policy in the same order, on l1_thread_info descriptors that
+ * it owns.
+ *
+ * The MLFQ parameters are taken from the configuration (SCHED_PERIOD) and
+ * from l1_priority_params (MIN_SLICE, TIME_PRIORITY_THRESHOLD). TOP_PRIORITY
+ * sizes the run queues, so it cannot change without recompiling.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "error.h"
+#include "l1_time.h"
+#include "priority.h"
+#include "schedule.h"
+
+/* A task of the workload */
+typedef struct
+{
+  l1_time arrival;      /** Creation time */
+  l1_time cpu;          /** Length of each CPU burst */
+  l1_time io;           /** BLOCKED time between two bursts, 0 to yield instead */
+  unsigned bursts;      /** Number of CPU bursts, at least 1 */
+  int joins;            /** Task joined after the last burst, -1 if none */
+  l1_priority priority; /** Initial priority level */
+} l1_sim_task;
+
+typedef struct
+{
+  const sched_policy *policy;
+  unsigned sched_period; /** SCHED_PERIOD of the simulated scheduler */
+  bool preemptive;       /** Preempt a burst at the end of the slice, as L1_PREEMPT_ASYNC */
+  l1_time switch_cost;   /** Virtual time taken by every switch */
+  l1_time starvation;    /** A longer RUNNABLE wait counts as starvation */
+} l1_sim_config;
+
+typedef struct
+{
+  size_t finished;           /** Tasks that ran to completion */
+  uint64_t switches;         /** Dispatches */
+  l1_time makespan;          /** Time of the last completion */
+  double mean_turnaround;    /** Arrival to completion */
+  l1_time p99_turnaround;
+  double mean_response;      /** Arrival to first run */
+  l1_time p99_response;
+  l1_time max_wait;          /** Longest single RUNNABLE wait */
+  size_t starved;            /** Tasks that waited longer than starvation once */
+} l1_sim_report;
+
+/**
+ * @brief Simulates the tasks under config, and summarizes the run in report.
+ *
+ * Uses a scheduler of its own, so the calling OS thread must not have one
+ * (see initialize_scheduler).
+ *
+ * @return SUCCESS, ERRINVAL if the calling thread has a scheduler or the
+ * joins form a cycle (report then covers the tasks that finished), or
+ * ERRNOMEM.
+ */
+l1_error l1_sim_run(const l1_sim_config *config, const l1_sim_task *tasks, size_t count,
+                    l1_sim_report *report);
+
+/**
+ * @brief Fills tasks with a reproducible workload of count tasks.
+ *
+ * Arrivals are a Poisson process of mean interarrival. A fraction
+ * `interactive` of the tasks run many short bursts separated by I/O, the
+ * others a few long CPU-bound bursts. About one task in eight joins an
+ * earlier task. The same seed always gives the same tasks.
+ */
+void l1_sim_generate(l1_sim_task *tasks, size_t count, uint64_t seed, double interactive,
+                     l1_time interarrival);
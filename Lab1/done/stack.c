@@ -9,10 +9,14 @@
 #include "stack.h"
 
 l1_stack* l1_stack_new(void) {
+  return l1_stack_new_capacity(MAX_STACK_CAPACITY);
+}
+
+l1_stack* l1_stack_new_capacity(unsigned capacity) {
   l1_stack* l1_stack_new = (l1_stack*)malloc(sizeof(l1_stack));
   if( l1_stack_new == NULL ) 
     return NULL;
-  l1_stack_new->capacity = MAX_STACK_CAPACITY;
+  l1_stack_new->capacity = capacity;
   l1_stack_new->size = 0;
   l1_stack_new->base = (uint64_t*)malloc(l1_stack_new->capacity * sizeof(uint64_t));
   if( l1_stack_new->base == NULL ) {
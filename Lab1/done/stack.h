@@ -12,6 +12,10 @@
  * On a 64-bit architecture, a word is 64 bits */
 #define MAX_STACK_CAPACITY  1024
 
+/* Smallest capacity of a thread stack: the initial frame, l1_start and a
+ * few calls */
+#define MIN_STACK_CAPACITY  64
+
 /**
  * @brief A stack structure
  */
@@ -33,6 +37,16 @@ typedef struct {
  */
 l1_stack* l1_stack_new(void);
 
+/**
+ * @brief Creates a new stack of a given capacity
+ *
+ * Same as l1_stack_new, for `capacity` words instead of MAX_STACK_CAPACITY.
+ *
+ * @return  A pointer to the allocated stack. Returns NULL if unable
+ *          to allocate space for the stack
+ */
+l1_stack* l1_stack_new_capacity(unsigned capacity);
+
 /**
  * @brief Cleans up the stack for a thread on completion 
  * 
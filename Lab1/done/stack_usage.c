@@ -0,0 +1,131 @@
+/**
+ * @file stack_usage.c
+ * @brief Implementation of the stack high-water marks.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "stack_usage.h"
+
+typedef struct
+{
+  thread_func_t func;
+  l1_histogram *usage; /* Bytes used */
+} l1_stack_usage_entry;
+
+/* Open addressing on the function address, shared by the workers */
+static l1_stack_usage_entry l1_stack_usage_table[L1_STACK_USAGE_FUNCS];
+static pthread_mutex_t l1_stack_usage_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void l1_stack_paint(l1_stack *stack)
+{
+  for (uint64_t *word = stack->base; word < stack->top; word++)
+  {
+    *word = L1_STACK_CANARY;
+  }
+}
+
+uint64_t l1_stack_high_water(const l1_stack *stack)
+{
+  const uint64_t *word = stack->base;
+  const uint64_t *end = stack->base + stack->capacity;
+  while (word < end && *word == L1_STACK_CANARY)
+  {
+    word++;
+  }
+  return (uint64_t)(end - word) * sizeof(uint64_t);
+}
+
+/* Entry of func, claimed if create. NULL if absent, or if the table is full */
+static l1_stack_usage_entry *l1_stack_usage_entry_get(thread_func_t func, bool create)
+{
+  size_t hash = ((uintptr_t)func >> 4) * 0x9E3779B97F4A7C15ULL >> 32;
+  for (size_t probe = 0; probe < L1_STACK_USAGE_FUNCS; probe++)
+  {
+    l1_stack_usage_entry *entry = &l1_stack_usage_table[(hash + probe) % L1_STACK_USAGE_FUNCS];
+    if (entry->func == func)
+    {
+      return entry;
+    }
+    if (entry->func == NULL)
+    {
+      if (!create || (entry->usage = malloc(sizeof(l1_histogram))) == NULL)
+      {
+        return NULL;
+      }
+      entry->func = func;
+      l1_histogram_init(entry->usage);
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+void l1_stack_usage_record(thread_func_t func, const l1_stack *stack)
+{
+  if (stack == NULL)
+  {
+    return;
+  }
+  uint64_t used = l1_stack_high_water(stack);
+  pthread_mutex_lock(&l1_stack_usage_lock);
+  l1_stack_usage_entry *entry = l1_stack_usage_entry_get(func, true);
+  if (entry != NULL)
+  {
+    l1_histogram_record(entry->usage, used);
+  }
+  pthread_mutex_unlock(&l1_stack_usage_lock);
+}
+
+l1_error l1_stack_usage_get(thread_func_t func, l1_histogram *usage)
+{
+  l1_error err = ERRINVAL;
+  pthread_mutex_lock(&l1_stack_usage_lock);
+  l1_stack_usage_entry *entry = l1_stack_usage_entry_get(func, false);
+  if (entry != NULL)
+  {
+    *usage = *entry->usage;
+    err = SUCCESS;
+  }
+  pthread_mutex_unlock(&l1_stack_usage_lock);
+  return err;
+}
+
+void l1_stack_usage_dump(FILE *out)
+{
+  bool first = true;
+  pthread_mutex_lock(&l1_stack_usage_lock);
+  fprintf(out, "[");
+  for (size_t i = 0; i < L1_STACK_USAGE_FUNCS; i++)
+  {
+    const l1_stack_usage_entry *entry = &l1_stack_usage_table[i];
+    if (entry->func == NULL)
+    {
+      continue;
+    }
+    const l1_histogram *usage = entry->usage;
+    fprintf(out,
+            "%s\n{\"func\":\"%p\",\"threads\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+            "\"max\":%llu}",
+            first ? "" : ",", (void *)(uintptr_t)entry->func, (unsigned long long)usage->count,
+            (unsigned long long)l1_histogram_quantile(usage, 0.5),
+            (unsigned long long)l1_histogram_quantile(usage, 0.9),
+            (unsigned long long)l1_histogram_quantile(usage, 0.99),
+            (unsigned long long)usage->max);
+    first = false;
+  }
+  fprintf(out, "\n]\n");
+  pthread_mutex_unlock(&l1_stack_usage_lock);
+}
+
+void l1_stack_usage_clear(void)
+{
+  pthread_mutex_lock(&l1_stack_usage_lock);
+  for (size_t i = 0; i < L1_STACK_USAGE_FUNCS; i++)
+  {
+    free(l1_stack_usage_table[i].usage);
+    l1_stack_usage_table[i].func = NULL;
+    l1_stack_usage_table[i].usage = NULL;
+  }
+  pthread_mutex_unlock(&l1_stack_usage_lock);
+}
@@ -0,0 +1,69 @@
+/**
+ * @file stack_usage.h
+ * @brief High-water marks of the green-thread stacks, per thread function
+ *
+ * With L1_STACK_USAGE defined (see the Makefile), the stack of every new
+ * thread is painted with L1_STACK_CANARY below its initial frame, and when
+ * the thread returns, schedule() finds the deepest word that no longer holds
+ * the canary and records the bytes used in the histogram of its
+ * thread_func. The percentiles per function tell which stack capacity (see
+ * l1_thread_attr.stack_capacity) each kind of thread needs.
+ *
+ * Painting writes the whole stack, so in this mode every stack is resident
+ * from its creation: it is meant for sizing runs. Stackless tasks and
+ * coroutine stacks are not measured, and a thread that overflowed its stack
+ * has already corrupted the memory below it.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include "error.h"
+#include "histogram.h"
+#include "stack.h"
+#include "thread_info.h"
+
+#define L1_STACK_CANARY 0x5AFEC0DE5AFEC0DEULL
+#define L1_STACK_USAGE_FUNCS 256 /* Distinct thread functions tracked */
+
+/**
+ * @brief Fills the free part of stack, below its top, with L1_STACK_CANARY.
+ */
+void l1_stack_paint(l1_stack *stack);
+
+/**
+ * @brief Returns the bytes of a painted stack that were ever used: from the
+ * end of the stack to the deepest word that is not the canary.
+ */
+uint64_t l1_stack_high_water(const l1_stack *stack);
+
+/**
+ * @brief Records the high-water mark of the painted stack of a thread
+ * running func. Does nothing without a stack.
+ */
+void l1_stack_usage_record(thread_func_t func, const l1_stack *stack);
+
+/**
+ * @brief Copies the histogram of the bytes used by the threads of func.
+ *
+ * @return SUCCESS, or ERRINVAL if no thread of func was recorded.
+ */
+l1_error l1_stack_usage_get(thread_func_t func, l1_histogram *usage);
+
+/**
+ * @brief Writes, as a JSON array, the thread count and the percentiles of
+ * the bytes used for every function recorded.
+ */
+void l1_stack_usage_dump(FILE *out);
+
+/**
+ * @brief Forgets every recorded mark.
+ */
+void l1_stack_usage_clear(void);
+
+#ifdef L1_STACK_USAGE
+#define L1_STACK_PAINT(stack) l1_stack_paint(stack)
+#define L1_STACK_RECORD(thread) l1_stack_usage_record((thread)->thread_func, (thread)->thread_stack)
+#else
+#define L1_STACK_PAINT(stack) ((void)0)
+#define L1_STACK_RECORD(thread) ((void)0)
+#endif
@@ -0,0 +1,115 @@
+/**
+ * @file stats.c
+ * @brief Implementation of the scheduling statistics queries.
+ */
+#include "preempt.h"
+#include "schedule.h"
+#include "stats.h"
+
+static const char *const l1_state_names[NUM_THREAD_STATES] = {
+    [RUNNING] = "running",
+    [RUNNABLE] = "runnable",
+    [BLOCKED] = "blocked",
+    [ZOMBIE] = "zombie",
+    [DEAD] = "dead",
+};
+
+const l1_sched_stats_info *l1_sched_stats(void)
+{
+  return &get_scheduler()->stats;
+}
+
+void l1_stats_retire_deadline(l1_thread_info *thread, l1_time now)
+{
+  if (l1_time_are_equal(thread->deadline, 0))
+  {
+    return;
+  }
+  l1_sched_stats_info *stats = &get_scheduler()->stats;
+  bool missed = l1_time_is_smaller(thread->deadline, now);
+  thread->stats.deadlines++;
+  thread->stats.deadline_misses += missed;
+  stats->deadlines++;
+  stats->deadline_misses += missed;
+  l1_time_init(&thread->deadline);
+}
+
+l1_error l1_thread_get_stats(l1_tid tid, l1_thread_stats *stats)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_error err = ERRINVAL;
+  l1_preempt_disable();
+  lists_lock();
+  for (int state = RUNNABLE; state < DEAD && err != SUCCESS; state++)
+  {
+    l1_thread_info *thread = thread_list_find(&scheduler->thread_arrays[state], tid);
+    if (thread != NULL)
+    {
+      *stats = thread->stats;
+      err = SUCCESS;
+    }
+  }
+  lists_unlock();
+  l1_preempt_enable();
+  return err;
+}
+
+static void l1_histogram_dump(FILE *out, const char *name, const l1_histogram *histogram)
+{
+  double mean = (histogram->count > 0) ? (double)histogram->sum / histogram->count : 0;
+  fprintf(out,
+          "\"%s\":{\"count\":%llu,\"min\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,"
+          "\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+          name, (unsigned long long)histogram->count,
+          (unsigned long long)(histogram->count > 0 ? histogram->min : 0), mean,
+          (unsigned long long)l1_histogram_quantile(histogram, 0.5),
+          (unsigned long long)l1_histogram_quantile(histogram, 0.9),
+          (unsigned long long)l1_histogram_quantile(histogram, 0.99),
+          (unsigned long long)l1_histogram_quantile(histogram, 0.999),
+          (unsigned long long)histogram->max);
+}
+
+static void l1_thread_stats_dump(FILE *out, const l1_thread_info *thread, bool first)
+{
+  const l1_thread_stats *stats = &thread->stats;
+  fprintf(out,
+          "%s\n{\"tid\":%u,\"state\":\"%s\",\"run\":%llu,\"wait\":%llu,\"blocked\":%llu,"
+          "\"switches\":%llu,\"voluntary\":%llu,\"involuntary\":%llu,\"deadlines\":%llu,"
+          "\"deadline_misses\":%llu}",
+          first ? "" : ",", (unsigned)thread->id, l1_state_names[thread->state],
+          (unsigned long long)thread->total_time, (unsigned long long)stats->wait_time,
+          (unsigned long long)stats->blocked_time, (unsigned long long)stats->switches,
+          (unsigned long long)stats->voluntary, (unsigned long long)stats->involuntary,
+          (unsigned long long)stats->deadlines, (unsigned long long)stats->deadline_misses);
+}
+
+void l1_sched_stats_dump(FILE *out)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_preempt_disable();
+  const l1_sched_stats_info *stats = &scheduler->stats;
+  fprintf(out,
+          "{\"worker\":%u,\"switches\":%llu,\"preemptions\":%llu,\"deadlines\":%llu,"
+          "\"deadline_misses\":%llu,",
+          scheduler->worker_id, (unsigned long long)stats->switches,
+          (unsigned long long)scheduler->preemptions, (unsigned long long)stats->deadlines,
+          (unsigned long long)stats->deadline_misses);
+  l1_histogram_dump(out, "runq_latency", &stats->runq_latency);
+  fprintf(out, ",");
+  l1_histogram_dump(out, "slice_length", &stats->slice_length);
+  fprintf(out, ",\"threads\":[");
+  bool first = true;
+  lists_lock();
+  for (int state = RUNNABLE; state < DEAD; state++)
+  {
+    for (l1_thread_info *thread = scheduler->thread_arrays[state].head; thread != NULL;
+         thread = thread->next)
+    {
+      l1_thread_stats_dump(out, thread, first);
+      first = false;
+    }
+  }
+  lists_unlock();
+  fprintf(out, "\n]}\n");
+  l1_preempt_enable();
+}
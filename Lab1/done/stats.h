@@ -0,0 +1,58 @@
+/**
+ * @file stats.h
+ * @brief Scheduling statistics of the threads and of the schedulers
+ *
+ * Every thread counts, in l1_thread_info.stats, how long it waited RUNNABLE
+ * and BLOCKED, how many times it was scheduled, and how many of its switches
+ * out were voluntary (yield, block, return) or forced by preemption. Its
+ * running time is total_time. Every scheduler keeps histograms of the
+ * run-queue latency, from becoming RUNNABLE to running, and of the length of
+ * the slices. All times are in l1_time units, nanoseconds unless
+ * USE_UNIX_TIME is defined.
+ *
+ * A deadline (see l1_thread_set_deadline) is retired when the thread sets
+ * another one, clears it or returns, and counts as a miss if it passed by
+ * then. The thread and its scheduler both count retired and missed
+ * deadlines.
+ *
+ * In M:N mode the histograms are per worker.
+ */
+#pragma once
+#include <stdio.h>
+#include "error.h"
+#include "histogram.h"
+#include "thread_info.h"
+
+typedef struct
+{
+  uint64_t switches;          /** Threads switched in */
+  uint64_t deadlines;         /** Deadlines retired by the threads */
+  uint64_t deadline_misses;   /** Of which retired after they passed */
+  l1_histogram runq_latency;  /** RUNNABLE to RUNNING */
+  l1_histogram slice_length;  /** RUNNING to switched out */
+} l1_sched_stats_info;
+
+/**
+ * @brief Returns the statistics of the calling scheduler, updated as it
+ * runs.
+ */
+const l1_sched_stats_info *l1_sched_stats(void);
+
+/**
+ * @brief Copies the statistics of thread tid, which must not be released.
+ *
+ * @return SUCCESS, or ERRINVAL if there is no such thread.
+ */
+l1_error l1_thread_get_stats(l1_tid tid, l1_thread_stats *stats);
+
+/**
+ * @brief Retires the deadline of thread at time now, counting a miss if it
+ * passed. Used by the scheduler and l1_thread_set_deadline.
+ */
+void l1_stats_retire_deadline(l1_thread_info *thread, l1_time now);
+
+/**
+ * @brief Writes the statistics of the calling scheduler and of every thread
+ * that is not released as a JSON object.
+ */
+void l1_sched_stats_dump(FILE *out);
@@ -0,0 +1,328 @@
+/**
+ * @file sync.c
+ * @brief Implementation of the green thread synchronization primitives.
+ */
+#include <sched.h>
+#include <stddef.h>
+#include "preempt.h"
+#include "schedule.h"
+#include "sync.h"
+
+//========================================================================================
+static void guard_lock(char *guard)
+{
+  while (__atomic_test_and_set(guard, __ATOMIC_ACQUIRE))
+  {
+    /* Only another worker can hold it, let it run */
+    sched_yield();
+  }
+}
+
+static void guard_unlock(char *guard)
+{
+  __atomic_clear(guard, __ATOMIC_RELEASE);
+}
+
+static void queue_push(l1_wait_queue *queue, l1_waiter *waiter)
+{
+  waiter->next = NULL;
+  if (queue->tail == NULL)
+  {
+    queue->head = waiter;
+  }
+  else
+  {
+    queue->tail->next = waiter;
+  }
+  queue->tail = waiter;
+}
+
+static l1_waiter *queue_pop(l1_wait_queue *queue)
+{
+  l1_waiter *waiter = queue->head;
+  if (waiter != NULL)
+  {
+    queue->head = waiter->next;
+    if (queue->head == NULL)
+    {
+      queue->tail = NULL;
+    }
+  }
+  return waiter;
+}
+
+static void waiter_init(l1_waiter *waiter)
+{
+  waiter->thread = get_scheduler()->current;
+  waiter->next = NULL;
+}
+
+/* Blocks until the object is handed over, with preemption disabled. The
+ * waiter is queued, so it may already have been granted in M:N mode. */
+static void waiter_park(l1_waiter *waiter)
+{
+  waiter->thread->state = BLOCKED;
+  waiter->thread->wait_reason = L1_WAIT_SYNC;
+  yield(-1);
+}
+
+/* Hands the object over to waiter, whose node is gone once it runs */
+static void waiter_grant(l1_waiter *waiter)
+{
+  l1_thread_info *thread = waiter->thread;
+  lists_lock();
+  wake_thread(thread, SUCCESS);
+  lists_unlock();
+}
+//========================================================================================
+void l1_mutex_init(l1_mutex *mutex)
+{
+  mutex->state = L1_MUTEX_UNLOCKED;
+  mutex->guard = 0;
+  mutex->owner = NULL;
+  mutex->waiters.head = mutex->waiters.tail = NULL;
+}
+
+bool l1_mutex_trylock(l1_mutex *mutex)
+{
+  int expected = L1_MUTEX_UNLOCKED;
+  if (__atomic_compare_exchange_n(&mutex->state, &expected, L1_MUTEX_LOCKED, false,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+  {
+    mutex->owner = get_scheduler()->current;
+    return true;
+  }
+  return false;
+}
+
+/* Gives mutex to waiter and returns true if it is free, queues waiter
+ * otherwise. Called with preemption disabled. */
+static bool mutex_acquire_for(l1_mutex *mutex, l1_waiter *waiter)
+{
+  guard_lock(&mutex->guard);
+  for (;;)
+  {
+    int state = __atomic_load_n(&mutex->state, __ATOMIC_RELAXED);
+    if (state == L1_MUTEX_UNLOCKED)
+    {
+      if (__atomic_compare_exchange_n(&mutex->state, &state, L1_MUTEX_LOCKED, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      {
+        mutex->owner = waiter->thread;
+        guard_unlock(&mutex->guard);
+        return true;
+      }
+    }
+    /* From now on the holder has to take the guard to unlock */
+    else if (state == L1_MUTEX_CONTENDED ||
+             __atomic_compare_exchange_n(&mutex->state, &state, L1_MUTEX_CONTENDED, false,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+      queue_push(&mutex->waiters, waiter);
+      guard_unlock(&mutex->guard);
+      return false;
+    }
+  }
+}
+
+l1_error l1_mutex_lock(l1_mutex *mutex)
+{
+  if (l1_mutex_trylock(mutex))
+  {
+    return SUCCESS;
+  }
+  if (mutex->owner == get_scheduler()->current)
+  {
+    return ERRINVAL;
+  }
+  l1_waiter waiter;
+  waiter_init(&waiter);
+  l1_preempt_disable();
+  if (!mutex_acquire_for(mutex, &waiter))
+  {
+    /* The unlocking thread makes us the owner */
+    waiter_park(&waiter);
+  }
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+l1_error l1_mutex_unlock(l1_mutex *mutex)
+{
+  if (mutex->owner != get_scheduler()->current)
+  {
+    return ERRINVAL;
+  }
+  mutex->owner = NULL;
+  int expected = L1_MUTEX_LOCKED;
+  if (__atomic_compare_exchange_n(&mutex->state, &expected, L1_MUTEX_UNLOCKED, false,
+                                  __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+  {
+    return SUCCESS;
+  }
+
+  /* Contended: the mutex stays locked and changes hands */
+  l1_preempt_disable();
+  guard_lock(&mutex->guard);
+  l1_waiter *next = queue_pop(&mutex->waiters);
+  if (next == NULL)
+  {
+    __atomic_store_n(&mutex->state, L1_MUTEX_UNLOCKED, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    if (mutex->waiters.head == NULL)
+    {
+      __atomic_store_n(&mutex->state, L1_MUTEX_LOCKED, __ATOMIC_RELAXED);
+    }
+    mutex->owner = next->thread;
+  }
+  guard_unlock(&mutex->guard);
+  if (next != NULL)
+  {
+    waiter_grant(next);
+  }
+  l1_preempt_enable();
+  return SUCCESS;
+}
+//========================================================================================
+void l1_cond_init(l1_cond *cond)
+{
+  cond->guard = 0;
+  cond->mutex = NULL;
+  cond->waiters.head = cond->waiters.tail = NULL;
+}
+
+l1_error l1_cond_wait(l1_cond *cond, l1_mutex *mutex)
+{
+  if (mutex->owner != get_scheduler()->current)
+  {
+    return ERRINVAL;
+  }
+  l1_waiter waiter;
+  waiter_init(&waiter);
+  l1_preempt_disable();
+  guard_lock(&cond->guard);
+  cond->mutex = mutex;
+  queue_push(&cond->waiters, &waiter);
+  guard_unlock(&cond->guard);
+  l1_mutex_unlock(mutex);
+  /* Signaling moves us to the mutex, which is handed to us in turn */
+  waiter_park(&waiter);
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+/* Moves up to count waiters of cond to its mutex */
+static void cond_wake(l1_cond *cond, unsigned count)
+{
+  l1_preempt_disable();
+  guard_lock(&cond->guard);
+  l1_mutex *mutex = cond->mutex;
+  l1_wait_queue woken = cond->waiters;
+  l1_waiter *last = NULL;
+  for (unsigned i = 0; i < count && cond->waiters.head != NULL; i++)
+  {
+    last = queue_pop(&cond->waiters);
+  }
+  if (last != NULL)
+  {
+    last->next = NULL;
+  }
+  else
+  {
+    woken.head = NULL;
+  }
+  guard_unlock(&cond->guard);
+
+  l1_waiter *waiter = woken.head;
+  while (waiter != NULL)
+  {
+    l1_waiter *next = waiter->next;
+    /* Otherwise it runs when it reaches the head of the mutex queue */
+    if (mutex_acquire_for(mutex, waiter))
+    {
+      waiter_grant(waiter);
+    }
+    waiter = next;
+  }
+  l1_preempt_enable();
+}
+
+void l1_cond_signal(l1_cond *cond)
+{
+  cond_wake(cond, 1);
+}
+
+void l1_cond_broadcast(l1_cond *cond)
+{
+  cond_wake(cond, (unsigned)-1);
+}
+//========================================================================================
+void l1_sem_init(l1_sem *sem, int value)
+{
+  sem->count = value;
+  sem->guard = 0;
+  sem->pending = 0;
+  sem->waiters.head = sem->waiters.tail = NULL;
+}
+
+bool l1_sem_trywait(l1_sem *sem)
+{
+  int count = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+  while (count > 0)
+  {
+    if (__atomic_compare_exchange_n(&sem->count, &count, count - 1, true,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void l1_sem_wait(l1_sem *sem)
+{
+  if (__atomic_fetch_sub(&sem->count, 1, __ATOMIC_ACQUIRE) > 0)
+  {
+    return;
+  }
+  l1_waiter waiter;
+  waiter_init(&waiter);
+  l1_preempt_disable();
+  guard_lock(&sem->guard);
+  /* A post for us came before we could queue */
+  if (sem->pending > 0)
+  {
+    sem->pending--;
+    guard_unlock(&sem->guard);
+    l1_preempt_enable();
+    return;
+  }
+  queue_push(&sem->waiters, &waiter);
+  guard_unlock(&sem->guard);
+  waiter_park(&waiter);
+  l1_preempt_enable();
+}
+
+void l1_sem_post(l1_sem *sem)
+{
+  if (__atomic_fetch_add(&sem->count, 1, __ATOMIC_RELEASE) >= 0)
+  {
+    return;
+  }
+  /* A thread waits, or is about to */
+  l1_preempt_disable();
+  guard_lock(&sem->guard);
+  l1_waiter *next = queue_pop(&sem->waiters);
+  if (next == NULL)
+  {
+    sem->pending++;
+  }
+  guard_unlock(&sem->guard);
+  if (next != NULL)
+  {
+    waiter_grant(next);
+  }
+  l1_preempt_enable();
+}
@@ -0,0 +1,141 @@
+/**
+ * @file sync.h
+ * @brief Mutexes, condition variables and semaphores for green threads
+ *
+ * pthread primitives block the OS thread, and with it the whole scheduler.
+ * These ones park the calling green thread instead. Every object keeps its
+ * waiters in a FIFO queue, and a release hands the object directly to the
+ * oldest waiter: the waiter is made RUNNABLE already owning the mutex or
+ * the semaphore unit, so nobody else can take it first and nobody wakes up
+ * just to find it taken again. Uncontended operations are a single atomic
+ * instruction and never enter the scheduler.
+ *
+ * In M:N mode a waiter can be granted the object by another worker before
+ * its own worker has parked it, wake_thread then leaves it RUNNABLE.
+ *
+ * Only green threads may wait, tsys must not call these functions.
+ */
+#pragma once
+#include <stdbool.h>
+#include "error.h"
+#include "thread_info.h"
+
+/* A waiting thread, lives on its stack */
+typedef struct l1_waiter
+{
+  l1_thread_info *thread;
+  struct l1_waiter *next;
+} l1_waiter;
+
+/* FIFO of waiters, protected by the guard of its object */
+typedef struct
+{
+  l1_waiter *head;
+  l1_waiter *tail;
+} l1_wait_queue;
+
+typedef struct
+{
+  int state;               /* L1_MUTEX_UNLOCKED, L1_MUTEX_LOCKED or L1_MUTEX_CONTENDED */
+  char guard;              /* Spinlock of waiters, only contended in M:N mode */
+  l1_thread_info *owner;   /* Thread holding the mutex */
+  l1_wait_queue waiters;
+} l1_mutex;
+
+#define L1_MUTEX_UNLOCKED 0
+#define L1_MUTEX_LOCKED 1
+#define L1_MUTEX_CONTENDED 2 /* Locked, and waiters may be queued */
+
+typedef struct
+{
+  char guard;
+  l1_mutex *mutex;         /* Mutex of the current waiters */
+  l1_wait_queue waiters;
+} l1_cond;
+
+typedef struct
+{
+  int count;               /* Units left, negative when threads wait */
+  char guard;
+  unsigned pending;        /* Units posted to waiters that are not queued yet */
+  l1_wait_queue waiters;
+} l1_sem;
+
+#define L1_MUTEX_INITIALIZER {0}
+#define L1_COND_INITIALIZER {0}
+
+/**
+ * @brief Initializes an unlocked mutex.
+ */
+void l1_mutex_init(l1_mutex *mutex);
+
+/**
+ * @brief Locks mutex, parking the calling thread while it is held.
+ *
+ * @return SUCCESS, or ERRINVAL if the calling thread already holds it.
+ */
+l1_error l1_mutex_lock(l1_mutex *mutex);
+
+/**
+ * @brief Locks mutex if it is free.
+ *
+ * @return true if the mutex was locked.
+ */
+bool l1_mutex_trylock(l1_mutex *mutex);
+
+/**
+ * @brief Unlocks mutex, handing it to the oldest waiter if any.
+ *
+ * @return SUCCESS, or ERRINVAL if the calling thread does not hold it.
+ */
+l1_error l1_mutex_unlock(l1_mutex *mutex);
+
+/**
+ * @brief Initializes a condition variable without waiters.
+ */
+void l1_cond_init(l1_cond *cond);
+
+/**
+ * @brief Atomically unlocks mutex and waits for cond to be signaled.
+ *
+ * The thread runs again once it was signaled and holds mutex again. All
+ * the concurrent waiters of a condition variable must use the same mutex.
+ *
+ * @return SUCCESS, or ERRINVAL if the calling thread does not hold mutex.
+ */
+l1_error l1_cond_wait(l1_cond *cond, l1_mutex *mutex);
+
+/**
+ * @brief Wakes the oldest waiter of cond, if any.
+ *
+ * The waiter is moved to the queue of the mutex rather than woken up, so
+ * it only runs once it can have the mutex ("wait morphing").
+ */
+void l1_cond_signal(l1_cond *cond);
+
+/**
+ * @brief Wakes every waiter of cond, in order, see l1_cond_signal.
+ */
+void l1_cond_broadcast(l1_cond *cond);
+
+/**
+ * @brief Initializes a semaphore with value units.
+ */
+void l1_sem_init(l1_sem *sem, int value);
+
+/**
+ * @brief Takes a unit, parking the calling thread until one is posted.
+ */
+void l1_sem_wait(l1_sem *sem);
+
+/**
+ * @brief Takes a unit if one is available.
+ *
+ * @return true if a unit was taken.
+ */
+bool l1_sem_trywait(l1_sem *sem);
+
+/**
+ * @brief Gives a unit to the oldest waiter, or makes it available.
+ */
+void l1_sem_post(l1_sem *sem);
@@ -0,0 +1,214 @@
+/**
+ * @file task_group.c
+ * @brief Implementation of the futures and the task groups.
+ */
+#include "preempt.h"
+#include "schedule.h"
+#include "task_group.h"
+#include "thread.h"
+
+/* Parks the current thread in L1_WAIT_SYNC, with the lists locked and
+ * preemption disabled. Returns with the lists locked. */
+static void park_locked(void)
+{
+  l1_thread_info *current = get_scheduler()->current;
+  current->state = BLOCKED;
+  current->wait_reason = L1_WAIT_SYNC;
+  lists_unlock();
+  yield(-1);
+  lists_lock();
+}
+
+static void future_set_locked(l1_future *future, void *value)
+{
+  future->value = value;
+  future->ready = true;
+  l1_waiter *waiter = future->awaiters.head;
+  future->awaiters.head = future->awaiters.tail = NULL;
+  while (waiter != NULL)
+  {
+    /* The node is gone once its thread runs */
+    l1_waiter *next = waiter->next;
+    wake_thread(waiter->thread, SUCCESS);
+    waiter = next;
+  }
+}
+
+/* Frees a collected child, which no longer runs on its stack */
+static void child_free(l1_thread_info *child)
+{
+  child->state = DEAD;
+  release_thread(child);
+}
+//========================================================================================
+void l1_future_init(l1_future *future)
+{
+  future->ready = false;
+  future->value = NULL;
+  future->awaiters.head = future->awaiters.tail = NULL;
+}
+
+l1_error l1_future_set(l1_future *future, void *value)
+{
+  l1_error err = SUCCESS;
+  l1_preempt_disable();
+  lists_lock();
+  if (future->ready)
+  {
+    err = ERRINVAL;
+  }
+  else
+  {
+    future_set_locked(future, value);
+  }
+  lists_unlock();
+  l1_preempt_enable();
+  return err;
+}
+
+void l1_future_await(l1_future *future, void **value)
+{
+  if (!__atomic_load_n(&future->ready, __ATOMIC_ACQUIRE))
+  {
+    l1_preempt_disable();
+    lists_lock();
+    if (!future->ready)
+    {
+      l1_waiter waiter = {.thread = get_scheduler()->current, .next = NULL};
+      if (future->awaiters.tail == NULL)
+      {
+        future->awaiters.head = &waiter;
+      }
+      else
+      {
+        future->awaiters.tail->next = &waiter;
+      }
+      future->awaiters.tail = &waiter;
+      park_locked();
+    }
+    lists_unlock();
+    l1_preempt_enable();
+  }
+  if (value != NULL)
+  {
+    *value = future->value;
+  }
+}
+
+bool l1_future_is_ready(l1_future *future)
+{
+  return __atomic_load_n(&future->ready, __ATOMIC_ACQUIRE);
+}
+//========================================================================================
+void l1_task_group_init(l1_task_group *group)
+{
+  group->outstanding = 0;
+  group->done.size = 0;
+  group->done.head = group->done.tail = NULL;
+  group->waiter = NULL;
+  group->wait_all = false;
+}
+
+l1_error l1_task_group_spawn(l1_task_group *group, l1_tid *tid, l1_future *future,
+                             void *(*start_routine)(void *), void *arg)
+{
+  l1_thread_attr attr = {.group = group, .future = future};
+  l1_tid child;
+  /* Counted first, the child may return before l1_thread_create_attr does */
+  l1_preempt_disable();
+  lists_lock();
+  group->outstanding++;
+  lists_unlock();
+  l1_error err = l1_thread_create_attr(&child, &attr, start_routine, arg);
+  if (err != SUCCESS)
+  {
+    lists_lock();
+    group->outstanding--;
+    lists_unlock();
+  }
+  else if (tid != NULL)
+  {
+    *tid = child;
+  }
+  l1_preempt_enable();
+  return err;
+}
+
+size_t l1_task_group_wait_all(l1_task_group *group)
+{
+  l1_preempt_disable();
+  lists_lock();
+  if (group->outstanding > 0)
+  {
+    group->waiter = get_scheduler()->current;
+    group->wait_all = true;
+    park_locked();
+  }
+  l1_thread_list done = group->done;
+  group->done.size = 0;
+  group->done.head = group->done.tail = NULL;
+  lists_unlock();
+  l1_preempt_enable();
+
+  size_t freed = done.size;
+  l1_thread_info *child;
+  while ((child = thread_list_pop(&done)) != NULL)
+  {
+    child_free(child);
+  }
+  return freed;
+}
+
+l1_error l1_task_group_wait_any(l1_task_group *group, l1_tid *tid, void **retval)
+{
+  l1_preempt_disable();
+  lists_lock();
+  if (thread_list_is_empty(&group->done) && group->outstanding > 0)
+  {
+    group->waiter = get_scheduler()->current;
+    group->wait_all = false;
+    park_locked();
+  }
+  l1_thread_info *child = thread_list_pop(&group->done);
+  lists_unlock();
+  l1_preempt_enable();
+
+  if (child == NULL)
+  {
+    return ERRINVAL;
+  }
+  if (tid != NULL)
+  {
+    *tid = child->id;
+  }
+  if (retval != NULL)
+  {
+    *retval = child->retval;
+  }
+  child_free(child);
+  return SUCCESS;
+}
+
+bool l1_task_group_complete(l1_thread_info *child)
+{
+  if (child->future != NULL)
+  {
+    future_set_locked(child->future, child->retval);
+  }
+  l1_task_group *group = child->group;
+  if (group == NULL)
+  {
+    return false;
+  }
+  l1_scheduler_info *scheduler = get_scheduler();
+  thread_list_remove(&scheduler->thread_arrays[RUNNABLE], child);
+  thread_list_add(&group->done, child);
+  group->outstanding--;
+  l1_thread_info *waiter = group->waiter;
+  if (waiter != NULL && (!group->wait_all || group->outstanding == 0))
+  {
+    group->waiter = NULL;
+    wake_thread(waiter, SUCCESS);
+  }
+  return true;
+}
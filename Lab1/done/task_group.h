@@ -0,0 +1,103 @@
+/**
+ * @file task_group.h
+ * @brief Futures, and task groups that join their children in batches
+ *
+ * Joining N children with l1_thread_join blocks N times and looks each
+ * zombie up in the ZOMBIE list. The children of a task group are instead
+ * collected by the scheduler when they return: handle_non_runnable moves
+ * them from the RUNNABLE list to the group, completes their future and
+ * decrements the count of outstanding children, and wakes the parent once,
+ * when the count it waits for is reached. The parent then frees the
+ * finished children in one batch.
+ *
+ * A future is a write-once value that any number of threads can await.
+ * Futures and groups are protected by the lock of the thread lists (see
+ * lists_lock) and, in 1:N mode, by disabling preemption.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "error.h"
+#include "sync.h"
+#include "thread_info.h"
+#include "thread_list.h"
+
+typedef struct l1_future
+{
+  bool ready;
+  void *value;
+  l1_wait_queue awaiters;
+} l1_future;
+
+typedef struct l1_task_group
+{
+  size_t outstanding;      /* Children still running */
+  l1_thread_list done;     /* Finished children not collected yet */
+  l1_thread_info *waiter;  /* Thread in wait_all or wait_any, NULL if none */
+  bool wait_all;           /* The waiter only wants the last child */
+} l1_task_group;
+
+/**
+ * @brief Initializes a future without value.
+ */
+void l1_future_init(l1_future *future);
+
+/**
+ * @brief Sets the value of future and wakes the threads awaiting it.
+ *
+ * @return SUCCESS, or ERRINVAL if it already has a value.
+ */
+l1_error l1_future_set(l1_future *future, void *value);
+
+/**
+ * @brief Waits until future has a value and stores it in value, if not NULL.
+ */
+void l1_future_await(l1_future *future, void **value);
+
+/**
+ * @brief Returns true if future has a value.
+ */
+bool l1_future_is_ready(l1_future *future);
+
+/**
+ * @brief Initializes an empty group.
+ */
+void l1_task_group_init(l1_task_group *group);
+
+/**
+ * @brief Spawns a child of group running start_routine(arg).
+ *
+ * @param tid     Where to store the id of the child, may be NULL.
+ * @param future  Completed with the return value of the child, may be NULL.
+ *                It must outlive the child.
+ * @return SUCCESS, or the error of l1_thread_create.
+ */
+l1_error l1_task_group_spawn(l1_task_group *group, l1_tid *tid, l1_future *future,
+                             void *(*start_routine)(void *), void *arg);
+
+/**
+ * @brief Waits until every child of group returned, and frees them.
+ *
+ * @return The number of children freed.
+ */
+size_t l1_task_group_wait_all(l1_task_group *group);
+
+/**
+ * @brief Waits until a child of group returned, and frees it.
+ *
+ * The children are collected in the order in which they returned.
+ *
+ * @param tid     Where to store the id of the child, may be NULL.
+ * @param retval  Where to store its return value, may be NULL.
+ * @return SUCCESS, or ERRINVAL if group has no child left.
+ */
+l1_error l1_task_group_wait_any(l1_task_group *group, l1_tid *tid, void **retval);
+
+/**
+ * @brief Completes the future of a thread that just returned and collects
+ * it if it belongs to a group. Called by handle_non_runnable with the lists
+ * locked.
+ *
+ * @return true if the thread was collected, and skips the ZOMBIE list.
+ */
+bool l1_task_group_complete(l1_thread_info *child);
@@ -47,8 +47,6 @@ START_TEST(chunk_malloc_test_2)
 
   l1_init();
 
-  l1_chunk_desc_t *meta = l1_chunk_meta;
-
   int *first_int = (int *)l1_malloc(sizeof(int));
   double *sec_double = (double *)l1_malloc(sizeof(double));
   void *empty = l1_malloc(3 * CHUNK_SIZE);
@@ -77,13 +75,13 @@ START_TEST(chunk_malloc_test_2)
 
   for (size_t i = 0; i < CHUNK_ARENA_LENGTH / 2; i++)
   {
-    if (i < 12 /*because of headers */)
+    if (i < 7 /*metadata is kept out of the arena */)
     {
-      ck_assert_int_eq(meta[i], 1);
+      ck_assert_int_eq(IS_CHUNK_TAKEN(i), 1);
     }
     else
     {
-      ck_assert_int_eq(meta[i], 0);
+      ck_assert_int_eq(IS_CHUNK_TAKEN(i), 0);
     }
   }
 
@@ -95,26 +93,26 @@ START_TEST(chunk_malloc_test_2)
 
   for (size_t i = 0; i < CHUNK_ARENA_LENGTH / 2; i++)
   {
-    if (i > 11 || (i < 8 && i >= 4))
+    if (i > 6 || (i < 5 && i >= 2))
     {
-      ck_assert_int_eq(meta[i], 0);
+      ck_assert_int_eq(IS_CHUNK_TAKEN(i), 0);
     }
     else
     {
-      ck_assert_int_eq(meta[i], 1);
+      ck_assert_int_eq(IS_CHUNK_TAKEN(i), 1);
     }
   }
 
   empty = l1_malloc(4 * CHUNK_SIZE);
   for (size_t i = 0; i < CHUNK_ARENA_LENGTH / 2; i++)
   {
-    if (i > 16 || (i < 8 && i >= 4))
+    if (i > 10 || (i < 5 && i >= 2))
     {
-      ck_assert_int_eq(meta[i], 0);
+      ck_assert_int_eq(IS_CHUNK_TAKEN(i), 0);
     }
     else
     {
-      ck_assert_int_eq(meta[i], 1);
+      ck_assert_int_eq(IS_CHUNK_TAKEN(i), 1);
     }
   }
 
@@ -135,7 +133,103 @@ START_TEST(chunk_malloc_test_2)
 
   for (size_t i = 0; i < CHUNK_ARENA_LENGTH / 2; i++)
   {
-    ck_assert_int_eq(meta[i], 0);
+    ck_assert_int_eq(IS_CHUNK_TAKEN(i), 0);
+  }
+
+  l1_deinit();
+}
+END_TEST
+
+/* Test next fit across bitmap words and around the end of the arena */
+START_TEST(chunk_malloc_test_3)
+{
+  l1_init = l1_chunk_init;
+  l1_deinit = l1_chunk_deinit;
+  l1_malloc = l1_chunk_malloc;
+  l1_free = l1_chunk_free;
+
+  l1_init();
+
+  /* Chunks 0 to 59, then 60 to 69 across the first word boundary */
+  void *head = l1_malloc(60 * CHUNK_SIZE);
+  void *straddle = l1_malloc(10 * CHUNK_SIZE);
+  ck_assert_ptr_eq(straddle, &l1_chunk_arena[60]);
+  ck_assert_uint_eq(l1_chunk_meta[0], ~(l1_chunk_desc_t)0);
+  ck_assert_uint_eq(l1_chunk_meta[1], 0x3F);
+  ck_assert_uint_eq(l1_chunk_rover, 70);
+
+  /* The hole left at the start is skipped until the search wraps */
+  ck_assert_int_eq((int)SUCCESS, (int)l1_free(head));
+  void *small = l1_malloc(sizeof(int));
+  ck_assert_ptr_eq(small, &l1_chunk_arena[70]);
+  void *tail = l1_malloc((CHUNK_ARENA_LENGTH - 71) * CHUNK_SIZE);
+  ck_assert_ptr_eq(tail, &l1_chunk_arena[71]);
+  ck_assert_uint_eq(l1_chunk_rover, 0);
+  void *wrapped = l1_malloc(CHUNK_SIZE);
+  ck_assert_ptr_eq(wrapped, &l1_chunk_arena[0]);
+
+  /* 59 free chunks left, all between 1 and 59 */
+  ck_assert_ptr_eq(l1_malloc(60 * CHUNK_SIZE), NULL);
+  ck_assert_int_eq(l1_errno, ERRNOMEM);
+  void *rest = l1_malloc(59 * CHUNK_SIZE);
+  ck_assert_ptr_eq(rest, &l1_chunk_arena[1]);
+  for (size_t i = 0; i < CHUNK_ARENA_LENGTH; i++)
+  {
+    ck_assert_int_eq(IS_CHUNK_TAKEN(i), 1);
+  }
+
+  ck_assert_int_eq((int)SUCCESS, (int)l1_free(straddle));
+  ck_assert_int_eq((int)SUCCESS, (int)l1_free(small));
+  ck_assert_int_eq((int)SUCCESS, (int)l1_free(tail));
+  ck_assert_int_eq((int)SUCCESS, (int)l1_free(wrapped));
+  ck_assert_int_eq((int)SUCCESS, (int)l1_free(rest));
+  for (size_t i = 0; i < CHUNK_META_LENGTH; i++)
+  {
+    ck_assert_uint_eq(l1_chunk_meta[i], 0);
+  }
+
+  l1_deinit();
+}
+END_TEST
+
+/* Test that small regions take one chunk and that invalid frees are caught */
+START_TEST(chunk_malloc_test_4)
+{
+  l1_init = l1_chunk_init;
+  l1_deinit = l1_chunk_deinit;
+  l1_malloc = l1_chunk_malloc;
+  l1_free = l1_chunk_free;
+
+  l1_init();
+
+  /* Without header chunks, the arena holds one small region per chunk */
+  static int *ints[CHUNK_ARENA_LENGTH];
+  for (size_t i = 0; i < CHUNK_ARENA_LENGTH; i++)
+  {
+    ints[i] = l1_malloc(sizeof(int));
+    ck_assert_ptr_eq(ints[i], &l1_chunk_arena[i]);
+    *ints[i] = i;
+  }
+  ck_assert_ptr_eq(l1_malloc(sizeof(int)), NULL);
+  ck_assert_int_eq(*ints[CHUNK_ARENA_LENGTH - 1], CHUNK_ARENA_LENGTH - 1);
+
+  for (size_t i = 0; i < CHUNK_ARENA_LENGTH; i++)
+  {
+    ck_assert_int_eq((int)SUCCESS, (int)l1_free(ints[i]));
+  }
+
+  /* Pointers inside a region, off the arena or freed twice are rejected */
+  char *region = l1_malloc(3 * CHUNK_SIZE);
+  ck_assert_ptr_ne(region, NULL);
+  ck_assert_int_eq((int)ERRINVAL, (int)l1_free(region + 8));
+  ck_assert_int_eq((int)ERRINVAL, (int)l1_free(region + CHUNK_SIZE));
+  ck_assert_int_eq((int)ERRINVAL, (int)l1_free((char *)l1_chunk_arena + ALLOC8R_HEAP_SIZE));
+  ck_assert_int_eq((int)ERRINVAL, (int)l1_free(&region));
+  ck_assert_int_eq((int)SUCCESS, (int)l1_free(region));
+  ck_assert_int_eq((int)ERRINVAL, (int)l1_free(region));
+  for (size_t i = 0; i < CHUNK_META_LENGTH; i++)
+  {
+    ck_assert_uint_eq(l1_chunk_meta[i], 0);
   }
 
   l1_deinit();
@@ -248,6 +342,8 @@ int main(int argc, char **argv)
 
   tcase_add_test(tc1, chunk_malloc_test_1);
   tcase_add_test(tc1, chunk_malloc_test_2);
+  tcase_add_test(tc1, chunk_malloc_test_3);
+  tcase_add_test(tc1, chunk_malloc_test_4);
 
   tcase_add_test(tc1, list_malloc_test1);
   tcase_add_test(tc1, list_malloc_test2);
@@ -5,12 +5,27 @@
  * @author Mark Sutherland
  */
 #include <check.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "chan.h"
+#include "coro.h"
+#include "event_loop.h"
 #include "malloc.h"
+#include "preempt.h"
 #include "schedule.h"
 #include "sched_policy.h"
+#include "sim.h"
+#include "stack_usage.h"
+#include "stats.h"
+#include "sync.h"
+#include "task_group.h"
 #include "thread.h"
 #include "thread_info.h"
+#include "trace.h"
+#include "worker.h"
 
 /* Setting the allocator interface to libc. 
  * We will implement custom allocators in week 5 
@@ -90,13 +105,13 @@ void print_thread_list(l1_thread_list const *list)
     }
 }
 //=======================================================================================
-l1_thread_info *test_mlfq_policy(l1_thread_info *prev, l1_thread_info *next)
+l1_thread_info *test_mlfq_pick_next(l1_thread_info *prev)
 {
     l1_scheduler_info *sched = get_scheduler();
     printf("printing prev thread info:\n");
     print_thread_info(prev);
     print_thread_list(&sched->thread_arrays[RUNNABLE]);
-    l1_thread_info *real_next = l1_mlfq_policy(prev, next);
+    l1_thread_info *real_next = l1_mlfq_policy.pick_next(prev);
     if (real_next != NULL)
     {
         printf("printing next thread:\n");
@@ -106,6 +121,1261 @@ l1_thread_info *test_mlfq_policy(l1_thread_info *prev, l1_thread_info *next)
     printf("----------\n");
     return real_next;
 }
+
+/* MLFQ with traces of every decision */
+sched_policy test_mlfq_policy;
+//=======================================================================================
+START_TEST(mlfq_highest_level_first)
+{
+    initialize_scheduler(&l1_mlfq_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    l1_thread_info *threads[4];
+    const l1_priority levels[4] = {3, 7, 3, 7};
+    for (int i = 0; i < 4; i++)
+    {
+        l1_tid tid;
+        ck_assert_int_eq(l1_thread_create(&tid, is_bar, "bar"), SUCCESS);
+        threads[i] = thread_list_find(&sched->thread_arrays[RUNNABLE], tid);
+        l1_mlfq_policy.dequeue(threads[i]);
+        threads[i]->priority_level = levels[i];
+        l1_mlfq_policy.enqueue(threads[i]);
+    }
+
+    /* FIFO order within the highest level */
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[1]);
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[3]);
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[0]);
+
+    /* Period wrap: the waiting head of level 3 gets promoted */
+    sched->sched_ticks = 0;
+    l1_mlfq_policy.tick(sched->tsys);
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[2]);
+    ck_assert_int_eq(threads[2]->priority_level, 4);
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), NULL);
+
+    /* A head that already ran does not hold back the threads behind it,
+     * even while a higher level always has a thread to run */
+    for (int i = 0; i < 3; i++)
+    {
+        threads[i]->priority_level = 3;
+        threads[i]->got_scheduled = (i == 0);
+        l1_mlfq_policy.enqueue(threads[i]);
+    }
+    l1_mlfq_policy.enqueue(threads[3]);
+    sched->sched_ticks = 0;
+    l1_mlfq_policy.tick(sched->tsys);
+    for (int i = 0; i < 3; i++)
+    {
+        ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[3]);
+        l1_mlfq_policy.enqueue(threads[3]);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        ck_assert_int_eq(threads[i]->priority_level, 4);
+    }
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[3]);
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[0]);
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[1]);
+    ck_assert_ptr_eq(l1_mlfq_policy.pick_next(sched->tsys), threads[2]);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+START_TEST(fair_share_smallest_vruntime_first)
+{
+    initialize_scheduler(&l1_fair_share_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    l1_thread_info *threads[3];
+    const uint64_t vruntimes[3] = {5 * FAIR_WAKEUP_CREDIT, FAIR_WAKEUP_CREDIT, 3 * FAIR_WAKEUP_CREDIT};
+    for (int i = 0; i < 3; i++)
+    {
+        l1_tid tid;
+        ck_assert_int_eq(l1_thread_create(&tid, is_bar, "bar"), SUCCESS);
+        threads[i] = thread_list_find(&sched->thread_arrays[RUNNABLE], tid);
+        l1_fair_share_policy.dequeue(threads[i]);
+        threads[i]->vruntime = vruntimes[i];
+        l1_fair_share_policy.enqueue(threads[i]);
+    }
+
+    ck_assert_ptr_eq(l1_fair_share_policy.pick_next(sched->tsys), threads[1]);
+    ck_assert_ptr_eq(l1_fair_share_policy.pick_next(sched->tsys), threads[2]);
+    ck_assert_ptr_eq(l1_fair_share_policy.pick_next(sched->tsys), threads[0]);
+
+    /* A newcomer starts close to the others instead of at 0 */
+    l1_tid tid;
+    ck_assert_int_eq(l1_thread_create(&tid, is_bar, "bar"), SUCCESS);
+    l1_thread_info *late = thread_list_find(&sched->thread_arrays[RUNNABLE], tid);
+    ck_assert_uint_ge(late->vruntime, 4 * FAIR_WAKEUP_CREDIT);
+    ck_assert_ptr_eq(l1_fair_share_policy.pick_next(sched->tsys), late);
+    ck_assert_ptr_eq(l1_fair_share_policy.pick_next(sched->tsys), NULL);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static void *deadline_resetter(void *arg)
+{
+    /* Retires the creation deadline in time, then clears a new one */
+    l1_thread_set_deadline(L1_NSEC_PER_SEC);
+    l1_thread_set_deadline(0);
+    return NULL;
+}
+
+START_TEST(edf_earliest_deadline_first)
+{
+    initialize_scheduler(&l1_edf_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert_int_eq(l1_thread_set_deadline(L1_NSEC_PER_MSEC), ERRINVAL);
+    l1_thread_info *threads[4];
+    const l1_time deadlines[4] = {30 * L1_NSEC_PER_MSEC, 0, 10 * L1_NSEC_PER_MSEC, 20 * L1_NSEC_PER_MSEC};
+    for (int i = 0; i < 4; i++)
+    {
+        l1_tid tid;
+        ck_assert_int_eq(l1_thread_create_with_deadline(&tid, deadlines[i], is_bar, "bar"), SUCCESS);
+        threads[i] = thread_list_find(&sched->thread_arrays[RUNNABLE], tid);
+    }
+    /* The thread without a deadline runs last */
+    ck_assert_ptr_eq(l1_edf_policy.pick_next(sched->tsys), threads[2]);
+    ck_assert_ptr_eq(l1_edf_policy.pick_next(sched->tsys), threads[3]);
+    ck_assert_ptr_eq(l1_edf_policy.pick_next(sched->tsys), threads[0]);
+    ck_assert_ptr_eq(l1_edf_policy.pick_next(sched->tsys), threads[1]);
+    ck_assert_ptr_eq(l1_edf_policy.pick_next(sched->tsys), NULL);
+    clean_up_scheduler();
+
+    /* One deadline missed at the return, two met */
+    initialize_scheduler(&l1_edf_policy);
+    l1_tid late, on_time;
+    ck_assert_int_eq(l1_thread_create_with_deadline(&late, 1, is_bar, "bar"), SUCCESS);
+    ck_assert_int_eq(l1_thread_create_with_deadline(&on_time, L1_NSEC_PER_SEC, deadline_resetter, NULL), SUCCESS);
+    schedule();
+    ck_assert_int_eq(l1_sched_stats()->deadlines, 3);
+    ck_assert_int_eq(l1_sched_stats()->deadline_misses, 1);
+    l1_thread_stats stats;
+    ck_assert_int_eq(l1_thread_get_stats(on_time, &stats), SUCCESS);
+    ck_assert_int_eq(stats.deadlines, 2);
+    ck_assert_int_eq(stats.deadline_misses, 0);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+START_TEST(classes_run_in_strict_priority_under_caps)
+{
+    l1_sched_class_tunables defaults[L1_SCHED_CLASSES];
+    memcpy(defaults, l1_sched_class_params, sizeof(defaults));
+    l1_sched_class_params[L1_CLASS_REALTIME].policy = &l1_round_robin_policy;
+    l1_sched_class_params[L1_CLASS_REALTIME].cap = 50;
+    initialize_scheduler(&l1_class_policy);
+    memcpy(l1_sched_class_params, defaults, sizeof(defaults));
+    l1_scheduler_info *sched = get_scheduler();
+
+    l1_thread_attr attr = {.sched_class = L1_SCHED_CLASSES};
+    l1_tid tid;
+    ck_assert_int_eq(l1_thread_create_attr(&tid, &attr, is_bar, "bar"), ERRINVAL);
+    const l1_sched_class classes[4] = {L1_CLASS_BATCH, L1_CLASS_INTERACTIVE, L1_CLASS_REALTIME, L1_CLASS_REALTIME};
+    l1_thread_info *threads[4];
+    for (int i = 0; i < 4; i++)
+    {
+        attr.sched_class = classes[i];
+        ck_assert_int_eq(l1_thread_create_attr(&tid, &attr, is_bar, "bar"), SUCCESS);
+        threads[i] = thread_list_find(&sched->thread_arrays[RUNNABLE], tid);
+    }
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), threads[2]);
+
+    /* Realtime ran 60% of the period, over its cap: the others go first */
+    threads[2]->slice_start = sched->tsys->slice_end;
+    threads[2]->slice_end = threads[2]->slice_start + 60 * L1_CLASS_PERIOD / 100;
+    l1_class_policy.tick(threads[2]);
+    l1_class_policy.enqueue(threads[2]);
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), threads[1]);
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), threads[0]);
+    /* Then the throttled class rather than nothing */
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), threads[3]);
+
+    /* A new period lifts the cap */
+    l1_class_policy.enqueue(threads[1]);
+    sched->tsys->slice_end = threads[2]->slice_end + L1_CLASS_PERIOD;
+    l1_class_policy.tick(sched->tsys);
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), threads[2]);
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), threads[1]);
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), NULL);
+
+    /* Dequeue reaches the class of the thread */
+    l1_class_policy.enqueue(threads[0]);
+    l1_class_policy.dequeue(threads[0]);
+    ck_assert_ptr_eq(l1_class_policy.pick_next(sched->tsys), NULL);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+START_TEST(round_robin_and_smallest_cycles_order)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    l1_thread_info *threads[3];
+    for (int i = 0; i < 3; i++)
+    {
+        l1_tid tid;
+        ck_assert_int_eq(l1_thread_create(&tid, is_bar, "bar"), SUCCESS);
+        threads[i] = thread_list_find(&sched->thread_arrays[RUNNABLE], tid);
+    }
+    ck_assert_ptr_eq(l1_round_robin_policy.pick_next(sched->tsys), threads[0]);
+    l1_round_robin_policy.dequeue(threads[1]);
+    ck_assert_ptr_eq(l1_round_robin_policy.pick_next(sched->tsys), threads[2]);
+    ck_assert_ptr_eq(l1_round_robin_policy.pick_next(sched->tsys), NULL);
+    clean_up_scheduler();
+
+    initialize_scheduler(&l1_smallest_cycles_policy);
+    sched = get_scheduler();
+    const l1_time cycles[3] = {7, 3, 5};
+    for (int i = 0; i < 3; i++)
+    {
+        l1_tid tid;
+        ck_assert_int_eq(l1_thread_create(&tid, is_bar, "bar"), SUCCESS);
+        threads[i] = thread_list_find(&sched->thread_arrays[RUNNABLE], tid);
+        l1_smallest_cycles_policy.dequeue(threads[i]);
+        threads[i]->total_time = cycles[i];
+        l1_smallest_cycles_policy.enqueue(threads[i]);
+    }
+    ck_assert_ptr_eq(l1_smallest_cycles_policy.pick_next(sched->tsys), threads[1]);
+    ck_assert_ptr_eq(l1_smallest_cycles_policy.pick_next(sched->tsys), threads[2]);
+    ck_assert_ptr_eq(l1_smallest_cycles_policy.pick_next(sched->tsys), threads[0]);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static volatile int spinner_released;
+static volatile int spinner_saw_release;
+
+/* Never yields, gives up after a second so that a broken tick cannot hang the test */
+static void *spin_until_released(void *arg)
+{
+    l1_time start, now, spent;
+    l1_time_get(&start);
+    do
+    {
+        l1_time_get(&now);
+        l1_time_diff(&spent, now, start);
+    } while (!spinner_released && l1_time_is_smaller(spent, L1_NSEC_PER_SEC));
+    spinner_saw_release = spinner_released;
+    return NULL;
+}
+
+static void *release_spinner(void *arg)
+{
+    spinner_released = 1;
+    return NULL;
+}
+
+START_TEST(async_preemption_unsticks_spinner)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    ck_assert_int_eq(l1_preempt_start(L1_PREEMPT_ASYNC), SUCCESS);
+    ck_assert_uint_ge(get_scheduler()->stack_capacity, l1_preempt_stack_capacity());
+
+    l1_tid tid;
+    ck_assert_int_eq(l1_thread_create(&tid, spin_until_released, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&tid, release_spinner, NULL), SUCCESS);
+    schedule();
+    l1_preempt_stop();
+
+    ck_assert_int_eq(spinner_saw_release, 1);
+    ck_assert_uint_gt(get_scheduler()->preemptions, 0);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+/* Like spin_until_released, but gives the tick a safe point to switch at */
+static void *deferred_spinner(void *arg)
+{
+    l1_time start, now, spent;
+    l1_time_get(&start);
+    do
+    {
+        l1_preempt_point();
+        l1_time_get(&now);
+        l1_time_diff(&spent, now, start);
+    } while (!spinner_released && l1_time_is_smaller(spent, L1_NSEC_PER_SEC));
+    spinner_saw_release = spinner_released;
+    return NULL;
+}
+
+START_TEST(deferred_preemption_switches_at_safe_points)
+{
+    spinner_released = spinner_saw_release = 0;
+    initialize_scheduler(&l1_round_robin_policy);
+    ck_assert_int_eq(l1_preempt_start(L1_PREEMPT_DEFERRED), SUCCESS);
+    /* The handler runs on the green stacks in this mode as well */
+    ck_assert_uint_ge(get_scheduler()->stack_capacity, l1_preempt_stack_capacity());
+
+    l1_tid tid;
+    ck_assert_int_eq(l1_thread_create(&tid, deferred_spinner, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&tid, release_spinner, NULL), SUCCESS);
+    l1_thread_attr attr = L1_THREAD_ATTR_DEFAULT;
+    attr.stack_capacity = MIN_STACK_CAPACITY;
+    ck_assert_int_eq(l1_thread_create_attr(&tid, &attr, release_spinner, NULL), ERRINVAL);
+    schedule();
+    l1_preempt_stop();
+
+    ck_assert_int_eq(spinner_saw_release, 1);
+    ck_assert_uint_gt(get_scheduler()->preemptions, 0);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+/* Binary fork-join tree, returns its number of leaves */
+static void *count_leaves(void *arg)
+{
+    intptr_t depth = (intptr_t)arg;
+    if (depth == 0)
+        return (void *)1;
+    l1_tid left, right;
+    void *left_ret = NULL, *right_ret = NULL;
+    if (l1_thread_create(&left, count_leaves, (void *)(depth - 1)) != SUCCESS ||
+        l1_thread_create(&right, count_leaves, (void *)(depth - 1)) != SUCCESS ||
+        l1_thread_join(left, &left_ret) != SUCCESS ||
+        l1_thread_join(right, &right_ret) != SUCCESS)
+        return NULL;
+    return (void *)((intptr_t)left_ret + (intptr_t)right_ret);
+}
+
+START_TEST(work_stealing_joins_across_workers)
+{
+    initialize_scheduler(&l1_mlfq_policy);
+    ck_assert_int_eq(l1_workers_run(2), ERRINVAL);
+    clean_up_scheduler();
+
+    initialize_scheduler(&l1_work_stealing_policy);
+    l1_tid tid;
+    ck_assert_int_eq(l1_thread_create(&tid, count_leaves, (void *)6), SUCCESS);
+    ck_assert_int_eq(l1_workers_run(4), SUCCESS);
+
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert(thread_list_is_empty(&sched->thread_arrays[RUNNABLE]));
+    ck_assert(thread_list_is_empty(&sched->thread_arrays[BLOCKED]));
+    l1_thread_info *root = thread_list_find(&sched->thread_arrays[ZOMBIE], tid);
+    ck_assert_ptr_ne(root, NULL);
+    ck_assert_int_eq((intptr_t)root->retval, 64);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static int io_pipe[2];
+static char io_received[8];
+static l1_time io_slept;
+
+static void *pipe_reader(void *arg)
+{
+    ssize_t n = l1_read(io_pipe[0], io_received, sizeof(io_received) - 1);
+    return (void *)n;
+}
+
+static void *sleepy_writer(void *arg)
+{
+    l1_time start, end;
+    l1_time_get(&start);
+    l1_sleep(2 * L1_NSEC_PER_MSEC);
+    l1_time_get(&end);
+    l1_time_diff(&io_slept, end, start);
+    return (void *)l1_write(io_pipe[1], "ping", 4);
+}
+
+START_TEST(event_loop_parks_readers_and_sleepers)
+{
+    ck_assert_int_eq(pipe(io_pipe), 0);
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_tid reader, writer;
+    ck_assert_int_eq(l1_thread_create(&reader, pipe_reader, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&writer, sleepy_writer, NULL), SUCCESS);
+    /* Both threads block at some point, schedule must wait for them */
+    schedule();
+
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert(thread_list_is_empty(&sched->thread_arrays[BLOCKED]));
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], reader)->retval, 4);
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], writer)->retval, 4);
+    ck_assert_str_eq(io_received, "ping");
+    ck_assert(!l1_time_is_smaller(io_slept, 2 * L1_NSEC_PER_MSEC));
+    clean_up_scheduler();
+    l1_close(io_pipe[0]);
+    l1_close(io_pipe[1]);
+}
+END_TEST
+//=======================================================================================
+static l1_notifier notified;
+static volatile int notified_value;
+
+static void *late_signaler(void *arg)
+{
+    usleep(20000);
+    notified_value = 42;
+    l1_notifier_signal(&notified);
+    return NULL;
+}
+
+static void *notified_waiter(void *arg)
+{
+    /* A signal sent while nobody waits is kept for the next wait */
+    l1_notifier_signal(&notified);
+    l1_notifier_wait(&notified);
+    l1_notifier_wait(&notified);
+    return (void *)(intptr_t)notified_value;
+}
+
+START_TEST(notifier_wakes_threads_from_other_os_threads)
+{
+    l1_notifier_init(&notified);
+    notified_value = 0;
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_tid waiter;
+    ck_assert_int_eq(l1_thread_create(&waiter, notified_waiter, NULL), SUCCESS);
+    pthread_t signaler;
+    ck_assert_int_eq(pthread_create(&signaler, NULL, late_signaler, NULL), 0);
+    /* Nothing is runnable for 20 ms, schedule must sleep instead of returning */
+    schedule();
+    pthread_join(signaler, NULL);
+
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert(thread_list_is_empty(&sched->thread_arrays[BLOCKED]));
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], waiter)->retval, 42);
+    ck_assert(!l1_event_loop_has_waiters());
+    /* Parked, not polled: one switch for the first wait, one to wake up */
+    ck_assert_uint_le(l1_sched_stats()->switches, 3);
+    clean_up_scheduler();
+    l1_notifier_destroy(&notified);
+}
+END_TEST
+//=======================================================================================
+static l1_tid timer_order[3];
+static int timer_order_len;
+
+static void *sleeper(void *arg)
+{
+    l1_sleep((l1_time)(intptr_t)arg * L1_NSEC_PER_MSEC);
+    timer_order[timer_order_len++] = get_scheduler()->current->id;
+    return NULL;
+}
+
+static void *impatient_joiner(void *arg)
+{
+    l1_tid target = (l1_tid)(intptr_t)arg;
+    l1_error timed_out = l1_thread_join_timeout(target, NULL, L1_NSEC_PER_MSEC);
+    l1_error joined = l1_thread_join_timeout(target, NULL, 100 * L1_NSEC_PER_MSEC);
+    return (void *)(intptr_t)(timed_out * 100 + joined);
+}
+
+START_TEST(timer_wheel_sleep_and_join_timeout)
+{
+    /* Far timers sit in the upper levels and cascade down in order */
+    l1_timer_wheel wheel;
+    l1_timer timers[3];
+    memset(timers, 0, sizeof(timers));
+    timer_wheel_init(&wheel, 0);
+    timer_wheel_add(&wheel, &timers[0], 5000 * TIMER_WHEEL_TICK);
+    timer_wheel_add(&wheel, &timers[1], 10 * TIMER_WHEEL_TICK);
+    timer_wheel_add(&wheel, &timers[2], 300000 * TIMER_WHEEL_TICK);
+    ck_assert(!l1_time_is_smaller(10 * TIMER_WHEEL_TICK, timer_wheel_next_expiry(&wheel)));
+    ck_assert_ptr_eq(timer_wheel_expire(&wheel, 9 * TIMER_WHEEL_TICK), NULL);
+    ck_assert_ptr_eq(timer_wheel_expire(&wheel, 10 * TIMER_WHEEL_TICK), &timers[1]);
+    ck_assert(!l1_time_is_smaller(5000 * TIMER_WHEEL_TICK, timer_wheel_next_expiry(&wheel)));
+    timer_wheel_cancel(&wheel, &timers[0]);
+    ck_assert_ptr_eq(timer_wheel_expire(&wheel, 299999 * TIMER_WHEEL_TICK), NULL);
+    l1_timer *last = timer_wheel_expire(&wheel, 300000 * TIMER_WHEEL_TICK);
+    ck_assert_ptr_eq(last, &timers[2]);
+    ck_assert_ptr_eq(last->next, NULL);
+    ck_assert(timer_wheel_is_empty(&wheel));
+
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_tid slow, fast, medium, joiner;
+    timer_order_len = 0;
+    ck_assert_int_eq(l1_thread_create(&slow, sleeper, (void *)6), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&fast, sleeper, (void *)2), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&medium, sleeper, (void *)4), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&joiner, impatient_joiner, (void *)(intptr_t)slow), SUCCESS);
+    schedule();
+
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert_int_eq(timer_order_len, 3);
+    ck_assert_int_eq(timer_order[0], fast);
+    ck_assert_int_eq(timer_order[1], medium);
+    ck_assert_int_eq(timer_order[2], slow);
+    l1_thread_info *waited = thread_list_find(&sched->thread_arrays[ZOMBIE], joiner);
+    ck_assert_int_eq((intptr_t)waited->retval, ERRTIMEDOUT * 100 + SUCCESS);
+    ck_assert(timer_wheel_is_empty(&sched->timers));
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static l1_mutex sync_mutex;
+static l1_cond sync_not_empty;
+static l1_sem sync_slots;
+static int sync_counter;
+static l1_tid sync_order[4];
+static int sync_order_len;
+static int sync_queue[4];
+static int sync_queue_len;
+
+static void *mutex_incrementer(void *arg)
+{
+    for (int i = 0; i < 50; i++)
+    {
+        l1_mutex_lock(&sync_mutex);
+        int seen = sync_counter;
+        /* Everybody else queues up behind us */
+        yield(-1);
+        sync_counter = seen + 1;
+        l1_mutex_unlock(&sync_mutex);
+    }
+    return NULL;
+}
+
+static void *mutex_waiter(void *arg)
+{
+    l1_mutex_lock(&sync_mutex);
+    sync_order[sync_order_len++] = get_scheduler()->current->id;
+    l1_mutex_unlock(&sync_mutex);
+    return NULL;
+}
+
+static void *mutex_holder(void *arg)
+{
+    l1_tid *tids = arg;
+    l1_mutex_lock(&sync_mutex);
+    for (int i = 0; i < 4; i++)
+    {
+        l1_thread_create(&tids[i], mutex_waiter, NULL);
+    }
+    /* Let all of them queue up */
+    yield(-1);
+    intptr_t queued = (sync_order_len == 0 && sync_mutex.state == L1_MUTEX_CONTENDED);
+    l1_mutex_unlock(&sync_mutex);
+    return (void *)queued;
+}
+
+static void *producer(void *arg)
+{
+    for (int i = 1; i <= 20; i++)
+    {
+        l1_sem_wait(&sync_slots);
+        l1_mutex_lock(&sync_mutex);
+        sync_queue[sync_queue_len++] = i;
+        l1_cond_signal(&sync_not_empty);
+        l1_mutex_unlock(&sync_mutex);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    intptr_t sum = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        l1_mutex_lock(&sync_mutex);
+        while (sync_queue_len == 0)
+        {
+            l1_cond_wait(&sync_not_empty, &sync_mutex);
+        }
+        sum += sync_queue[0];
+        sync_queue_len--;
+        memmove(sync_queue, sync_queue + 1, sync_queue_len * sizeof(int));
+        l1_mutex_unlock(&sync_mutex);
+        l1_sem_post(&sync_slots);
+    }
+    return (void *)sum;
+}
+
+START_TEST(sync_primitives_hand_off_in_order)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_mutex_init(&sync_mutex);
+    sync_counter = 0;
+    l1_tid tids[4];
+    for (int i = 0; i < 4; i++)
+    {
+        ck_assert_int_eq(l1_thread_create(&tids[i], mutex_incrementer, NULL), SUCCESS);
+    }
+    schedule();
+    ck_assert_int_eq(sync_counter, 200);
+    ck_assert_int_eq(sync_mutex.state, L1_MUTEX_UNLOCKED);
+    clean_up_scheduler();
+
+    /* Waiters get the mutex in arrival order */
+    initialize_scheduler(&l1_round_robin_policy);
+    sync_order_len = 0;
+    l1_tid holder;
+    ck_assert_int_eq(l1_thread_create(&holder, mutex_holder, tids), SUCCESS);
+    schedule();
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], holder)->retval, 1);
+    ck_assert_int_eq(sync_order_len, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        ck_assert_int_eq(sync_order[i], tids[i]);
+    }
+    clean_up_scheduler();
+
+    /* Bounded buffer with a condition variable and a semaphore */
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_cond_init(&sync_not_empty);
+    l1_sem_init(&sync_slots, 4);
+    sync_queue_len = 0;
+    l1_tid prod, cons;
+    ck_assert_int_eq(l1_thread_create(&cons, consumer, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&prod, producer, NULL), SUCCESS);
+    schedule();
+    sched = get_scheduler();
+    ck_assert(thread_list_is_empty(&sched->thread_arrays[BLOCKED]));
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], cons)->retval, 210);
+    ck_assert_int_eq(sync_slots.count, 4);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static l1_chan chan_numbers, chan_squares, chan_words;
+
+static void *squarer(void *arg)
+{
+    int n;
+    while (l1_chan_recv(&chan_numbers, &n) == SUCCESS)
+    {
+        int square = n * n;
+        l1_chan_send(&chan_squares, &square);
+    }
+    l1_chan_close(&chan_squares);
+    return NULL;
+}
+
+static void *word_sender(void *arg)
+{
+    const char *word = "done";
+    l1_chan_send(&chan_words, &word);
+    return NULL;
+}
+
+static void *chan_selector(void *arg)
+{
+    intptr_t sum = 0, words = 0;
+    int square;
+    const char *word;
+    l1_chan_case cases[] = {{&chan_squares, L1_CHAN_RECV, &square}, {&chan_words, L1_CHAN_RECV, &word}};
+    for (;;)
+    {
+        int fired = l1_chan_select(cases, 2, true);
+        if (fired == 1)
+        {
+            words++;
+        }
+        else if (cases[0].err == ERRCLOSED)
+        {
+            break;
+        }
+        else
+        {
+            sum += square;
+        }
+    }
+    return (void *)(sum * 10 + words);
+}
+
+START_TEST(channels_pipeline_and_select)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    ck_assert_int_eq(l1_chan_init(&chan_numbers, sizeof(int), L1_CHAN_UNBOUNDED), SUCCESS);
+    ck_assert_int_eq(l1_chan_init(&chan_squares, sizeof(int), 0), SUCCESS);
+    ck_assert_int_eq(l1_chan_init(&chan_words, sizeof(char *), 2), SUCCESS);
+    /* tsys never waits on an unbounded channel, which grows past its ring */
+    for (int i = 1; i <= 100; i++)
+    {
+        ck_assert_int_eq(l1_chan_send(&chan_numbers, &i), SUCCESS);
+    }
+    ck_assert_int_eq(chan_numbers.len, 100);
+    ck_assert_int_eq(l1_chan_close(&chan_numbers), SUCCESS);
+    ck_assert_int_eq(l1_chan_close(&chan_numbers), ERRINVAL);
+    int zero = 0;
+    ck_assert_int_eq(l1_chan_send(&chan_numbers, &zero), ERRCLOSED);
+
+    l1_tid selector, squarer_tid, sender;
+    ck_assert_int_eq(l1_thread_create(&selector, chan_selector, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&squarer_tid, squarer, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&sender, word_sender, NULL), SUCCESS);
+    schedule();
+
+    /* Sum of the squares of 1..100 */
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert(thread_list_is_empty(&sched->thread_arrays[BLOCKED]));
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], selector)->retval, 3383501);
+    int n = -1;
+    ck_assert_int_eq(l1_chan_recv(&chan_numbers, &n), ERRCLOSED);
+    ck_assert_int_eq(n, 0);
+    const char *word = NULL;
+    l1_chan_case empty[] = {{&chan_words, L1_CHAN_RECV, &word}};
+    ck_assert_int_eq(l1_chan_select(empty, 1, false), -1);
+    l1_chan_destroy(&chan_numbers);
+    l1_chan_destroy(&chan_squares);
+    l1_chan_destroy(&chan_words);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static l1_future tg_start;
+
+static void *tg_square(void *arg)
+{
+    intptr_t n = (intptr_t)arg;
+    /* Finish in reverse order of creation */
+    for (intptr_t i = n; i < 10; i++)
+    {
+        yield(-1);
+    }
+    return (void *)(n * n);
+}
+
+static void *tg_awaiter(void *arg)
+{
+    void *value;
+    l1_future_await(&tg_start, &value);
+    return value;
+}
+
+static void *tg_parent(void *arg)
+{
+    l1_task_group group;
+    l1_task_group_init(&group);
+    l1_future futures[10];
+    for (intptr_t i = 0; i < 10; i++)
+    {
+        l1_future_init(&futures[i]);
+        l1_task_group_spawn(&group, NULL, &futures[i], tg_square, (void *)i);
+    }
+    intptr_t sum = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        void *value;
+        l1_future_await(&futures[i], &value);
+        sum += (intptr_t)value;
+    }
+    intptr_t freed = l1_task_group_wait_all(&group);
+
+    /* Collected in completion order */
+    l1_tid tids[3], first;
+    void *retval;
+    for (intptr_t i = 0; i < 3; i++)
+    {
+        l1_task_group_spawn(&group, &tids[i], NULL, tg_square, (void *)(7 + i));
+    }
+    /* A running group child cannot be joined */
+    intptr_t unjoinable = (l1_thread_join(tids[0], NULL) == ERRINVAL);
+    l1_task_group_wait_any(&group, &first, &retval);
+    intptr_t ordered = unjoinable && (first == tids[2] && (intptr_t)retval == 81);
+    ordered &= (l1_task_group_wait_any(&group, NULL, NULL) == SUCCESS);
+    ordered &= (l1_task_group_wait_any(&group, NULL, NULL) == SUCCESS);
+    ordered &= (l1_task_group_wait_any(&group, NULL, NULL) == ERRINVAL);
+    return (void *)(sum * 100 + freed * 10 + ordered);
+}
+
+START_TEST(task_groups_collect_children_in_batches)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_future_init(&tg_start);
+    l1_tid parent, awaiters[2];
+    ck_assert_int_eq(l1_thread_create(&parent, tg_parent, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&awaiters[0], tg_awaiter, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&awaiters[1], tg_awaiter, NULL), SUCCESS);
+    schedule();
+    /* The awaiters are still blocked on the future */
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert_int_eq(sched->thread_arrays[BLOCKED].size, 2);
+    ck_assert_int_eq(l1_future_set(&tg_start, (void *)42), SUCCESS);
+    ck_assert_int_eq(l1_future_set(&tg_start, (void *)43), ERRINVAL);
+    schedule();
+
+    /* Only the threads created with l1_thread_create are zombies */
+    ck_assert_int_eq(sched->thread_arrays[ZOMBIE].size, 3);
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], parent)->retval, 28500 + 100 + 1);
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], awaiters[0])->retval, 42);
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], awaiters[1])->retval, 42);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static int detached_ran;
+
+static void *detached_worker(void *arg)
+{
+    detached_ran++;
+    yield(-1);
+    return NULL;
+}
+
+static void *detacher(void *arg)
+{
+    l1_tid tid;
+    l1_thread_create(&tid, detached_worker, NULL);
+    intptr_t ok = (l1_thread_detach(tid) == SUCCESS);
+    ok &= (l1_thread_detach(tid) == ERRINVAL);
+    /* A detached thread cannot be joined */
+    ok &= (l1_thread_join(tid, NULL) == ERRINVAL);
+    return (void *)ok;
+}
+
+START_TEST(detached_threads_are_released_on_return)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    detached_ran = 0;
+    l1_thread_attr attr = {.detached = true};
+    l1_tid tid;
+    for (int i = 0; i < 2 * THREAD_CACHE_SIZE; i++)
+    {
+        ck_assert_int_eq(l1_thread_create_attr(&tid, &attr, detached_worker, NULL), SUCCESS);
+    }
+    l1_tid joined, zombie, other;
+    ck_assert_int_eq(l1_thread_create(&joined, detacher, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&zombie, detached_worker, NULL), SUCCESS);
+    schedule();
+    ck_assert_int_eq(detached_ran, 2 * THREAD_CACHE_SIZE + 2);
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], joined)->retval, 1);
+    ck_assert_int_eq(sched->thread_arrays[ZOMBIE].size, 2);
+    ck_assert_int_eq(sched->thread_cache.size, THREAD_CACHE_SIZE);
+
+    /* Detaching a zombie releases it, and new threads reuse the cache */
+    ck_assert_int_eq(l1_thread_detach(zombie), SUCCESS);
+    ck_assert_int_eq(l1_thread_detach(zombie), ERRINVAL);
+    ck_assert_int_eq(sched->thread_arrays[ZOMBIE].size, 1);
+    l1_thread_info *cached = sched->thread_cache.head;
+    ck_assert_int_eq(l1_thread_create(&other, detached_worker, NULL), SUCCESS);
+    ck_assert_ptr_eq(thread_list_find(&sched->thread_arrays[RUNNABLE], other), cached);
+    schedule();
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static char task_trace[16];
+static int task_trace_len;
+
+static void *task_logger(void *arg)
+{
+    task_trace[task_trace_len++] = (char)(intptr_t)arg;
+    return arg;
+}
+
+static void *task_spawner(void *arg)
+{
+    l1_tid tid;
+    task_logger(arg);
+    /* Runs as tsys, nothing to yield to */
+    intptr_t ok = (get_scheduler()->current == get_scheduler()->tsys);
+    ok &= (l1_task_create(&tid, task_logger, (void *)'u') == SUCCESS);
+    return (void *)ok;
+}
+
+static void *task_thread(void *arg)
+{
+    task_logger(arg);
+    yield(-1);
+    task_logger(arg);
+    return NULL;
+}
+
+START_TEST(stackless_tasks_share_the_run_queue)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    task_trace_len = 0;
+    l1_future future;
+    l1_future_init(&future);
+    l1_thread_attr attr = {.stackless = true, .future = &future};
+    l1_tid thread, task;
+    ck_assert_int_eq(l1_thread_create(&thread, task_thread, (void *)'a'), SUCCESS);
+    ck_assert_int_eq(l1_thread_create_attr(&task, &attr, task_spawner, (void *)'t'), SUCCESS);
+    ck_assert_ptr_null(thread_list_find(&sched->thread_arrays[RUNNABLE], task)->thread_stack);
+    schedule();
+
+    /* Run in queue order, and released without ever becoming zombies */
+    task_trace[task_trace_len] = '\0';
+    ck_assert_str_eq(task_trace, "atau");
+    ck_assert(l1_future_is_ready(&future));
+    void *ok;
+    l1_future_await(&future, &ok);
+    ck_assert_int_eq((intptr_t)ok, 1);
+    ck_assert_int_eq(sched->thread_arrays[ZOMBIE].size, 1);
+    ck_assert_int_eq(sched->task_cache.size, 2);
+    ck_assert_int_eq(sched->thread_cache.size, 0);
+
+    /* New tasks reuse the cache */
+    l1_thread_info *cached = sched->task_cache.head;
+    ck_assert_int_eq(l1_task_create(&task, task_logger, (void *)'v'), SUCCESS);
+    ck_assert_ptr_eq(thread_list_find(&sched->thread_arrays[RUNNABLE], task), cached);
+    schedule();
+    ck_assert_int_eq(task_trace[4], 'v');
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static void *batch_doubler(void *arg)
+{
+    yield(-1);
+    return (void *)(2 * (intptr_t)arg);
+}
+
+static int batch_joined;
+
+static void *batch_joiner(void *arg)
+{
+    l1_tid *tids = arg;
+    for (int i = 0; i < 100; i++)
+    {
+        void *ret;
+        if (l1_thread_join(tids[i], &ret) == SUCCESS && (intptr_t)ret == 2 * i)
+        {
+            batch_joined++;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(create_many_runs_a_batch_of_threads)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    static l1_tid tids[100];
+    void *args[100];
+    for (int i = 0; i < 100; i++)
+    {
+        args[i] = (void *)(intptr_t)i;
+    }
+    l1_tid before, joiner;
+    ck_assert_int_eq(l1_thread_create(&before, is_bar, "bar"), SUCCESS);
+    ck_assert_int_eq(l1_thread_create_many(0, batch_doubler, args, tids), SUCCESS);
+    ck_assert_int_eq(l1_thread_create_many(100, batch_doubler, args, tids), SUCCESS);
+    ck_assert_int_eq(sched->thread_arrays[RUNNABLE].size, 101);
+    l1_thread_info *first = thread_list_find(&sched->thread_arrays[RUNNABLE], tids[0]);
+    for (int i = 0; i < 100; i++)
+    {
+        ck_assert_int_eq(tids[i], before + 1 + i);
+    }
+    /* One region, stacks written when the threads first run */
+    ck_assert_ptr_nonnull(first->batch);
+    ck_assert_int_eq(first->thread_stack->size, 0);
+    ck_assert_ptr_eq(first->next, first + 1);
+
+    batch_joined = 0;
+    ck_assert_int_eq(l1_thread_create(&joiner, batch_joiner, tids), SUCCESS);
+    schedule();
+    ck_assert_int_eq(batch_joined, 100);
+    /* Released into the batch, not the cache */
+    ck_assert_int_eq(sched->thread_cache.size, 0);
+    ck_assert_int_eq(sched->thread_arrays[ZOMBIE].size, 2);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+static void *coro_counter(void *arg)
+{
+    for (intptr_t i = 0; i < (intptr_t)arg; i++)
+    {
+        l1_coro_yield((void *)i);
+    }
+    return (void *)-1;
+}
+
+/* Yields the sums of pairs of values of a nested generator */
+static void *coro_pairs(void *arg)
+{
+    l1_coro *inner;
+    l1_coro_create(&inner, coro_counter, arg);
+    void *a, *b;
+    while (l1_coro_resume(inner, &a) == SUCCESS && l1_coro_resume(inner, &b) == SUCCESS &&
+           !l1_coro_is_done(inner))
+    {
+        l1_coro_yield((void *)((intptr_t)a + (intptr_t)b));
+        /* Suspends the whole green thread */
+        yield(-1);
+    }
+    l1_coro_destroy(inner);
+    return NULL;
+}
+
+static void *coro_thread(void *arg)
+{
+    l1_coro *coro;
+    l1_coro_create(&coro, coro_pairs, arg);
+    intptr_t sum = 0;
+    void *value;
+    while (l1_coro_resume(coro, &value) == SUCCESS && !l1_coro_is_done(coro))
+    {
+        sum = sum * 100 + (intptr_t)value;
+    }
+    l1_coro_destroy(coro);
+    return (void *)sum;
+}
+
+START_TEST(coroutines_switch_with_their_resumer)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    ck_assert_int_eq(l1_coro_yield(NULL), ERRINVAL);
+
+    /* Resumed by tsys */
+    l1_coro *coro;
+    void *value;
+    ck_assert_int_eq(l1_coro_create(&coro, coro_counter, (void *)2), SUCCESS);
+    ck_assert_int_eq(l1_coro_resume(coro, &value), SUCCESS);
+    ck_assert_int_eq((intptr_t)value, 0);
+    ck_assert_int_eq(l1_coro_resume(coro, &value), SUCCESS);
+    ck_assert_int_eq((intptr_t)value, 1);
+    ck_assert(!l1_coro_is_done(coro));
+    ck_assert_int_eq(l1_coro_resume(coro, &value), SUCCESS);
+    ck_assert_int_eq((intptr_t)value, -1);
+    ck_assert(l1_coro_is_done(coro));
+    ck_assert_int_eq(l1_coro_resume(coro, &value), ERRINVAL);
+    ck_assert_int_eq(l1_coro_destroy(coro), SUCCESS);
+    ck_assert_int_eq(sched->stack_cache_size, 1);
+
+    /* Nested in green threads that interleave */
+    l1_tid threads[2];
+    ck_assert_int_eq(l1_thread_create(&threads[0], coro_thread, (void *)6), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&threads[1], coro_thread, (void *)4), SUCCESS);
+    schedule();
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], threads[0])->retval, 10509);
+    ck_assert_int_eq((intptr_t)thread_list_find(&sched->thread_arrays[ZOMBIE], threads[1])->retval, 105);
+    ck_assert_ptr_null(sched->tsys->coro);
+
+    /* The stacks are pooled */
+    ck_assert_int_eq(l1_coro_create(&coro, coro_counter, NULL), SUCCESS);
+    ck_assert_ptr_nonnull(coro->stack);
+    ck_assert_int_eq(l1_coro_destroy(coro), SUCCESS);
+    ck_assert_int_eq(sched->stack_cache_size, 4);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+/* Counts the occurrences of needle in the file at path */
+static int count_in_file(const char *path, const char *needle)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    static char text[L1_TRACE_EVENTS * 128];
+    size_t len = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[len] = '\0';
+    int count = 0;
+    for (char *at = strstr(text, needle); at != NULL; at = strstr(at + 1, needle))
+    {
+        count++;
+    }
+    return count;
+}
+
+START_TEST(trace_buffers_dump_chrome_json)
+{
+    char path[] = "/tmp/l1_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+
+    l1_trace_clear();
+    l1_trace_record(L1_TRACE_SWITCH_IN, 7, 0);
+    l1_trace_record(L1_TRACE_BLOCK, 7, L1_WAIT_SYNC);
+    l1_trace_record(L1_TRACE_SWITCH_OUT, 7, BLOCKED);
+    l1_trace_record(L1_TRACE_UNBLOCK, 7, SUCCESS);
+    ck_assert_int_eq(l1_trace_dump(path), SUCCESS);
+    ck_assert_int_eq(count_in_file(path, "\"traceEvents\":["), 1);
+    ck_assert_int_eq(count_in_file(path, "\"tid\":7,"), 4);
+    ck_assert_int_eq(count_in_file(path, "\"ph\":\"B\""), 1);
+    ck_assert_int_eq(count_in_file(path, "\"ph\":\"E\""), 1);
+    ck_assert_int_eq(count_in_file(path, "\"name\":\"block\""), 1);
+
+    /* The ring keeps the newest events */
+    for (uint32_t i = 0; i < L1_TRACE_EVENTS; i++)
+    {
+        l1_trace_record(L1_TRACE_DEAD, 8, 0);
+    }
+    ck_assert_int_eq(l1_trace_dump(path), SUCCESS);
+    ck_assert_int_eq(count_in_file(path, "\"tid\":7,"), 0);
+    ck_assert_int_eq(count_in_file(path, "\"tid\":8,"), L1_TRACE_EVENTS);
+    l1_trace_clear();
+    ck_assert_int_eq(l1_trace_dump("/nonexistent/trace.json"), ERRINVAL);
+    unlink(path);
+}
+END_TEST
+//=======================================================================================
+static void *stats_yielder(void *arg)
+{
+    yield(-1);
+    yield(-1);
+    /* As if a tick asked for a switch */
+    get_scheduler()->need_resched = 1;
+    l1_preempt_point();
+    return NULL;
+}
+
+static void *stats_sleeper(void *arg)
+{
+    l1_sleep(2 * L1_NSEC_PER_MSEC);
+    return NULL;
+}
+
+START_TEST(stats_count_switches_and_latencies)
+{
+    l1_histogram histogram;
+    l1_histogram_init(&histogram);
+    ck_assert_int_eq(l1_histogram_quantile(&histogram, 0.5), 0);
+    for (uint64_t i = 1; i <= 1000; i++)
+    {
+        l1_histogram_record(&histogram, i);
+    }
+    ck_assert_int_eq(histogram.min, 1);
+    ck_assert_int_eq(l1_histogram_quantile(&histogram, 1.0), 1000);
+    ck_assert_int_ge(l1_histogram_quantile(&histogram, 0.5), 500);
+    ck_assert_int_le(l1_histogram_quantile(&histogram, 0.5), 500 * 17 / 16);
+    ck_assert_int_ge(l1_histogram_quantile(&histogram, 0.99), 990);
+    ck_assert_int_le(l1_histogram_quantile(&histogram, 0.99), 1000);
+
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_tid yielder, sleeper;
+    ck_assert_int_eq(l1_thread_create(&yielder, stats_yielder, NULL), SUCCESS);
+    ck_assert_int_eq(l1_thread_create(&sleeper, stats_sleeper, NULL), SUCCESS);
+    schedule();
+
+    l1_thread_stats stats;
+    ck_assert_int_eq(l1_thread_get_stats(yielder, &stats), SUCCESS);
+    ck_assert_int_eq(stats.switches, 4);
+    ck_assert_int_eq(stats.voluntary, 3);
+    ck_assert_int_eq(stats.involuntary, 1);
+    ck_assert_int_eq(l1_thread_get_stats(sleeper, &stats), SUCCESS);
+    ck_assert_int_eq(stats.switches, 2);
+    ck_assert_int_eq(stats.voluntary, 2);
+    ck_assert_int_ge(stats.blocked_time, 2 * L1_NSEC_PER_MSEC);
+    ck_assert_int_eq(l1_thread_get_stats(sleeper + 1, &stats), ERRINVAL);
+
+    const l1_sched_stats_info *sched = l1_sched_stats();
+    ck_assert_int_eq(sched->switches, 6);
+    ck_assert_int_eq(sched->runq_latency.count, 6);
+    ck_assert_int_eq(sched->slice_length.count, 6);
+
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    l1_sched_stats_dump(out);
+    fclose(out);
+    ck_assert_ptr_nonnull(strstr(json, "\"runq_latency\":{\"count\":6,"));
+    ck_assert_ptr_nonnull(strstr(json, "\"state\":\"zombie\""));
+    free(json);
+    clean_up_scheduler();
+}
+END_TEST
+//=======================================================================================
+START_TEST(simulator_replays_workloads_in_virtual_time)
+{
+    l1_sim_config config = {
+        .policy = &l1_round_robin_policy,
+        .sched_period = SCHED_PERIOD,
+        .preemptive = true,
+        .starvation = L1_NSEC_PER_MSEC,
+    };
+    /* Two CPU-bound tasks sharing 1 ms slices, and one joining the first */
+    l1_sim_task tasks[3] = {
+        {.cpu = 3 * L1_NSEC_PER_MSEC, .bursts = 1, .joins = -1, .priority = TOP_PRIORITY},
+        {.cpu = 3 * L1_NSEC_PER_MSEC, .bursts = 1, .joins = -1, .priority = TOP_PRIORITY},
+        {.cpu = L1_NSEC_PER_MSEC, .bursts = 1, .joins = 0, .priority = TOP_PRIORITY},
+    };
+    l1_sim_report report;
+    initialize_scheduler(&l1_round_robin_policy);
+    ck_assert_int_eq(l1_sim_run(&config, tasks, 2, &report), ERRINVAL);
+    clean_up_scheduler();
+
+    ck_assert_int_eq(l1_sim_run(&config, tasks, 2, &report), SUCCESS);
+    ck_assert_int_eq(report.finished, 2);
+    ck_assert_int_eq(report.switches, 6);
+    ck_assert_int_eq(report.makespan, 6 * L1_NSEC_PER_MSEC);
+    ck_assert_int_eq((uint64_t)report.mean_turnaround, 5500 * L1_NSEC_PER_USEC);
+    ck_assert_int_eq((uint64_t)report.mean_response, 500 * L1_NSEC_PER_USEC);
+    ck_assert_int_eq(report.max_wait, L1_NSEC_PER_MSEC);
+    ck_assert_int_eq(report.starved, 0);
+
+    /* The joiner completes with the task it joins */
+    ck_assert_int_eq(l1_sim_run(&config, tasks, 3, &report), SUCCESS);
+    ck_assert_int_eq(report.makespan, 7 * L1_NSEC_PER_MSEC);
+    ck_assert_int_eq(llround(3 * report.mean_turnaround), 19 * L1_NSEC_PER_MSEC);
+    ck_assert_int_eq(report.starved, 3);
+    tasks[0].joins = 1;
+    tasks[1].joins = 0;
+    ck_assert_int_eq(l1_sim_run(&config, tasks, 2, &report), ERRINVAL);
+    ck_assert_int_eq(report.finished, 0);
+
+    /* Reproducible */
+    static l1_sim_task workload[200];
+    l1_sim_report first;
+    l1_sim_generate(workload, 200, 42, 0.5, 2 * L1_NSEC_PER_MSEC);
+    config.policy = &l1_mlfq_policy;
+    ck_assert_int_eq(l1_sim_run(&config, workload, 200, &first), SUCCESS);
+    ck_assert_int_eq(first.finished, 200);
+    l1_sim_generate(workload, 200, 42, 0.5, 2 * L1_NSEC_PER_MSEC);
+    ck_assert_int_eq(l1_sim_run(&config, workload, 200, &report), SUCCESS);
+    ck_assert_int_eq(memcmp(&first, &report, sizeof(report)), 0);
+}
+END_TEST
+//=======================================================================================
+static void *stack_recurse(void *arg)
+{
+    volatile uint64_t frame[16];
+    intptr_t depth = (intptr_t)arg;
+    frame[0] = depth;
+    if (depth > 1)
+    {
+        stack_recurse((void *)(depth - 1));
+    }
+    return (void *)(intptr_t)frame[0];
+}
+
+START_TEST(stack_usage_records_high_water_marks)
+{
+    initialize_scheduler(&l1_round_robin_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    l1_stack_usage_clear();
+    l1_thread_attr attr = {.stack_capacity = 512};
+    l1_tid shallow, deep, tiny;
+    attr.stack_capacity = MIN_STACK_CAPACITY - 1;
+    ck_assert_int_eq(l1_thread_create_attr(&tiny, &attr, stack_recurse, (void *)1), ERRINVAL);
+    attr.stack_capacity = 512;
+    ck_assert_int_eq(l1_thread_create_attr(&shallow, &attr, stack_recurse, (void *)2), SUCCESS);
+    ck_assert_int_eq(l1_thread_create_attr(&deep, &attr, stack_recurse, (void *)8), SUCCESS);
+    l1_thread_info *threads[2] = {
+        thread_list_find(&sched->thread_arrays[RUNNABLE], shallow),
+        thread_list_find(&sched->thread_arrays[RUNNABLE], deep),
+    };
+    for (int i = 0; i < 2; i++)
+    {
+        /* What L1_STACK_USAGE does at creation and return */
+        ck_assert_int_eq(threads[i]->thread_stack->capacity, 512);
+        l1_stack_paint(threads[i]->thread_stack);
+        ck_assert_int_eq(l1_stack_high_water(threads[i]->thread_stack), 8 * sizeof(uint64_t));
+    }
+    schedule();
+    /* Already recorded with L1_STACK_USAGE */
+    l1_stack_usage_clear();
+    uint64_t used[2];
+    for (int i = 0; i < 2; i++)
+    {
+        used[i] = l1_stack_high_water(threads[i]->thread_stack);
+        l1_stack_usage_record(threads[i]->thread_func, threads[i]->thread_stack);
+    }
+    /* Six more frames of at least 16 words */
+    ck_assert_uint_ge(used[1], used[0] + 6 * 16 * sizeof(uint64_t));
+    ck_assert_uint_lt(used[1], 512 * sizeof(uint64_t));
+
+    l1_histogram usage;
+    ck_assert_int_eq(l1_stack_usage_get(stack_recurse, &usage), SUCCESS);
+    ck_assert_int_eq(usage.count, 2);
+    ck_assert_int_eq(usage.max, used[1]);
+    ck_assert_int_eq(l1_stack_usage_get(is_bar, &usage), ERRINVAL);
+    l1_stack_usage_clear();
+    ck_assert_int_eq(l1_stack_usage_get(stack_recurse, &usage), ERRINVAL);
+    clean_up_scheduler();
+}
+END_TEST
 //=======================================================================================
 int main(int argc, char **argv)
 {
@@ -113,12 +1383,35 @@ int main(int argc, char **argv)
     TCase *tc1 = tcase_create("basic");
     suite_add_tcase(s, tc1);
 
-    /* TODO: Write your own tests */
+    tcase_add_test(tc1, mlfq_highest_level_first);
+    tcase_add_test(tc1, fair_share_smallest_vruntime_first);
+    tcase_add_test(tc1, edf_earliest_deadline_first);
+    tcase_add_test(tc1, classes_run_in_strict_priority_under_caps);
+    tcase_add_test(tc1, round_robin_and_smallest_cycles_order);
+    tcase_add_test(tc1, async_preemption_unsticks_spinner);
+    tcase_add_test(tc1, deferred_preemption_switches_at_safe_points);
+    tcase_add_test(tc1, work_stealing_joins_across_workers);
+    tcase_add_test(tc1, event_loop_parks_readers_and_sleepers);
+    tcase_add_test(tc1, notifier_wakes_threads_from_other_os_threads);
+    tcase_add_test(tc1, timer_wheel_sleep_and_join_timeout);
+    tcase_add_test(tc1, sync_primitives_hand_off_in_order);
+    tcase_add_test(tc1, channels_pipeline_and_select);
+    tcase_add_test(tc1, task_groups_collect_children_in_batches);
+    tcase_add_test(tc1, detached_threads_are_released_on_return);
+    tcase_add_test(tc1, stackless_tasks_share_the_run_queue);
+    tcase_add_test(tc1, create_many_runs_a_batch_of_threads);
+    tcase_add_test(tc1, coroutines_switch_with_their_resumer);
+    tcase_add_test(tc1, trace_buffers_dump_chrome_json);
+    tcase_add_test(tc1, stats_count_switches_and_latencies);
+    tcase_add_test(tc1, simulator_replays_workloads_in_virtual_time);
+    tcase_add_test(tc1, stack_usage_records_high_water_marks);
 
     if (l1_init != NULL)
         l1_init();
 
-    initialize_scheduler(test_mlfq_policy);
+    test_mlfq_policy = l1_mlfq_policy;
+    test_mlfq_policy.pick_next = test_mlfq_pick_next;
+    initialize_scheduler(&test_mlfq_policy);
 
     l1_tid tid;
     l1_thread_create(&tid, foo, (void *)("baz"));
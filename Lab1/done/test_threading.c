@@ -77,7 +77,7 @@ int main(int argc, char **argv)
     if (l1_init != NULL)
         l1_init();
 
-    initialize_scheduler(l1_mlfq_policy);
+    initialize_scheduler(&l1_mlfq_policy);
 
     l1_tid tid;
     l1_thread_create(&tid, foo, (void *)("baz"));
@@ -5,11 +5,14 @@
  * @author Mark Sutherland
  */
 #include <stdlib.h>
+#include <string.h>
 #include "schedule.h"
 #include "stack.h"
+#include "stack_usage.h"
 #include "thread.h"
 #include "thread_info.h"
 #include "priority.h"
+#include "preempt.h"
 
 /* This is a function that calls a new thread's start_routine and stores the
  * return value in the function's info struct. This function is put on top
@@ -18,27 +21,104 @@
 void l1_start(void)
 {
   l1_thread_info *cur = get_scheduler()->current;
+  /* We start outside of any l1_preempt_disable section */
+  get_scheduler()->preempt_count = 0;
   /* enter execution */
   void *ret = cur->thread_func(cur->thread_func_args);
+  l1_preempt_disable();
   cur->retval = ret;
-  cur->state = ZOMBIE;
+  /* Nobody joins a detached thread, schedule releases it right away */
+  cur->state = cur->detached ? DEAD : ZOMBIE;
   /* Let the scheduler do the cleanup */
   yield(-1);
 }
 
-l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg)
+/* Sets up every field of a new thread but its stack and batch, as created
+ * at time now */
+static void l1_thread_init(l1_thread_info *thread, l1_tid tid, const l1_thread_attr *attr,
+                           void *(*start_routine)(void *), void *arg, l1_time now)
 {
+  bool stackless = (attr != NULL && attr->stackless);
+  thread->id = tid;
+  thread->state = RUNNABLE;
+  thread->thread_func = start_routine;
+  thread->thread_func_args = arg;
+  thread->joined_target = -1;
+  thread->join_recv = NULL;
+  thread->wait_reason = L1_WAIT_JOIN;
+  thread->parked = thread->wake_pending = false;
+  memset(&thread->timer, 0, sizeof(l1_timer));
+
+  //Week 4 initializations
+  thread->priority_level = TOP_PRIORITY;
+  thread->got_scheduled = 0;
+  l1_time_init(&thread->total_time);
+  l1_time_init(&thread->slice_start);
+  l1_time_init(&thread->slice_end);
+  l1_time_init(&thread->deadline);
+  if (attr != NULL && !l1_time_are_equal(attr->deadline, 0))
+  {
+    thread->deadline = now;
+    l1_time_add(&thread->deadline, attr->deadline);
+  }
+  thread->rq_prev = thread->rq_next = thread->rq_child = NULL;
+  thread->rq_epoch = 0;
+  thread->vruntime = 0;
+  thread->sched_class = (attr != NULL) ? attr->sched_class : L1_CLASS_INTERACTIVE;
+  memset(&thread->stats, 0, sizeof(l1_thread_stats));
+  thread->stats.since = now;
+
+  //Set remaining fields to a default value
+  thread->errno = SUCCESS;
+  thread->group = (attr != NULL) ? attr->group : NULL;
+  thread->future = (attr != NULL) ? attr->future : NULL;
+  thread->coro = NULL;
+  /* The group collects its children, nobody joins a task */
+  thread->detached = (attr != NULL) ? (attr->detached || stackless) && attr->group == NULL : false;
+}
+
+/* l1_thread_create_attr, with preemption disabled */
+static l1_error l1_thread_create_locked(l1_tid *thread, const l1_thread_attr *attr,
+                                        void *(*start_routine)(void *), void *arg)
+{
+  l1_scheduler_info *sched = get_scheduler();
+  bool stackless = (attr != NULL && attr->stackless);
+  bool explicit_capacity = (attr != NULL && attr->stack_capacity != 0);
+  unsigned capacity = explicit_capacity ? attr->stack_capacity : sched->stack_capacity;
+  /* A signal frame must fit on the stack of every thread. l1_preempt_start
+   * already raised the default capacity */
+  if (!stackless && explicit_capacity &&
+      (capacity < MIN_STACK_CAPACITY ||
+       (sched->preempt_mode != L1_PREEMPT_OFF && capacity < l1_preempt_stack_capacity())))
+  {
+    return ERRINVAL;
+  }
+  if (attr != NULL && (attr->sched_class < 0 || attr->sched_class >= L1_SCHED_CLASSES))
+  {
+    return ERRINVAL;
+  }
   l1_tid new_tid = get_uniq_tid();
   /* Allocate l1_thread_info struct for new thread,
-   * allocate stack for the thread. */
-  l1_thread_info *fresh_thread = malloc(sizeof(l1_thread_info));
-  if (fresh_thread == NULL)
+   * allocate stack for the thread. The cache only holds stacks of the
+   * default capacity. */
+  l1_thread_info *fresh_thread = (stackless || capacity == sched->stack_capacity) ? reuse_thread(stackless) : NULL;
+  l1_stack *new_stack = NULL;
+  if (fresh_thread != NULL)
   {
-    return ERRNOMEM;
+    new_stack = fresh_thread->thread_stack;
+  }
+  else
+  {
+    fresh_thread = malloc(sizeof(l1_thread_info));
+    if (fresh_thread == NULL)
+    {
+      return ERRNOMEM;
+    }
+    if (!stackless)
+    {
+      new_stack = l1_stack_new_capacity(capacity);
+    }
   }
-  fresh_thread->id = new_tid;
-  fresh_thread->state = RUNNABLE;
-  l1_stack *new_stack = l1_stack_new();
 
   /* Setup stack for new task. At the bottom of the stack is a fake stack 
    * frame for l1_start, as described in the handout. This will allow the 
@@ -52,39 +132,34 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
    * In `switch_asm`, we only save the registers are not already saved.
    */
   //If cannot allocate, set error and return
-  if (new_stack == NULL)
+  if (new_stack == NULL && !stackless)
   {
     free(fresh_thread);
     return ERRNOMEM;
   }
 
-  //Push empty value on stack
-  l1_stack_push(new_stack, (uint64_t)0);
-  l1_stack_push(new_stack, (uint64_t)l1_start);
-
-//Push rbp, r15, r14, r13, r12, rbx on stack (6 registers)
-#define M_SAVED_REGS_COUNT 6
-  for (unsigned i = 0; i < M_SAVED_REGS_COUNT; i++)
+  /* A stackless task is called by schedule on the stack of tsys */
+  if (!stackless)
   {
+    //Push empty value on stack
     l1_stack_push(new_stack, (uint64_t)0);
-  }
+    l1_stack_push(new_stack, (uint64_t)l1_start);
+
+  //Push rbp, r15, r14, r13, r12, rbx on stack (6 registers)
+#define M_SAVED_REGS_COUNT 6
+    for (unsigned i = 0; i < M_SAVED_REGS_COUNT; i++)
+    {
+      l1_stack_push(new_stack, (uint64_t)0);
+    }
 #undef M_SAVED_REGS_COUNT
+    L1_STACK_PAINT(new_stack);
+  }
 
   fresh_thread->thread_stack = new_stack;
-  fresh_thread->thread_func = start_routine;
-  fresh_thread->thread_func_args = arg;
-  fresh_thread->joined_target = -1;
-  fresh_thread->join_recv = NULL;
-
-  //Week 4 initializations
-  fresh_thread->priority_level = TOP_PRIORITY;
-  fresh_thread->got_scheduled = 0;
-  l1_time_init(&fresh_thread->total_time);
-  l1_time_init(&fresh_thread->slice_start);
-  l1_time_init(&fresh_thread->slice_end);
-
-  //Set remaining fields to a default value
-  fresh_thread->errno = SUCCESS;
+  fresh_thread->batch = NULL;
+  l1_time now;
+  l1_time_get(&now);
+  l1_thread_init(fresh_thread, new_tid, attr, start_routine, arg, now);
 
   /* Add the new task for scheduling */
   add_to_scheduler(fresh_thread, RUNNABLE);
@@ -95,17 +170,144 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
   return SUCCESS;
 }
 
-l1_error l1_thread_join(l1_tid target, void **retval)
+l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg)
+{
+  return l1_thread_create_attr(thread, NULL, start_routine, arg);
+}
+
+l1_error l1_thread_create_attr(l1_tid *thread, const l1_thread_attr *attr,
+                               void *(*start_routine)(void *), void *arg)
+{
+  /* malloc and the scheduler lists must not be interrupted by a tick */
+  l1_preempt_disable();
+  l1_error err = l1_thread_create_locked(thread, attr, start_routine, arg);
+  l1_preempt_enable();
+  return err;
+}
+
+void l1_thread_prepare_stack(l1_stack *stack)
+{
+  /* The frame l1_thread_create_locked pushes: 0, l1_start and the 6 saved
+   * registers */
+  stack->size = 8;
+  stack->top = stack->base + stack->capacity - stack->size;
+  memset(stack->top, 0, stack->size * sizeof(uint64_t));
+  stack->top[6] = (uint64_t)l1_start;
+  L1_STACK_PAINT(stack);
+}
+
+/* Rounds size up to a multiple of 16 bytes, the alignment of the stacks */
+#define L1_BATCH_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+l1_error l1_thread_create_many(size_t count, void *(*start_routine)(void *), void *args[],
+                               l1_tid tids[])
+{
+  if (count == 0)
+  {
+    return SUCCESS;
+  }
+  /* Header, then the descriptors, the stack structures and the stacks */
+  unsigned capacity = get_scheduler()->stack_capacity;
+  size_t per_thread = sizeof(l1_thread_info) + sizeof(l1_stack) + capacity * sizeof(uint64_t);
+  if (count > (SIZE_MAX - 64) / per_thread)
+  {
+    return ERRNOMEM;
+  }
+  size_t infos_offset = L1_BATCH_ALIGN(sizeof(l1_thread_batch));
+  size_t stacks_offset = L1_BATCH_ALIGN(infos_offset + count * sizeof(l1_thread_info));
+  size_t words_offset = L1_BATCH_ALIGN(stacks_offset + count * sizeof(l1_stack));
+
+  l1_preempt_disable();
+  l1_thread_batch *batch = malloc(words_offset + count * capacity * sizeof(uint64_t));
+  if (batch == NULL)
+  {
+    l1_preempt_enable();
+    return ERRNOMEM;
+  }
+  batch->live = count;
+  l1_thread_info *infos = (l1_thread_info *)((char *)batch + infos_offset);
+  l1_stack *stacks = (l1_stack *)((char *)batch + stacks_offset);
+  uint64_t *words = (uint64_t *)((char *)batch + words_offset);
+
+  l1_tid first = get_uniq_tids(count);
+  l1_time now;
+  l1_time_get(&now);
+  for (size_t i = 0; i < count; i++)
+  {
+    /* Left empty: the first write to a stack faults its page in, which
+     * costs more than the rest of the creation, so schedule prepares it */
+    l1_stack *stack = &stacks[i];
+    stack->capacity = capacity;
+    stack->base = words + i * capacity;
+    stack->size = 0;
+    stack->top = stack->base + capacity;
+
+    l1_thread_info *thread = &infos[i];
+    l1_thread_init(thread, first + i, NULL, start_routine, (args != NULL) ? args[i] : NULL, now);
+    thread->thread_stack = stack;
+    thread->batch = batch;
+    thread->prev = (i > 0) ? &infos[i - 1] : NULL;
+    thread->next = (i + 1 < count) ? &infos[i + 1] : NULL;
+    tids[i] = first + i;
+  }
+  add_batch_to_scheduler(&infos[0], &infos[count - 1], count);
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+l1_error l1_thread_create_with_deadline(l1_tid *thread, l1_time deadline,
+                                        void *(*start_routine)(void *), void *arg)
+{
+  l1_thread_attr attr = {.deadline = deadline};
+  return l1_thread_create_attr(thread, &attr, start_routine, arg);
+}
+
+l1_error l1_thread_set_deadline(l1_time deadline)
+{
+  l1_scheduler_info *sched = get_scheduler();
+  l1_thread_info *current = sched->current;
+  if (current == sched->tsys)
+  {
+    return ERRINVAL;
+  }
+  l1_time now;
+  l1_time_get(&now);
+  /* The statistics are per scheduler */
+  l1_preempt_disable();
+  l1_stats_retire_deadline(current, now);
+  if (!l1_time_are_equal(deadline, 0))
+  {
+    current->deadline = now;
+    l1_time_add(&current->deadline, deadline);
+  }
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+l1_error l1_task_create(l1_tid *task, void *(*routine)(void *), void *arg)
+{
+  static const l1_thread_attr attr = {.stackless = true};
+  return l1_thread_create_attr(task, &attr, routine, arg);
+}
+
+/* Blocks the current thread on target, until *deadline if it is not NULL */
+static l1_error l1_thread_join_until(l1_tid target, void **retval, const l1_time *deadline)
 {
   //Check that thread with tid target exists
   /* Setup necessary metadata and block yourself */
   l1_scheduler_info *sched = get_scheduler();
   l1_thread_info *current_thread = sched->current;
 
+  l1_preempt_disable();
   current_thread->state = BLOCKED;
+  current_thread->wait_reason = L1_WAIT_JOIN;
   current_thread->joined_target = target;
   current_thread->join_recv = retval;
   current_thread->errno = SUCCESS;
+  if (deadline != NULL)
+  {
+    timer_wheel_add(&sched->timers, &current_thread->timer, *deadline);
+  }
 
   yield(-1);
 
@@ -114,6 +316,118 @@ l1_error l1_thread_join(l1_tid target, void **retval)
   l1_error resulting_errno = current_thread->errno;
   current_thread->errno = SUCCESS;
   current_thread->joined_target = -1;
+  l1_preempt_enable();
 
   return resulting_errno;
 }
+
+l1_error l1_thread_join(l1_tid target, void **retval)
+{
+  return l1_thread_join_until(target, retval, NULL);
+}
+
+l1_error l1_thread_join_timeout(l1_tid target, void **retval, l1_time timeout)
+{
+  /* The timers are per worker, a join may complete on another one */
+  if (get_scheduler()->runtime != NULL)
+  {
+    return ERRINVAL;
+  }
+  l1_time deadline;
+  l1_time_get(&deadline);
+  l1_time_add(&deadline, timeout);
+  return l1_thread_join_until(target, retval, &deadline);
+}
+
+l1_error l1_sleep(l1_time duration)
+{
+  l1_scheduler_info *sched = get_scheduler();
+  l1_thread_info *current_thread = sched->current;
+  /* Nothing else to run on this OS thread */
+  if (current_thread == sched->tsys || sched->runtime != NULL)
+  {
+#ifdef USE_UNIX_TIME
+    struct timespec ts = {.tv_sec = duration, .tv_nsec = 0};
+#else
+    struct timespec ts = {.tv_sec = duration / L1_NSEC_PER_SEC, .tv_nsec = duration % L1_NSEC_PER_SEC};
+#endif
+    while (nanosleep(&ts, &ts) != 0)
+      ;
+    return SUCCESS;
+  }
+
+  l1_time deadline;
+  l1_time_get(&deadline);
+  l1_time_add(&deadline, duration);
+  l1_preempt_disable();
+  current_thread->state = BLOCKED;
+  current_thread->wait_reason = L1_WAIT_SLEEP;
+  timer_wheel_add(&sched->timers, &current_thread->timer, deadline);
+  yield(-1);
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+l1_error l1_yield_for(l1_time duration)
+{
+  l1_scheduler_info *sched = get_scheduler();
+  l1_thread_info *current_thread = sched->current;
+  if (current_thread == sched->tsys || sched->runtime != NULL)
+  {
+    if (current_thread != sched->tsys)
+    {
+      yield(-1);
+    }
+    return SUCCESS;
+  }
+
+  l1_time deadline;
+  l1_time_get(&deadline);
+  l1_time_add(&deadline, duration);
+  l1_preempt_disable();
+  current_thread->state = BLOCKED;
+  current_thread->wait_reason = L1_WAIT_YIELD;
+  sched->timed_yielders++;
+  timer_wheel_add(&sched->timers, &current_thread->timer, deadline);
+  yield(-1);
+  l1_preempt_enable();
+  return SUCCESS;
+}
+
+l1_error l1_thread_detach(l1_tid target)
+{
+  l1_scheduler_info *sched = get_scheduler();
+  l1_error err = ERRINVAL;
+  l1_preempt_disable();
+  lists_lock();
+  l1_thread_info *thread = thread_list_find(&sched->thread_arrays[ZOMBIE], target);
+  if (thread != NULL)
+  {
+    /* It does not run anymore */
+    thread_list_remove(&sched->thread_arrays[ZOMBIE], thread);
+    thread->state = DEAD;
+    release_thread(thread);
+    err = SUCCESS;
+  }
+  else
+  {
+    thread = thread_list_find(&sched->thread_arrays[RUNNABLE], target);
+    if (thread == NULL)
+    {
+      thread = thread_list_find(&sched->thread_arrays[BLOCKED], target);
+    }
+    bool joined = false;
+    for (l1_thread_info *blocked = sched->thread_arrays[BLOCKED].head; blocked != NULL; blocked = blocked->next)
+    {
+      joined |= (blocked->wait_reason == L1_WAIT_JOIN && blocked->joined_target == target);
+    }
+    if (thread != NULL && !thread->detached && thread->group == NULL && !joined)
+    {
+      thread->detached = true;
+      err = SUCCESS;
+    }
+  }
+  lists_unlock();
+  l1_preempt_enable();
+  return err;
+}
@@ -28,6 +28,81 @@
  */
 l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg);
 
+/**
+ * @brief Optional properties of a new thread, see l1_thread_create_attr.
+ */
+typedef struct
+{
+  struct l1_task_group *group; /** Collects the thread when it returns, see task_group.h */
+  struct l1_future *future;    /** Completed with the return value, see task_group.h */
+  bool detached;               /** Created detached, see l1_thread_detach. Ignored with a group */
+  bool stackless;              /** Run-to-completion task, see l1_task_create */
+  l1_time deadline;            /** Relative deadline, 0 if none, see l1_thread_set_deadline */
+  unsigned stack_capacity;     /** Stack size in words, 0 for the default of the scheduler,
+                                 * see stack_usage.h to size it */
+  l1_sched_class sched_class;  /** Class under l1_class_policy, see sched_policy.h */
+} l1_thread_attr;
+
+#define L1_THREAD_ATTR_DEFAULT {0}
+
+/**
+ * @brief l1_thread_create with the properties in attr, which may be NULL.
+ *
+ * The properties are set before the thread can run. A thread of a group
+ * cannot be joined with l1_thread_join. A stack capacity below
+ * MIN_STACK_CAPACITY, or below l1_preempt_stack_capacity while preemption
+ * is on, is invalid.
+ *
+ * @return See l1_thread_create, or ERRINVAL for an invalid stack capacity
+ * or scheduling class.
+ */
+l1_error l1_thread_create_attr(l1_tid *thread, const l1_thread_attr *attr,
+                               void *(*start_routine)(void *), void *arg);
+
+/**
+ * @brief Creates count green threads running start_routine(args[i]), or
+ * start_routine(NULL) if args is NULL, and stores their IDs in tids.
+ *
+ * Equivalent to count calls to l1_thread_create, but the descriptors and
+ * stacks of the threads are allocated at once, in a single region freed
+ * when the last of them is released, and the threads enter the scheduler
+ * together. They are never cached for reuse by later creations. The stack
+ * of each thread is only written to, and paged in, when it first runs.
+ *
+ * @return SUCCESS, or ERRNOMEM, in which case no thread was created.
+ */
+l1_error l1_thread_create_many(size_t count, void *(*start_routine)(void *), void *args[],
+                               l1_tid tids[]);
+
+/**
+ * @brief Writes the initial frame of a new thread, that switch_asm returns
+ * from into l1_start, on the empty stack. The stacks of
+ * l1_thread_create_many are prepared by schedule, when first switched to.
+ */
+void l1_thread_prepare_stack(l1_stack *stack);
+
+/**
+ * @brief l1_thread_create for a thread due within deadline of its creation.
+ *
+ * @return See l1_thread_create.
+ */
+l1_error l1_thread_create_with_deadline(l1_tid *thread, l1_time deadline,
+                                        void *(*start_routine)(void *), void *arg);
+
+/**
+ * @brief Sets the deadline of the calling thread to deadline from now, or
+ * clears it if deadline is 0.
+ *
+ * The previous deadline, if any, is retired: it counts as met, or as missed
+ * if it already passed (see stats.h). A thread that returns retires its
+ * deadline too. Only l1_edf_policy (see sched_policy.h) schedules by
+ * deadline, the other policies ignore it. The new deadline takes effect
+ * when the thread is next queued.
+ *
+ * @return SUCCESS, or ERRINVAL from tsys.
+ */
+l1_error l1_thread_set_deadline(l1_time deadline);
+
 /**
  * @brief Blocks until a thread completes
  * 
@@ -48,3 +123,63 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
  * @return  If successful, return SUCCESS. On error, it returns an error code.
  */
 l1_error l1_thread_join(l1_tid target, void **retval);
+
+/**
+ * @brief l1_thread_join that gives up after timeout.
+ *
+ * @param  timeout  Longest time to wait for target
+ * @return  SUCCESS if target was joined, ERRTIMEDOUT if it still runs after
+ *          timeout, ERRINVAL if it does not exist or in M:N mode.
+ */
+l1_error l1_thread_join_timeout(l1_tid target, void **retval, l1_time timeout);
+
+/**
+ * @brief Parks the calling green thread for at least duration.
+ *
+ * The thread becomes RUNNABLE on the first scheduler tick after its timer
+ * expires. From tsys or in M:N mode, the whole OS thread sleeps.
+ *
+ * @return SUCCESS.
+ */
+l1_error l1_sleep(l1_time duration);
+
+/**
+ * @brief Gives up the processor for at most duration.
+ *
+ * Like l1_sleep, except that the thread runs again as soon as no other
+ * thread is runnable, e.g. to back off while polling. Plain yield in M:N
+ * mode.
+ *
+ * @return SUCCESS.
+ */
+l1_error l1_yield_for(l1_time duration);
+
+/**
+ * @brief Detaches a thread: it is released as soon as it returns instead of
+ * waiting for a join, its descriptor and stack going back to the thread
+ * cache of the scheduler.
+ *
+ * A thread that already returned is released right away.
+ *
+ * @return SUCCESS, or ERRINVAL if target does not exist, is already detached,
+ *         belongs to a task group or is being joined.
+ */
+l1_error l1_thread_detach(l1_tid target);
+
+/**
+ * @brief Creates a stackless, run-to-completion task.
+ *
+ * A task is queued and scheduled like a thread, but has no stack: schedule
+ * calls routine(arg) directly on the stack of tsys, without any switch. The
+ * routine must return without waiting, as it runs as tsys, so yield() and
+ * the other blocking functions are not available (the wrappers that fall
+ * back to blocking system calls from tsys, like l1_read or l1_sleep, block
+ * the whole scheduler). A task may create threads and tasks.
+ *
+ * Tasks are detached: they are released as soon as they return, and their
+ * return value can only be collected through a future, by passing both
+ * stackless and future to l1_thread_create_attr.
+ *
+ * @return SUCCESS, or ERRNOMEM.
+ */
+l1_error l1_task_create(l1_tid *task, void *(*routine)(void *), void *arg);
@@ -0,0 +1,117 @@
+/**
+ * @file thread_deque.c
+ * @brief Implementation of the Chase-Lev work-stealing deque.
+ *
+ * Follows "Correct and Efficient Work-Stealing for Weak Memory Models"
+ * (Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013), with the GCC atomic builtins.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "thread_deque.h"
+
+static l1_thread_deque_buf* deque_buf_new(int64_t size) {
+  l1_thread_deque_buf* buf = malloc(sizeof(l1_thread_deque_buf) + size * sizeof(l1_thread_info*));
+  if (buf == NULL) {
+    fprintf(stderr, "Error: unable to allocate a thread deque\n");
+    exit(-1);
+  }
+  buf->size = size;
+  buf->prev = NULL;
+  return buf;
+}
+
+static l1_thread_info* deque_buf_get(l1_thread_deque_buf* buf, int64_t i) {
+  return __atomic_load_n(&buf->slots[i & (buf->size - 1)], __ATOMIC_RELAXED);
+}
+
+static void deque_buf_put(l1_thread_deque_buf* buf, int64_t i, l1_thread_info* thread) {
+  __atomic_store_n(&buf->slots[i & (buf->size - 1)], thread, __ATOMIC_RELAXED);
+}
+
+/* Copies the live slots [top, bottom) in a buffer twice as large */
+static l1_thread_deque_buf* deque_grow(l1_thread_deque* deque, l1_thread_deque_buf* old,
+                                       int64_t bottom, int64_t top) {
+  l1_thread_deque_buf* buf = deque_buf_new(2 * old->size);
+  for (int64_t i = top; i < bottom; i++) {
+    deque_buf_put(buf, i, deque_buf_get(old, i));
+  }
+  buf->prev = old;
+  __atomic_store_n(&deque->buf, buf, __ATOMIC_RELEASE);
+  return buf;
+}
+
+void thread_deque_init(l1_thread_deque* deque) {
+  deque->top = 0;
+  deque->bottom = 0;
+  deque->buf = deque_buf_new(THREAD_DEQUE_INITIAL_SIZE);
+}
+
+void thread_deque_destroy(l1_thread_deque* deque) {
+  l1_thread_deque_buf* buf = deque->buf;
+  while (buf != NULL) {
+    l1_thread_deque_buf* prev = buf->prev;
+    free(buf);
+    buf = prev;
+  }
+  deque->buf = NULL;
+}
+
+void thread_deque_push(l1_thread_deque* deque, l1_thread_info* thread) {
+  int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  l1_thread_deque_buf* buf = __atomic_load_n(&deque->buf, __ATOMIC_RELAXED);
+  if (b - t > buf->size - 1) {
+    buf = deque_grow(deque, buf, b, t);
+  }
+  deque_buf_put(buf, b, thread);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+l1_thread_info* thread_deque_pop(l1_thread_deque* deque) {
+  int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  l1_thread_deque_buf* buf = __atomic_load_n(&deque->buf, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (t > b) {
+    /* Empty */
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  l1_thread_info* thread = deque_buf_get(buf, b);
+  if (t == b) {
+    /* Last one, race against the thieves for it */
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      thread = NULL;
+    }
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return thread;
+}
+
+l1_thread_info* thread_deque_steal(l1_thread_deque* deque) {
+  for (;;) {
+    int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+      return NULL;
+    }
+    l1_thread_deque_buf* buf = __atomic_load_n(&deque->buf, __ATOMIC_ACQUIRE);
+    l1_thread_info* thread = deque_buf_get(buf, t);
+    if (__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      return thread;
+    }
+    /* Lost against another thief or the owner, the deque may not be empty */
+  }
+}
+
+bool thread_deque_is_empty(l1_thread_deque* deque) {
+  int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  return t >= b;
+}
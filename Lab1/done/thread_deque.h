@@ -0,0 +1,67 @@
+/**
+ * @file thread_deque.h
+ * @brief Header file for the Chase-Lev work-stealing deque of threads
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "thread_info.h"
+
+#define THREAD_DEQUE_INITIAL_SIZE 64
+
+/* Circular array of the deque, replaced by one twice as large when full */
+typedef struct l1_thread_deque_buf {
+  int64_t size;                     /* Power of two */
+  struct l1_thread_deque_buf* prev; /* Smaller buffer this one replaced */
+  l1_thread_info* slots[];
+} l1_thread_deque_buf;
+
+/**
+ * @brief A Chase-Lev work-stealing deque of threads.
+ *
+ * Only the owner, i.e. the OS thread that initialized the deque, may push
+ * and pop, at the bottom. Any OS thread, the owner included, may steal from
+ * the top, so the owner pops in LIFO order and thieves take the oldest
+ * thread. The deque is lock free; replaced buffers are kept until
+ * thread_deque_destroy since a thief may still be reading them.
+ */
+typedef struct l1_thread_deque {
+  int64_t top;              /* Next slot to steal, only grows */
+  int64_t bottom;           /* Next slot to push */
+  l1_thread_deque_buf* buf; /* Current buffer */
+} l1_thread_deque;
+
+/**
+ * @brief Initializes an empty deque.
+ */
+void thread_deque_init(l1_thread_deque* deque);
+
+/**
+ * @brief Frees the buffers of the deque.
+ * @warning No other OS thread may still use the deque.
+ */
+void thread_deque_destroy(l1_thread_deque* deque);
+
+/**
+ * @brief Pushes thread at the bottom. Owner only.
+ */
+void thread_deque_push(l1_thread_deque* deque, l1_thread_info* thread);
+
+/**
+ * @brief Removes and returns the bottom thread. Owner only.
+ *
+ * @return The newest thread or NULL if the deque is empty.
+ */
+l1_thread_info* thread_deque_pop(l1_thread_deque* deque);
+
+/**
+ * @brief Removes and returns the top thread. Safe from any OS thread.
+ *
+ * @return The oldest thread or NULL if the deque is empty.
+ */
+l1_thread_info* thread_deque_steal(l1_thread_deque* deque);
+
+/**
+ * @brief Check if the deque is empty. Only a hint for other OS threads.
+ */
+bool thread_deque_is_empty(l1_thread_deque* deque);
@@ -0,0 +1,117 @@
+/**
+ * @file thread_heap.c
+ * @brief Implementation of the thread pairing heap.
+ */
+#include <stdlib.h>
+#include "thread_heap.h"
+
+/* Links b as the leftmost child of a, or the opposite. Both must be roots. */
+static l1_thread_info* heap_meld(l1_thread_heap* heap, l1_thread_info* a, l1_thread_info* b) {
+  if (heap->before(b, a)) {
+    l1_thread_info* tmp = a;
+    a = b;
+    b = tmp;
+  }
+  b->rq_prev = a;
+  b->rq_next = a->rq_child;
+  if (a->rq_child != NULL) {
+    a->rq_child->rq_prev = b;
+  }
+  a->rq_child = b;
+  return a;
+}
+
+/* Standard two-pass merge of a sibling list into a single root. */
+static l1_thread_info* heap_merge_pairs(l1_thread_heap* heap, l1_thread_info* first) {
+  if (first == NULL) {
+    return NULL;
+  }
+  /* First pass, left to right: meld pairs and stack them through rq_next */
+  l1_thread_info* pairs = NULL;
+  while (first != NULL) {
+    l1_thread_info* a = first;
+    l1_thread_info* b = a->rq_next;
+    first = (b != NULL) ? b->rq_next : NULL;
+    a->rq_prev = a->rq_next = NULL;
+    if (b != NULL) {
+      b->rq_prev = b->rq_next = NULL;
+      a = heap_meld(heap, a, b);
+    }
+    a->rq_next = pairs;
+    pairs = a;
+  }
+  /* Second pass, right to left: meld everything into the last pair */
+  l1_thread_info* root = pairs;
+  pairs = pairs->rq_next;
+  root->rq_next = NULL;
+  while (pairs != NULL) {
+    l1_thread_info* next = pairs->rq_next;
+    pairs->rq_next = NULL;
+    root = heap_meld(heap, root, pairs);
+    pairs = next;
+  }
+  return root;
+}
+
+void thread_heap_init(l1_thread_heap* heap, thread_heap_before before) {
+  heap->size = 0;
+  heap->root = NULL;
+  heap->before = before;
+}
+
+void thread_heap_insert(l1_thread_heap* heap, l1_thread_info* thread) {
+  if (heap == NULL || thread == NULL) {
+    return;
+  }
+  thread->rq_child = thread->rq_prev = thread->rq_next = NULL;
+  heap->root = (heap->root == NULL) ? thread : heap_meld(heap, heap->root, thread);
+  heap->size++;
+}
+
+l1_thread_info* thread_heap_peek(l1_thread_heap* heap) {
+  if (heap == NULL) {
+    return NULL;
+  }
+  return heap->root;
+}
+
+l1_thread_info* thread_heap_pop(l1_thread_heap* heap) {
+  if (thread_heap_is_empty(heap)) {
+    return NULL;
+  }
+  return thread_heap_remove(heap, heap->root);
+}
+
+l1_thread_info* thread_heap_remove(l1_thread_heap* heap, l1_thread_info* thread) {
+  if (!heap || !thread) {
+    return NULL;
+  }
+  l1_thread_info* sub = heap_merge_pairs(heap, thread->rq_child);
+  if (thread == heap->root) {
+    heap->root = sub;
+    goto rm_prolog;
+  }
+  /* Cut the subtree of thread out of its parent's children */
+  if (thread->rq_prev->rq_child == thread) {
+    thread->rq_prev->rq_child = thread->rq_next;
+  } else {
+    thread->rq_prev->rq_next = thread->rq_next;
+  }
+  if (thread->rq_next != NULL) {
+    thread->rq_next->rq_prev = thread->rq_prev;
+  }
+  if (sub != NULL) {
+    heap->root = heap_meld(heap, heap->root, sub);
+  }
+rm_prolog:
+  heap->size--;
+  thread->rq_child = thread->rq_prev = thread->rq_next = NULL;
+  return thread;
+}
+
+bool thread_heap_is_empty(l1_thread_heap* heap) {
+  if (heap == NULL) {
+    return false;
+  }
+  return heap->size == 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file thread_heap.h
+ * @brief Header file for the thread pairing heap used by policy run queues
+ */
+#pragma once
+#include <stdbool.h>
+#include "thread_info.h"
+
+/**
+ * @brief Strict ordering of the heap: true if a must be popped before b.
+ */
+typedef bool (*thread_heap_before)(const l1_thread_info* a, const l1_thread_info* b);
+
+/**
+ * @brief A pairing heap of threads.
+ *
+ * Nodes are linked through the run queue fields of l1_thread_info:
+ * `rq_child` is the leftmost child, `rq_next` the right sibling and
+ * `rq_prev` the left sibling, or the parent for a leftmost child.
+ * Insertion is O(1), pop and removal are O(log n) amortized.
+ */
+typedef struct l1_thread_heap {
+  size_t size;
+  l1_thread_info *root;
+  thread_heap_before before;
+} l1_thread_heap;
+
+/**
+ * @brief Initializes an empty heap ordered by `before`.
+ */
+void thread_heap_init(l1_thread_heap* heap, thread_heap_before before);
+
+/**
+ * @brief Inserts thread in the heap.
+ * @warning The thread must not already be in a run queue.
+ */
+void thread_heap_insert(l1_thread_heap* heap, l1_thread_info* thread);
+
+/**
+ * @brief Returns the first thread of the heap without removing it.
+ *
+ * @return The first thread or NULL if the heap is empty.
+ */
+l1_thread_info* thread_heap_peek(l1_thread_heap* heap);
+
+/**
+ * @brief Removes and returns the first thread of the heap.
+ *
+ * @return The first thread or NULL if the heap is empty.
+ */
+l1_thread_info* thread_heap_pop(l1_thread_heap* heap);
+
+/**
+ * @brief Removes thread from anywhere in the heap.
+ * @warning The function does not check that thread is in heap.
+ *
+ * @return thread
+ */
+l1_thread_info* thread_heap_remove(l1_thread_heap* heap, l1_thread_info* thread);
+
+/**
+ * @brief Check if the heap is empty
+ */
+bool thread_heap_is_empty(l1_thread_heap* heap);
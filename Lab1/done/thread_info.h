@@ -11,6 +11,7 @@
 #include "stack.h"
 #include "l1_time.h"
 #include "priority.h"
+#include "timer_wheel.h"
 
 typedef void *(*thread_func_t)(void *);
 
@@ -27,18 +28,59 @@ typedef enum
 } l1_thread_state;
 typedef uint32_t l1_tid;
 
+/* What a BLOCKED thread waits for */
+typedef enum
+{
+  L1_WAIT_JOIN = 0, /* Termination of joined_target */
+  L1_WAIT_IO,       /* Readiness of a file descriptor, see event_loop.h */
+  L1_WAIT_SLEEP,    /* The timer, l1_sleep */
+  L1_WAIT_YIELD,    /* The timer or an idle processor, l1_yield_for */
+  L1_WAIT_SYNC,     /* An l1_mutex, l1_cond or l1_sem (see sync.h) */
+  L1_WAIT_NOTIFIER, /* An l1_notifier, maybe signaled by another OS thread */
+} l1_wait_reason;
+
+/* Scheduling class of a thread under l1_class_policy (see sched_policy.h).
+ * The classes run in strict priority: realtime, interactive, then batch */
+typedef enum
+{
+  L1_CLASS_INTERACTIVE = 0, /* Default */
+  L1_CLASS_REALTIME,
+  L1_CLASS_BATCH,
+  L1_SCHED_CLASSES
+} l1_sched_class;
+
+/* Scheduling statistics of a thread, see stats.h. The running time is
+ * total_time. */
+typedef struct
+{
+  l1_time wait_time;        /** RUNNABLE, waiting to be picked */
+  l1_time blocked_time;     /** BLOCKED */
+  l1_time since;            /** Start of the current RUNNABLE or BLOCKED period */
+  uint64_t switches;        /** Times it was scheduled */
+  uint64_t voluntary;       /** Yielded, blocked or returned */
+  uint64_t involuntary;     /** Preempted by a tick or at a safe point */
+  uint64_t deadlines;       /** Deadlines retired, see l1_thread_set_deadline */
+  uint64_t deadline_misses; /** Of which retired after they passed */
+  bool preempted;           /** The current switch out is involuntary */
+} l1_thread_stats;
+
 typedef struct l1_thread_info
 {
   l1_tid id;             /** Thread ID */
   l1_thread_state state; /** Thread state */
 
   l1_tid joined_target; /** Target for joining */
+  l1_wait_reason wait_reason; /** What the thread waits for when BLOCKED */
+  bool parked;                /** In the BLOCKED list */
+  bool wake_pending;          /** Woken before being parked, M:N mode */
+  l1_timer timer;             /** Timeout of a sleep, join or timed yield */
   l1_tid yield_target;  /** Target for yielding */
 
   thread_func_t thread_func; /** Function being run by the thread */
   void *thread_func_args;    /** Function arg */
 
   l1_stack *thread_stack; /** Thread stack */
+  struct l1_thread_batch *batch; /** Region holding the thread and its stack, NULL if allocated alone */
 
   /* These pointers are used to link thread info structs into a list for the 
    * scheduler seems like week4 */
@@ -48,6 +90,10 @@ typedef struct l1_thread_info
   l1_error errno;   /** Per-thread errno */
   void *retval;     /** Value returned by the thread */
   void **join_recv; /** Pointer to put joined thread's return val */
+  struct l1_task_group *group; /** Group collecting the thread instead of a join */
+  struct l1_future *future;    /** Completed with retval when the thread returns */
+  bool detached;               /** Released as soon as it returns, cannot be joined */
+  struct l1_coro *coro;        /** Innermost coroutine running on the thread, see coro.h */
 
   /* Scheduling information (week 4)*/
   l1_priority priority_level; /** Priority level for the scheduler */
@@ -55,4 +101,14 @@ typedef struct l1_thread_info
   l1_time total_time;         /** Total execution time so far */
   l1_time slice_start;        /** Start time it was last scheduled */
   l1_time slice_end;          /**End time it was last descheduled */
+  l1_time deadline;           /** Absolute deadline, 0 if none (see l1_thread_set_deadline) */
+  l1_sched_class sched_class; /** Class under l1_class_policy */
+  l1_thread_stats stats;      /** See stats.h */
+
+  /* Links for the run queues private to the scheduling policy */
+  struct l1_thread_info *rq_prev;  /** Previous in the policy run queue */
+  struct l1_thread_info *rq_next;  /** Next in the policy run queue */
+  struct l1_thread_info *rq_child; /** First child in a policy heap */
+  uint64_t rq_epoch;               /** Policy epoch or sequence when last enqueued */
+  uint64_t vruntime;               /** Weighted virtual runtime (fair share) */
 } l1_thread_info;
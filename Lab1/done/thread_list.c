@@ -84,6 +84,25 @@ add_prolog:
   list->size++;
 }
 
+void thread_list_splice(l1_thread_list* list, l1_thread_info* head, l1_thread_info* tail,
+                        size_t count) {
+  if (list == NULL || head == NULL || tail == NULL) {
+    return;
+  }
+  if (head->prev != NULL || tail->next != NULL) {
+    fprintf(stderr, "Error: spliced chain is still linked\n");
+    exit(-1);
+  }
+  if (thread_list_is_empty(list)) {
+    list->head = head;
+  } else {
+    list->tail->next = head;
+    head->prev = list->tail;
+  }
+  list->tail = tail;
+  list->size += count;
+}
+
 void thread_list_prepend(l1_thread_list* list, l1_thread_info* thread) {
   if (list == NULL || thread == NULL) {
     return;
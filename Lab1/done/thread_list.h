@@ -57,6 +57,17 @@ l1_thread_info* thread_list_rotate(l1_thread_list* list);
 void thread_list_add(l1_thread_list* list, l1_thread_info* thread);
 
 
+/**
+ * @brief Appends a chain of count threads, already linked from head to tail
+ * through prev/next, in one step.
+ *
+ * @param list the list to add to
+ * @param head the first thread of the chain, its prev is NULL
+ * @param tail the last thread of the chain, its next is NULL
+ */
+void thread_list_splice(l1_thread_list* list, l1_thread_info* head, l1_thread_info* tail,
+                        size_t count);
+
 /**
  * @brief Add a node to the list at the begining.
  *
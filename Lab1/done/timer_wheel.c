@@ -0,0 +1,174 @@
+/**
+ * @file timer_wheel.c
+ * @brief Implementation of the hierarchical timer wheel.
+ *
+ * Follows the cascading wheel of the Linux kernel before 4.8, with
+ * TIMER_WHEEL_SLOTS slots on every level.
+ */
+#include <stddef.h>
+#include "timer_wheel.h"
+
+#define LEVEL_SPAN(level) (1ULL << (TIMER_WHEEL_BITS * (level)))
+
+static uint64_t rotate_right(uint64_t bits, unsigned shift) {
+  shift &= 63;
+  return (shift == 0) ? bits : (bits >> shift) | (bits << (64 - shift));
+}
+
+static void wheel_link(l1_timer_wheel* wheel, l1_timer* timer) {
+  l1_timer** head = &wheel->slots[timer->level][timer->slot];
+  timer->prev = NULL;
+  timer->next = *head;
+  if (*head != NULL) {
+    (*head)->prev = timer;
+  }
+  *head = timer;
+  wheel->occupied[timer->level] |= 1ULL << timer->slot;
+  timer->armed = true;
+  wheel->count++;
+}
+
+static void wheel_unlink(l1_timer_wheel* wheel, l1_timer* timer) {
+  l1_timer** head = &wheel->slots[timer->level][timer->slot];
+  if (timer->prev == NULL) {
+    *head = timer->next;
+  } else {
+    timer->prev->next = timer->next;
+  }
+  if (timer->next != NULL) {
+    timer->next->prev = timer->prev;
+  }
+  if (*head == NULL) {
+    wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+  }
+  timer->prev = timer->next = NULL;
+  timer->armed = false;
+  wheel->count--;
+}
+
+/* Places timer according to its distance from the current tick */
+static void wheel_place(l1_timer_wheel* wheel, l1_timer* timer) {
+  uint64_t expires = (timer->expires > wheel->tick) ? timer->expires : wheel->tick;
+  uint64_t delta = expires - wheel->tick;
+  /* Out of range: park it in the last level, it is placed again when it
+   * comes up and its deadline is still ahead */
+  if (delta >= LEVEL_SPAN(TIMER_WHEEL_LEVELS)) {
+    delta = LEVEL_SPAN(TIMER_WHEEL_LEVELS) - 1;
+    expires = wheel->tick + delta;
+  }
+  uint8_t level = 0;
+  while (delta >= LEVEL_SPAN(level + 1)) {
+    level++;
+  }
+  timer->level = level;
+  timer->slot = (expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+  wheel_link(wheel, timer);
+}
+
+/* Moves every timer of a slot to the lower levels */
+static void wheel_cascade(l1_timer_wheel* wheel, unsigned level, unsigned slot) {
+  l1_timer* timer = wheel->slots[level][slot];
+  while (timer != NULL) {
+    l1_timer* next = timer->next;
+    wheel_unlink(wheel, timer);
+    wheel_place(wheel, timer);
+    timer = next;
+  }
+}
+
+void timer_wheel_init(l1_timer_wheel* wheel, l1_time now) {
+  *wheel = (l1_timer_wheel){0};
+  wheel->tick = now / TIMER_WHEEL_TICK;
+}
+
+void timer_wheel_add(l1_timer_wheel* wheel, l1_timer* timer, l1_time deadline) {
+  timer->deadline = deadline;
+  timer->expires = deadline / TIMER_WHEEL_TICK + (deadline % TIMER_WHEEL_TICK != 0);
+  wheel_place(wheel, timer);
+}
+
+void timer_wheel_cancel(l1_timer_wheel* wheel, l1_timer* timer) {
+  if (timer->armed) {
+    wheel_unlink(wheel, timer);
+  }
+}
+
+l1_timer* timer_wheel_expire(l1_timer_wheel* wheel, l1_time now) {
+  const uint64_t target = now / TIMER_WHEEL_TICK;
+  l1_timer* expired = NULL;
+  l1_timer** tail = &expired;
+
+  while (wheel->tick <= target) {
+    /* Skip the ticks where nothing can fire: if the lowest k levels are
+     * empty, nothing changes before the next cascade of level k */
+    unsigned empty = 0;
+    while (empty < TIMER_WHEEL_LEVELS && wheel->occupied[empty] == 0) {
+      empty++;
+    }
+    if (empty == TIMER_WHEEL_LEVELS) {
+      wheel->tick = target + 1;
+      break;
+    }
+    if (empty > 0) {
+      uint64_t span = LEVEL_SPAN(empty);
+      uint64_t boundary = (wheel->tick + span - 1) & ~(span - 1);
+      if (boundary > target) {
+        wheel->tick = target + 1;
+        break;
+      }
+      wheel->tick = boundary;
+    }
+
+    unsigned index = wheel->tick & (TIMER_WHEEL_SLOTS - 1);
+    if (index == 0) {
+      for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        unsigned slot = (wheel->tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+        wheel_cascade(wheel, level, slot);
+        if (slot != 0) {
+          break;
+        }
+      }
+    }
+
+    l1_timer* timer = wheel->slots[0][index];
+    while (timer != NULL) {
+      l1_timer* next = timer->next;
+      wheel_unlink(wheel, timer);
+      if (timer->expires <= wheel->tick) {
+        *tail = timer;
+        tail = &timer->next;
+      } else {
+        wheel_place(wheel, timer);
+      }
+      timer = next;
+    }
+    wheel->tick++;
+  }
+  return expired;
+}
+
+l1_time timer_wheel_next_expiry(l1_timer_wheel* wheel) {
+  uint64_t best = UINT64_MAX;
+  if (wheel->occupied[0] != 0) {
+    uint64_t ahead = rotate_right(wheel->occupied[0], wheel->tick);
+    best = wheel->tick + __builtin_ctzll(ahead);
+  }
+  /* A timer of an upper level cannot fire before its slot cascades */
+  for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+    if (wheel->occupied[level] == 0) {
+      continue;
+    }
+    uint64_t span = LEVEL_SPAN(level);
+    uint64_t base = (wheel->tick + span - 1) & ~(span - 1);
+    uint64_t ahead = rotate_right(wheel->occupied[level], base >> (TIMER_WHEEL_BITS * level));
+    uint64_t cascade = base + __builtin_ctzll(ahead) * span;
+    if (cascade < best) {
+      best = cascade;
+    }
+  }
+  return best * TIMER_WHEEL_TICK;
+}
+
+bool timer_wheel_is_empty(l1_timer_wheel* wheel) {
+  return wheel->count == 0;
+}
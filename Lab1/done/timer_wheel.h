@@ -0,0 +1,83 @@
+/**
+ * @file timer_wheel.h
+ * @brief Header file for the hierarchical timer wheel of the scheduler
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "l1_time.h"
+
+/* Granularity of the wheel: a timer fires at the first tick boundary at or
+ * after its deadline, never before. */
+#ifdef USE_UNIX_TIME
+#define TIMER_WHEEL_TICK 1
+#else
+#define TIMER_WHEEL_TICK (1ULL << 16) /* ~65 us */
+#endif
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 5 /* 2^30 ticks, about 19 hours */
+
+/**
+ * @brief A timer, embedded in the object it belongs to.
+ */
+typedef struct l1_timer {
+  struct l1_timer* prev; /* Links in the slot, or in the list of expired timers */
+  struct l1_timer* next;
+  l1_time deadline;      /* When the timer fires */
+  uint64_t expires;      /* Deadline in ticks, rounded up */
+  uint8_t level;         /* Position in the wheel */
+  uint8_t slot;
+  bool armed;            /* In the wheel */
+} l1_timer;
+
+/**
+ * @brief A hierarchical timing wheel (Varghese and Lauck).
+ *
+ * Level l has TIMER_WHEEL_SLOTS slots of TIMER_WHEEL_SLOTS^l ticks each. A
+ * timer goes to the lowest level whose span covers its delay, and moves
+ * down a level each time its slot comes up ("cascades"), so insertion and
+ * cancellation are O(1) and each timer is moved at most
+ * TIMER_WHEEL_LEVELS - 1 times. A bitmap of the non-empty slots of each
+ * level lets advancing skip empty stretches of time.
+ */
+typedef struct l1_timer_wheel {
+  uint64_t tick;                                             /* Next tick to process */
+  size_t count;                                              /* Armed timers */
+  uint64_t occupied[TIMER_WHEEL_LEVELS];                     /* Bit s set iff slot s is non-empty */
+  l1_timer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];    /* Doubly linked, unordered */
+} l1_timer_wheel;
+
+/**
+ * @brief Initializes an empty wheel starting at now.
+ */
+void timer_wheel_init(l1_timer_wheel* wheel, l1_time now);
+
+/**
+ * @brief Arms timer to fire at deadline.
+ * @warning The timer must not be armed.
+ */
+void timer_wheel_add(l1_timer_wheel* wheel, l1_timer* timer, l1_time deadline);
+
+/**
+ * @brief Disarms timer. Does nothing if it is not armed.
+ */
+void timer_wheel_cancel(l1_timer_wheel* wheel, l1_timer* timer);
+
+/**
+ * @brief Advances the wheel to now and disarms the timers that expired.
+ *
+ * @return The expired timers, linked through `next`, or NULL.
+ */
+l1_timer* timer_wheel_expire(l1_timer_wheel* wheel, l1_time now);
+
+/**
+ * @brief Returns a lower bound of the earliest deadline, to sleep until.
+ * @warning The wheel must not be empty.
+ */
+l1_time timer_wheel_next_expiry(l1_timer_wheel* wheel);
+
+/**
+ * @brief Check if no timer is armed
+ */
+bool timer_wheel_is_empty(l1_timer_wheel* wheel);
@@ -0,0 +1,113 @@
+/**
+ * @file trace.c
+ * @brief Implementation of the scheduler event tracing.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+__thread l1_trace_buffer *l1_trace_local = NULL;
+
+/* Buffers of every OS thread that recorded an event, never freed */
+static l1_trace_buffer *l1_trace_buffers[L1_TRACE_MAX_BUFFERS];
+static _Atomic unsigned l1_trace_buffer_count = 0;
+
+static const char *const l1_trace_names[L1_TRACE_NUM_KINDS] = {
+    [L1_TRACE_SWITCH_IN] = "run",
+    [L1_TRACE_SWITCH_OUT] = "run",
+    [L1_TRACE_BLOCK] = "block",
+    [L1_TRACE_UNBLOCK] = "unblock",
+    [L1_TRACE_ZOMBIE] = "zombie",
+    [L1_TRACE_DEAD] = "dead",
+};
+
+l1_trace_buffer *l1_trace_local_init(void)
+{
+  unsigned index = atomic_fetch_add(&l1_trace_buffer_count, 1);
+  l1_trace_buffer *buffer = calloc(1, sizeof(l1_trace_buffer));
+  if (index >= L1_TRACE_MAX_BUFFERS || buffer == NULL)
+  {
+    fprintf(stderr, "Error: unable to allocate a trace buffer\n");
+    exit(-1);
+  }
+  buffer->index = index;
+  l1_trace_buffers[index] = buffer;
+  l1_trace_local = buffer;
+  return buffer;
+}
+
+/* Timestamp in microseconds, on the time line of l1_time */
+static double l1_trace_usec(const l1_trace_event *event)
+{
+  uint64_t ns = event->stamp;
+#if !defined(USE_UNIX_TIME) && !defined(USE_CLOCK_GETTIME)
+  if (event->tsc)
+  {
+    __extension__ typedef unsigned __int128 l1_u128;
+    ns = l1_ns_base + (uint64_t)(((l1_u128)(event->stamp - l1_tsc_base) * l1_tsc_mult) >> 32);
+  }
+#endif
+  return (double)ns / L1_NSEC_PER_USEC;
+}
+
+static void l1_trace_dump_event(FILE *out, const l1_trace_buffer *buffer,
+                                const l1_trace_event *event, bool first)
+{
+  fprintf(out, "%s\n{\"name\":\"%s\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,", first ? "" : ",",
+          l1_trace_names[event->kind], (int)event->tid, l1_trace_usec(event));
+  switch (event->kind)
+  {
+  case L1_TRACE_SWITCH_IN:
+    fprintf(out, "\"ph\":\"B\",\"args\":{\"worker\":%u}}", buffer->index);
+    break;
+  case L1_TRACE_SWITCH_OUT:
+    fprintf(out, "\"ph\":\"E\",\"args\":{\"state\":%u}}", event->arg);
+    break;
+  default:
+    fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"args\":{\"arg\":%u,\"worker\":%u}}",
+            event->arg, buffer->index);
+    break;
+  }
+}
+
+l1_error l1_trace_dump(const char *path)
+{
+  FILE *out = fopen(path, "w");
+  if (out == NULL)
+  {
+    return ERRINVAL;
+  }
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool first = true;
+  unsigned count = atomic_load(&l1_trace_buffer_count);
+  for (unsigned i = 0; i < count && i < L1_TRACE_MAX_BUFFERS; i++)
+  {
+    l1_trace_buffer *buffer = l1_trace_buffers[i];
+    if (buffer == NULL)
+    {
+      continue;
+    }
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+    uint64_t start = (head > L1_TRACE_EVENTS) ? head - L1_TRACE_EVENTS : 0;
+    for (uint64_t seq = start; seq < head; seq++)
+    {
+      l1_trace_dump_event(out, buffer, &buffer->events[seq & (L1_TRACE_EVENTS - 1)], first);
+      first = false;
+    }
+  }
+  fprintf(out, "\n]}\n");
+  return (fclose(out) == 0) ? SUCCESS : ERRINVAL;
+}
+
+void l1_trace_clear(void)
+{
+  unsigned count = atomic_load(&l1_trace_buffer_count);
+  for (unsigned i = 0; i < count && i < L1_TRACE_MAX_BUFFERS; i++)
+  {
+    if (l1_trace_buffers[i] != NULL)
+    {
+      atomic_store(&l1_trace_buffers[i]->head, 0);
+    }
+  }
+}
@@ -0,0 +1,117 @@
+/**
+ * @file trace.h
+ * @brief Scheduler event tracing, dumped as Chrome trace JSON
+ *
+ * schedule.c records the switches and the state changes of the threads with
+ * L1_TRACE_EVENT, which compiles to nothing unless L1_TRACE is defined (see
+ * the Makefile). An event is a TSC timestamp, a thread id and a kind, stored
+ * in a ring buffer private to the OS thread, so to the worker, that records
+ * it: there is a single writer per buffer and no lock, and the oldest
+ * events are overwritten once L1_TRACE_EVENTS are buffered.
+ *
+ * l1_trace_dump writes the buffers of every worker in the Chrome trace
+ * format, which chrome://tracing and ui.perfetto.dev open: one row per green
+ * thread, with a slice for every run and instant events for the rest.
+ */
+#pragma once
+#include <stdatomic.h>
+#include <stdint.h>
+#include "error.h"
+#include "l1_time.h"
+
+#define L1_TRACE_EVENTS (1 << 16) /* Per worker, a power of two */
+#define L1_TRACE_MAX_BUFFERS 128
+
+typedef enum
+{
+  L1_TRACE_SWITCH_IN,  /* Starts running */
+  L1_TRACE_SWITCH_OUT, /* Stops running, arg is its new state */
+  L1_TRACE_BLOCK,      /* Parked BLOCKED, arg is the wait reason */
+  L1_TRACE_UNBLOCK,    /* Made RUNNABLE again, arg is the error it gets */
+  L1_TRACE_ZOMBIE,     /* Returned */
+  L1_TRACE_DEAD,       /* Released */
+  L1_TRACE_NUM_KINDS
+} l1_trace_kind;
+
+typedef struct
+{
+  uint64_t stamp; /* TSC, or ns if !tsc */
+  uint32_t tid;
+  uint8_t kind;
+  uint8_t tsc;
+  uint16_t arg;
+} l1_trace_event;
+
+typedef struct
+{
+  _Atomic uint64_t head; /* Events ever recorded, published after each write */
+  unsigned index;        /* In the registry, shown as the worker */
+  l1_trace_event events[L1_TRACE_EVENTS];
+} l1_trace_buffer;
+
+/* Buffer of the calling OS thread, NULL until its first event */
+extern __thread l1_trace_buffer *l1_trace_local;
+
+/**
+ * @brief Allocates and registers the buffer of the calling OS thread.
+ */
+l1_trace_buffer *l1_trace_local_init(void);
+
+/**
+ * @brief Records an event of thread tid in the buffer of the caller.
+ */
+static inline void l1_trace_record(l1_trace_kind kind, uint32_t tid, uint16_t arg)
+{
+  l1_trace_buffer *buffer = l1_trace_local;
+  if (__builtin_expect(buffer == NULL, 0))
+  {
+    buffer = l1_trace_local_init();
+  }
+  uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+  l1_trace_event *event = &buffer->events[head & (L1_TRACE_EVENTS - 1)];
+#if defined(USE_UNIX_TIME) || defined(USE_CLOCK_GETTIME)
+  event->stamp = l1_time_monotonic_ns();
+  event->tsc = 0;
+#else
+  /* Converted at dump time, with the calibration of l1_time */
+  if (__builtin_expect(l1_tsc_mult != 0, 1))
+  {
+    unsigned int lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    event->stamp = ((uint64_t)hi << 32) | lo;
+    event->tsc = 1;
+  }
+  else
+  {
+    event->stamp = l1_time_monotonic_ns();
+    event->tsc = 0;
+  }
+#endif
+  event->tid = tid;
+  event->kind = kind;
+  event->arg = arg;
+  atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+#ifdef L1_TRACE
+#define L1_TRACE_EVENT(kind, thread, arg) l1_trace_record((kind), (thread)->id, (uint16_t)(arg))
+#else
+#define L1_TRACE_EVENT(kind, thread, arg) ((void)0)
+#endif
+
+/**
+ * @brief Writes the buffered events of every worker to path, as Chrome
+ * trace JSON.
+ *
+ * Meant to be called once the workers stopped: events recorded during the
+ * dump may be missed, and the oldest ones overwritten while being read.
+ *
+ * @return SUCCESS, or ERRINVAL if path cannot be written.
+ */
+l1_error l1_trace_dump(const char *path);
+
+/**
+ * @brief Drops the buffered events of every worker. No worker may record
+ * events meanwhile.
+ */
+void l1_trace_clear(void);
@@ -0,0 +1,264 @@
+/**
+ * @file worker.c
+ * @brief Implementation of the M:N mode and of the work stealing policy.
+ */
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "worker.h"
+
+//========================================================================================
+static void l1_futex_wait(int *word, int expected)
+{
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void l1_futex_wake(int *word, int count)
+{
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/* New work for a parked worker. seq_cst pairs with the increment of parked
+ * in l1_runtime_park: either we see the parked worker, or it sees the new
+ * work_seq in futex_wait. */
+static void l1_runtime_notify(l1_runtime *runtime)
+{
+  __atomic_fetch_add(&runtime->work_seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&runtime->parked, __ATOMIC_SEQ_CST) > 0)
+  {
+    l1_futex_wake(&runtime->work_seq, 1);
+  }
+}
+
+/* Sleeps until work_seq moves away from seq */
+static void l1_runtime_park(l1_runtime *runtime, int seq)
+{
+  __atomic_fetch_add(&runtime->parked, 1, __ATOMIC_SEQ_CST);
+  l1_futex_wait(&runtime->work_seq, seq);
+  __atomic_fetch_sub(&runtime->parked, 1, __ATOMIC_SEQ_CST);
+}
+
+/* The run is over once no thread is RUNNABLE, running ones included.
+ * Wakes every parked worker so they can leave schedule() too. */
+static bool l1_runtime_is_done(l1_runtime *runtime)
+{
+  pthread_mutex_lock(&runtime->lock);
+  bool done = thread_list_is_empty(&runtime->thread_arrays[RUNNABLE]);
+  pthread_mutex_unlock(&runtime->lock);
+  if (done)
+  {
+    __atomic_fetch_add(&runtime->work_seq, 1, __ATOMIC_SEQ_CST);
+    l1_futex_wake(&runtime->work_seq, INT_MAX);
+  }
+  return done;
+}
+//========================================================================================
+static void l1_ws_init(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_ws_state *state = calloc(1, sizeof(l1_ws_state));
+  if (state == NULL)
+  {
+    fprintf(stderr, "Error: unable to allocate the policy run queue\n");
+    exit(-1);
+  }
+  thread_deque_init(&state->deque);
+  scheduler->policy_state = state;
+}
+
+static void l1_ws_destroy(void)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_ws_state *state = scheduler->policy_state;
+  thread_deque_destroy(&state->deque);
+  free(state);
+  scheduler->policy_state = NULL;
+}
+
+static void l1_ws_enqueue(l1_thread_info *thread)
+{
+  l1_ws_state *state = get_scheduler()->policy_state;
+  thread_deque_push(&state->deque, thread);
+  if (state->runtime != NULL)
+  {
+    l1_runtime_notify(state->runtime);
+  }
+}
+
+/** Remembers whether prev is about to be requeued, i.e. it yielded */
+static void l1_ws_tick(l1_thread_info *prev)
+{
+  l1_ws_state *state = get_scheduler()->policy_state;
+  state->prev_yielded = (prev->state == RUNNING);
+}
+
+/** Tries every other worker once, starting from the last successful victim */
+static l1_thread_info *l1_ws_steal(l1_ws_state *state, unsigned self)
+{
+  l1_runtime *runtime = state->runtime;
+  for (unsigned i = 0; i < runtime->workers; i++)
+  {
+    unsigned victim = (state->victim + i) % runtime->workers;
+    if (victim == self)
+    {
+      continue;
+    }
+    l1_thread_info *next = thread_deque_steal(runtime->deques[victim]);
+    if (next != NULL)
+    {
+      state->victim = victim;
+      return next;
+    }
+  }
+  return NULL;
+}
+
+/** Own deque first, then the others, then park until there is work */
+static l1_thread_info *l1_ws_pick_next(l1_thread_info *prev)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_ws_state *state = scheduler->policy_state;
+  l1_runtime *runtime = state->runtime;
+  for (;;)
+  {
+    /* Read before looking, so that work pushed meanwhile cancels the park */
+    int seq = (runtime != NULL) ? __atomic_load_n(&runtime->work_seq, __ATOMIC_SEQ_CST) : 0;
+
+    l1_thread_info *next = state->prev_yielded ? thread_deque_steal(&state->deque)
+                                               : thread_deque_pop(&state->deque);
+    if (next != NULL)
+    {
+      return next;
+    }
+    if (runtime == NULL)
+    {
+      return NULL;
+    }
+    next = l1_ws_steal(state, scheduler->worker_id);
+    if (next != NULL)
+    {
+      return next;
+    }
+    if (l1_runtime_is_done(runtime))
+    {
+      return NULL;
+    }
+    l1_runtime_park(runtime, seq);
+  }
+}
+
+const sched_policy l1_work_stealing_policy = {
+    .init = l1_ws_init,
+    .enqueue = l1_ws_enqueue,
+    .dequeue = NULL,
+    .pick_next = l1_ws_pick_next,
+    .tick = l1_ws_tick,
+    .destroy = l1_ws_destroy,
+};
+//========================================================================================
+/* Makes the scheduler of the calling OS thread a worker of runtime */
+static void l1_worker_attach(l1_runtime *runtime, unsigned id)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  l1_ws_state *state = scheduler->policy_state;
+  scheduler->runtime = runtime;
+  scheduler->worker_id = id;
+  scheduler->thread_arrays = runtime->thread_arrays;
+  state->runtime = runtime;
+  state->victim = (id + 1) % runtime->workers;
+  runtime->deques[id] = &state->deque;
+}
+
+static void *l1_worker_main(void *arg)
+{
+  l1_runtime *runtime = arg;
+  initialize_scheduler(runtime->policy);
+
+  pthread_mutex_lock(&runtime->lock);
+  unsigned id = 1;
+  while (runtime->deques[id] != NULL)
+  {
+    id++;
+  }
+  l1_worker_attach(runtime, id);
+  pthread_mutex_unlock(&runtime->lock);
+
+  pthread_barrier_wait(&runtime->started);
+  schedule();
+  pthread_barrier_wait(&runtime->stopped);
+  clean_up_scheduler();
+  return NULL;
+}
+
+l1_error l1_workers_run(unsigned workers)
+{
+  l1_scheduler_info *scheduler = get_scheduler();
+  if (scheduler == NULL || scheduler->policy != &l1_work_stealing_policy ||
+      scheduler->preempt_mode != 0)
+  {
+    return ERRINVAL;
+  }
+  if (workers == 0)
+  {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = (online > 0) ? online : 1;
+  }
+  if (workers > L1_MAX_WORKERS)
+  {
+    workers = L1_MAX_WORKERS;
+  }
+
+  l1_runtime *runtime = calloc(1, sizeof(l1_runtime));
+  pthread_t *threads = calloc(workers, sizeof(pthread_t));
+  if (runtime == NULL || threads == NULL)
+  {
+    fprintf(stderr, "Error: unable to allocate the workers\n");
+    exit(-1);
+  }
+  pthread_mutex_init(&runtime->lock, NULL);
+  pthread_barrier_init(&runtime->started, NULL, workers);
+  pthread_barrier_init(&runtime->stopped, NULL, workers);
+  runtime->workers = workers;
+  runtime->policy = scheduler->policy;
+
+  /* The threads created so far move to the shared lists */
+  memcpy(runtime->thread_arrays, scheduler->thread_arrays, sizeof(runtime->thread_arrays));
+  runtime->next_tid = scheduler->next_tid;
+  l1_worker_attach(runtime, 0);
+
+  for (unsigned i = 1; i < workers; i++)
+  {
+    if (pthread_create(&threads[i], NULL, l1_worker_main, runtime) != 0)
+    {
+      fprintf(stderr, "Error: unable to start a worker\n");
+      exit(-1);
+    }
+  }
+  pthread_barrier_wait(&runtime->started);
+  schedule();
+  pthread_barrier_wait(&runtime->stopped);
+  for (unsigned i = 1; i < workers; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+
+  /* Back to a single scheduler */
+  l1_ws_state *state = scheduler->policy_state;
+  memcpy(scheduler->local_arrays, runtime->thread_arrays, sizeof(scheduler->local_arrays));
+  scheduler->thread_arrays = scheduler->local_arrays;
+  scheduler->next_tid = runtime->next_tid;
+  scheduler->runtime = NULL;
+  scheduler->worker_id = 0;
+  state->runtime = NULL;
+
+  pthread_barrier_destroy(&runtime->started);
+  pthread_barrier_destroy(&runtime->stopped);
+  pthread_mutex_destroy(&runtime->lock);
+  free(runtime);
+  free(threads);
+  return SUCCESS;
+}
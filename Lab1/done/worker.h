@@ -0,0 +1,70 @@
+/**
+ * @file worker.h
+ * @brief M:N mode: green threads run by several OS worker threads
+ */
+#pragma once
+#include <pthread.h>
+#include <stdbool.h>
+#include "error.h"
+#include "schedule.h"
+#include "thread_deque.h"
+
+#define L1_MAX_WORKERS 64
+
+/* In M:N mode every worker is an OS thread with its own l1_scheduler_info,
+ * tsys and work-stealing deque (get_scheduler() is thread local). A green
+ * thread may resume on another worker than the one it yielded from, which
+ * is safe because it only ever switches to the tsys of its worker and only
+ * reads the scheduler through get_scheduler() after a switch. That accessor
+ * is never inlined and never reused across calls, so the thread local
+ * address is computed on the worker the thread resumed on.
+ *
+ * The thread lists, used for tid lookups and joins, are shared by all the
+ * workers under a single lock, the run queues are not. */
+typedef struct l1_runtime
+{
+  pthread_mutex_t lock;                            /** Protects thread_arrays and next_tid */
+  l1_thread_list thread_arrays[NUM_THREAD_STATES]; /** Shared thread lists */
+  l1_tid next_tid;                                 /** Next thread */
+  unsigned workers;                                /** Number of workers */
+  l1_thread_deque *deques[L1_MAX_WORKERS];         /** Run queue of each worker */
+  int work_seq;                                    /** Futex word, bumped when work is pushed or the run ends */
+  int parked;                                      /** Workers waiting on work_seq */
+  pthread_barrier_t started;                       /** Every deque is registered */
+  pthread_barrier_t stopped;                       /** Nobody steals anymore */
+  const sched_policy *policy;                      /** Policy of every worker */
+} l1_runtime;
+
+/* Work stealing: every worker pushes the threads it makes RUNNABLE in its own
+ * deque. It runs the newest one after a thread blocked or exited, which is
+ * usually the child it just spawned, and the oldest one after a yield, so
+ * yielding threads take turns. An idle worker steals the oldest thread of
+ * the other workers, and parks on a futex when they are all empty.
+ * The deque cannot remove arbitrary threads, so dequeue is NULL and
+ * directed yields are plain yields with this policy. */
+typedef struct
+{
+  l1_thread_deque deque; /* RUNNABLE threads pushed by this worker */
+  l1_runtime *runtime;   /* NULL outside of l1_workers_run */
+  unsigned victim;       /* Worker to try stealing from first */
+  bool prev_yielded;     /* The thread that just ran is RUNNABLE again */
+} l1_ws_state;
+
+extern const sched_policy l1_work_stealing_policy;
+
+/**
+ * @brief Runs the green threads on several OS threads until none is
+ * runnable.
+ *
+ * M:N counterpart of schedule(): the scheduler of the calling OS thread, set
+ * up with initialize_scheduler(&l1_work_stealing_policy), becomes worker 0
+ * and `workers` - 1 other OS threads are started, each with its own tsys.
+ * l1_thread_create and l1_thread_join work the same from any worker.
+ * When the function returns, the remaining threads are back in the lists of
+ * the calling scheduler, which is cleaned up with clean_up_scheduler.
+ *
+ * @param workers  Number of workers, 0 for one per online processor.
+ * @return SUCCESS, or ERRINVAL if the scheduler does not use the work
+ *         stealing policy or preemption is on (M:N mode is cooperative).
+ */
+l1_error l1_workers_run(unsigned workers);